@@ -0,0 +1,449 @@
+#include "BitGemm.h"
+
+/*
+ * Both kernels are written once as always inlined helpers and instantiated twice, once for the
+ * default target and once compiled with the hardware popcount instruction, the faster one is
+ * picked at runtime so the mex still loads on machines without it.
+ */
+
+/*
+ * A segment the arena lists as sparse is not read from its planes. Every listed sample tests its bit
+ * in the three planes of the other SNP, and the cells of the homozygous major genotype of the listed
+ * side follow from the genotype counts of the segments. When both segments are sparse the shorter
+ * lists are tested, which is cheaper than merging the two since each test is independent of the
+ * last. A pair of rare variants so costs time in their carriers, the samples off the homozygous
+ * major genotype, instead of in the sample words.
+ */
+
+//Indexed segments of the Snps of a tile, NULL for a Snp whose arena is not indexed
+struct TileSegments
+{
+    const SparseSegment * segments_[BITGEMM_TILE];
+    const uint32_t * entries_[BITGEMM_TILE];
+    bool anySparse_;
+
+    void load(const Snp * snps, int n, int segment)
+    {
+        anySparse_ = false;
+        for(int i=0; i<n; ++i)
+        {
+            const SparseSegment * segments = snps[i].getSparseSegments();
+            segments_[i] = segments == NULL ? NULL : &segments[segment];
+            entries_[i] = segments == NULL ? NULL : snps[i].getArena()->getEntries(segments[segment]);
+            anySparse_ = anySparse_ || (segments != NULL && segments[segment].sparse_);
+        }
+    }
+
+    //Whether the pair is counted from the lists rather than the planes
+    bool sparsePair(int i, const TileSegments & other, int j)const
+    {
+        return segments_[i] != NULL && other.segments_[j] != NULL && (segments_[i]->sparse_ || other.segments_[j]->sparse_);
+    }
+};
+
+//The indexed segments of every tile of snps, loaded once for all the sample blocks
+static inline void loadTiles(const Snp * snps, int n, int segment, vector<TileSegments> & tiles)
+{
+    tiles.resize((n + BITGEMM_TILE - 1)/BITGEMM_TILE);
+    for(int t=0; t<tiles.size(); ++t)
+        tiles[t].load(snps + t*BITGEMM_TILE, min(BITGEMM_TILE, n - t*BITGEMM_TILE), segment);
+}
+
+/*
+ * A sample block holds the block of every plane of a panel of a and a panel of b in BITGEMM_L2_BYTES.
+ * The panels are capped so a block is never cut below one chunk: past that the panels of b are
+ * walked one after the other, each against the whole panel of a, instead of the block outgrowing L2.
+ */
+struct BlockPanels
+{
+    //SNPs of a and of b per panel, all of them or whole tiles
+    int a_;
+    int b_;
+    //Words per sample block, whole chunks
+    int words_;
+};
+
+static inline BlockPanels blockPanels(int na, int nb, int planes)
+{
+    int maxSnps = BITGEMM_L2_BYTES/(planes*BITGEMM_CHUNK_WORDS*(int)sizeof(PACK_TYPE));
+    BlockPanels retVal;
+    retVal.a_ = na <= maxSnps/2 ? na : max(BITGEMM_TILE, maxSnps/2/BITGEMM_TILE*BITGEMM_TILE);
+    int restSnps = max(BITGEMM_TILE, (maxSnps - retVal.a_)/BITGEMM_TILE*BITGEMM_TILE);
+    retVal.b_ = nb <= maxSnps - retVal.a_ ? nb : restSnps;
+    int words = BITGEMM_L2_BYTES/((retVal.a_ + retVal.b_)*planes*(int)sizeof(PACK_TYPE));
+    retVal.words_ = max(BITGEMM_CHUNK_WORDS, words/BITGEMM_CHUNK_WORDS*BITGEMM_CHUNK_WORDS);
+    return retVal;
+}
+
+//Three counts packed FIELD_BITS apart, one row of a cross table in a register, flushed before a field can overflow
+#define FIELD_BITS 21
+#define FIELD_CAPACITY ((1<<FIELD_BITS)-1)
+
+//Adds to row the bits in the three planes of every listed sample
+static inline __attribute__((always_inline)) void crossList(const uint32_t * samples, int size, const PACK_TYPE * planes, int words, int * row)
+{
+    for(int e0=0; e0<size; e0+=FIELD_CAPACITY)
+    {
+        int end = min(size, e0+FIELD_CAPACITY);
+        uint64_t fields = 0;
+        for(int e=e0; e<end; ++e)
+        {
+            const PACK_TYPE * word = planes + samples[e]/PACK_SIZE;
+            int bit = samples[e]%PACK_SIZE;
+            fields += ((word[0] >> bit) & 1) | ((word[words] >> bit) & 1) << FIELD_BITS | ((word[2*words] >> bit) & 1) << 2*FIELD_BITS;
+        }
+        for(int k=0; k<GENOTYPE_LEVELS; ++k)
+            row[k] += (fields >> (FIELD_BITS*k)) & FIELD_CAPACITY;
+    }
+}
+
+//Cells i + 3*j of level i of a sparse segment with level j of another, whose planes start at planes
+static inline __attribute__((always_inline)) void crossSparse(const SparseSegment & sparse, const uint32_t * entries,
+                                                               const SparseSegment & other, const PACK_TYPE * planes, int words, int * cells)
+{
+    int cross[GENOTYPE_LEVELS+1][GENOTYPE_LEVELS] = {{0}};
+    for(int level=1; level<=UNKNOWN_LEVEL; ++level)
+    {
+        crossList(entries, sparse.counts_[level], planes, words, cross[level]);
+        entries += sparse.counts_[level];
+    }
+    for(int j=0; j<GENOTYPE_LEVELS; ++j)
+    {
+        cells[1 + GENOTYPE_LEVELS*j] = cross[1][j];
+        cells[2 + GENOTYPE_LEVELS*j] = cross[2][j];
+        cells[GENOTYPE_LEVELS*j] = other.counts_[j] - cross[1][j] - cross[2][j] - cross[UNKNOWN_LEVEL][j];
+    }
+}
+
+//Whether the pair is counted from the lists of its first SNP, the shorter ones when both are sparse
+static inline bool listFirst(const SparseSegment & a, const SparseSegment & b)
+{
+    return a.sparse_ && (!b.sparse_ || a.size() <= b.size());
+}
+
+//The 9 cells of one segment of a pair with a sparse side, pa and pb at the start of the segment
+static inline __attribute__((always_inline)) void countSparsePair(const TileSegments & sa, int i, const PACK_TYPE * pa,
+                                                                   const TileSegments & sb, int j, const PACK_TYPE * pb, int words, int * cells)
+{
+    const SparseSegment & a = *sa.segments_[i];
+    const SparseSegment & b = *sb.segments_[j];
+    if(listFirst(a, b))
+        crossSparse(a, sa.entries_[i], b, pb, words, cells);
+    else
+    {
+        int transposed[GENOTYPE_PAIRINGS];
+        crossSparse(b, sb.entries_[j], a, pa, words, transposed);
+        for(int x=0; x<GENOTYPE_LEVELS; ++x)
+            for(int y=0; y<GENOTYPE_LEVELS; ++y)
+                cells[x + GENOTYPE_LEVELS*y] = transposed[y + GENOTYPE_LEVELS*x];
+    }
+}
+
+//Adds the 9 plane pairings of words [begin, end) of one sample segment of a tile pair to counts, tables of tableCells ints
+static inline __attribute__((always_inline)) void countSegment(const Snp * a, int na, const Snp * b, int nb, int stride, int start, int words,
+                                                                int begin, int end, const TileSegments & sa, const TileSegments & sb,
+                                                                int tableCells, int cellOffset, int * counts)
+{
+    bool anySparse = sa.anySparse_ || sb.anySparse_;
+    for(int w0=begin; w0<end; w0+=BITGEMM_CHUNK_WORDS)
+    {
+        int chunk = min(BITGEMM_CHUNK_WORDS, end-w0);
+        for(int i=0; i<na; ++i)
+        {
+            const PACK_TYPE * pa = a[i].allSamples_ + start + w0;
+            for(int j=0; j<nb; ++j)
+            {
+                if(anySparse && sa.sparsePair(i, sb, j))
+                    continue;
+                const PACK_TYPE * pb = b[j].allSamples_ + start + w0;
+                int c[GENOTYPE_PAIRINGS] = {0};
+                for(int w=0; w<chunk; ++w)
+                {
+                    PACK_TYPE a0 = pa[w]; PACK_TYPE a1 = pa[w+words]; PACK_TYPE a2 = pa[w+2*words];
+                    PACK_TYPE b0 = pb[w]; PACK_TYPE b1 = pb[w+words]; PACK_TYPE b2 = pb[w+2*words];
+
+                    c[0] += POPCOUNT_FUNCTION(a0 & b0); c[1] += POPCOUNT_FUNCTION(a1 & b0); c[2] += POPCOUNT_FUNCTION(a2 & b0);
+                    c[3] += POPCOUNT_FUNCTION(a0 & b1); c[4] += POPCOUNT_FUNCTION(a1 & b1); c[5] += POPCOUNT_FUNCTION(a2 & b1);
+                    c[6] += POPCOUNT_FUNCTION(a0 & b2); c[7] += POPCOUNT_FUNCTION(a1 & b2); c[8] += POPCOUNT_FUNCTION(a2 & b2);
+                }
+                int * t = counts + (i*stride+j)*tableCells + cellOffset;
+                for(int k=0; k<GENOTYPE_PAIRINGS; ++k)
+                    t[k] += c[k];
+            }
+        }
+    }
+}
+
+//Adds the 9 cells of one whole segment of the pairs of a tile with a sparse side
+static inline __attribute__((always_inline)) void countSparseSegment(const Snp * a, int na, const Snp * b, int nb, int stride, int start, int words,
+                                                                      const TileSegments & sa, const TileSegments & sb,
+                                                                      int tableCells, int cellOffset, int * counts)
+{
+    for(int i=0; i<na; ++i)
+        for(int j=0; j<nb; ++j)
+            if(sa.sparsePair(i, sb, j))
+            {
+                int c[GENOTYPE_PAIRINGS];
+                countSparsePair(sa, i, a[i].allSamples_ + start, sb, j, b[j].allSamples_ + start, words, c);
+                int * t = counts + (i*stride+j)*tableCells + cellOffset;
+                for(int k=0; k<GENOTYPE_PAIRINGS; ++k)
+                    t[k] += c[k];
+            }
+}
+
+//Adds the tables of one segment of every pair of a x b, the dense pairs a sample block at a time
+static inline __attribute__((always_inline)) void countSegments(const Snp * a, int na, const Snp * b, int nb, int start, int words,
+                                                                 int segment, int tableCells, int cellOffset, int * counts)
+{
+    static thread_local vector<TileSegments> tilesA;
+    static thread_local vector<TileSegments> tilesB;
+    loadTiles(a, na, segment, tilesA);
+    loadTiles(b, nb, segment, tilesB);
+
+    BlockPanels panels = blockPanels(na, nb, GENOTYPE_LEVELS);
+    for(int ia=0; ia<na; ia+=panels.a_)
+        for(int jb=0; jb<nb; jb+=panels.b_)
+            for(int w0=0; w0<words; w0+=panels.words_)
+                for(int i=ia; i<min(na, ia+panels.a_); i+=BITGEMM_TILE)
+                    for(int j=jb; j<min(nb, jb+panels.b_); j+=BITGEMM_TILE)
+                        countSegment(a+i, min(BITGEMM_TILE, na-i), b+j, min(BITGEMM_TILE, nb-j), nb, start, words, w0, min(words, w0+panels.words_),
+                                     tilesA[i/BITGEMM_TILE], tilesB[j/BITGEMM_TILE], tableCells, cellOffset, counts + (i*nb+j)*tableCells);
+
+    for(int i=0; i<na; i+=BITGEMM_TILE)
+        for(int j=0; j<nb; j+=BITGEMM_TILE)
+            if(tilesA[i/BITGEMM_TILE].anySparse_ || tilesB[j/BITGEMM_TILE].anySparse_)
+                countSparseSegment(a+i, min(BITGEMM_TILE, na-i), b+j, min(BITGEMM_TILE, nb-j), nb, start, words,
+                                   tilesA[i/BITGEMM_TILE], tilesB[j/BITGEMM_TILE], tableCells, cellOffset, counts + (i*nb+j)*tableCells);
+}
+
+static inline __attribute__((always_inline)) void countTablesHelper(const Snp * a, int na, const Snp * b, int nb, int * counts)
+{
+    fill(counts, counts + na*nb*TABLE_CELLS, 0);
+    countSegments(a, na, b, nb, 0, Snp::getControlWords(), 0, TABLE_CELLS, 0, counts);
+    countSegments(a, na, b, nb, Snp::getCaseStart(), Snp::getCaseWords(), 1, TABLE_CELLS, GENOTYPE_PAIRINGS, counts);
+}
+
+static inline __attribute__((always_inline)) void countCaseTablesHelper(const Snp * a, int na, const Snp * b, int nb, int * counts)
+{
+    fill(counts, counts + na*nb*GENOTYPE_PAIRINGS, 0);
+    countSegments(a, na, b, nb, Snp::getCaseStart(), Snp::getCaseWords(), 1, GENOTYPE_PAIRINGS, 0, counts);
+}
+
+//Adds the level pairings of a collapsed model, each level plane ORed from the genotype planes as it is read
+template<class Model>
+static inline __attribute__((always_inline)) void countModelSegment(const Snp * a, int na, const Snp * b, int nb, int stride,
+                                                                     int start, int words, int begin, int end, int cellOffset, int * counts)
+{
+    const int cells = Model::levels*Model::levels*CONTINGENCY_COLUMNS;
+    for(int w0=begin; w0<end; w0+=BITGEMM_CHUNK_WORDS)
+    {
+        int chunk = min(BITGEMM_CHUNK_WORDS, end-w0);
+        for(int i=0; i<na; ++i)
+        {
+            const PACK_TYPE * pa = a[i].allSamples_ + start + w0;
+            for(int j=0; j<nb; ++j)
+            {
+                const PACK_TYPE * pb = b[j].allSamples_ + start + w0;
+                int c[4] = {0};
+                for(int w=0; w<chunk; ++w)
+                {
+                    PACK_TYPE a0 = Model::plane(pa, words, 0, w); PACK_TYPE a1 = Model::plane(pa, words, 1, w);
+                    PACK_TYPE b0 = Model::plane(pb, words, 0, w); PACK_TYPE b1 = Model::plane(pb, words, 1, w);
+
+                    c[0] += POPCOUNT_FUNCTION(a0 & b0); c[1] += POPCOUNT_FUNCTION(a1 & b0);
+                    c[2] += POPCOUNT_FUNCTION(a0 & b1); c[3] += POPCOUNT_FUNCTION(a1 & b1);
+                }
+                int * t = counts + (i*stride+j)*cells + cellOffset;
+                for(int k=0; k<4; ++k)
+                    t[k] += c[k];
+            }
+        }
+    }
+}
+
+template<class Model>
+static inline __attribute__((always_inline)) void countModelTablesHelper(const Snp * a, int na, const Snp * b, int nb, int * counts)
+{
+    const int cells = Model::levels*Model::levels*CONTINGENCY_COLUMNS;
+    fill(counts, counts + na*nb*cells, 0);
+
+    const int starts[2] = {0, Snp::getCaseStart()};
+    const int words[2] = {Snp::getControlWords(), Snp::getCaseWords()};
+    BlockPanels panels = blockPanels(na, nb, GENOTYPE_LEVELS);
+    for(int s=0; s<2; ++s)
+        for(int ia=0; ia<na; ia+=panels.a_)
+            for(int jb=0; jb<nb; jb+=panels.b_)
+                for(int w0=0; w0<words[s]; w0+=panels.words_)
+                    for(int i=ia; i<min(na, ia+panels.a_); i+=BITGEMM_TILE)
+                        for(int j=jb; j<min(nb, jb+panels.b_); j+=BITGEMM_TILE)
+                            countModelSegment<Model>(a+i, min(BITGEMM_TILE, na-i), b+j, min(BITGEMM_TILE, nb-j), nb, starts[s], words[s],
+                                                     w0, min(words[s], w0+panels.words_), s*Model::levels*Model::levels, counts + (i*nb+j)*cells);
+}
+
+//Heterozygous and homozygous minor matches of a sparse segment with another, whose planes start at planes
+static inline __attribute__((always_inline)) int popCoverSparse(const SparseSegment & sparse, const uint32_t * entries,
+                                                                 const PACK_TYPE * planes, int words)
+{
+    int retVal = 0;
+    for(int level=1; level<GENOTYPE_LEVELS; ++level)
+    {
+        const PACK_TYPE * plane = planes + level*words;
+        for(int e=0; e<sparse.counts_[level]; ++e)
+            retVal += (plane[entries[e]/PACK_SIZE] >> (entries[e]%PACK_SIZE)) & 1;
+        entries += sparse.counts_[level];
+    }
+    return retVal;
+}
+
+//Heterozygous and homozygous minor diagonal matches of words [begin, end) of one segment, added with the given sign
+static inline __attribute__((always_inline)) void popCoverSegment(const Snp * a, int na, const Snp * b, int nb, int stride, int start, int words,
+                                                                   int begin, int end, const TileSegments & sa, const TileSegments & sb,
+                                                                   int sign, int * popCovers)
+{
+    bool anySparse = sa.anySparse_ || sb.anySparse_;
+    for(int w0=begin; w0<end; w0+=BITGEMM_CHUNK_WORDS)
+    {
+        int chunk = min(BITGEMM_CHUNK_WORDS, end-w0);
+        for(int i=0; i<na; ++i)
+        {
+            const PACK_TYPE * pa = a[i].allSamples_ + start + words + w0;
+            for(int j=0; j<nb; ++j)
+            {
+                if(anySparse && sa.sparsePair(i, sb, j))
+                    continue;
+                const PACK_TYPE * pb = b[j].allSamples_ + start + words + w0;
+                int c = 0;
+                for(int w=0; w<chunk; ++w)
+                    c += POPCOUNT_FUNCTION(BitGemm::minorMatches(pa, pb, w, words));
+                popCovers[i*stride+j] += sign*c;
+            }
+        }
+    }
+}
+
+//Matches of one whole segment of the pairs of a tile with a sparse side
+static inline __attribute__((always_inline)) void popCoverSparseSegment(const Snp * a, int na, const Snp * b, int nb, int stride, int start, int words,
+                                                                         const TileSegments & sa, const TileSegments & sb, int sign, int * popCovers)
+{
+    for(int i=0; i<na; ++i)
+        for(int j=0; j<nb; ++j)
+            if(sa.sparsePair(i, sb, j))
+            {
+                const SparseSegment & segmentA = *sa.segments_[i];
+                const SparseSegment & segmentB = *sb.segments_[j];
+                int c = listFirst(segmentA, segmentB) ? popCoverSparse(segmentA, sa.entries_[i], b[j].allSamples_ + start, words)
+                                                      : popCoverSparse(segmentB, sb.entries_[j], a[i].allSamples_ + start, words);
+                popCovers[i*stride+j] += sign*c;
+            }
+}
+
+static inline __attribute__((always_inline)) void popCoverSegments(const Snp * a, int na, const Snp * b, int nb, int start, int words,
+                                                                    int segment, int sign, int * popCovers)
+{
+    static thread_local vector<TileSegments> tilesA;
+    static thread_local vector<TileSegments> tilesB;
+    loadTiles(a, na, segment, tilesA);
+    loadTiles(b, nb, segment, tilesB);
+
+    //Only the heterozygous and homozygous minor planes are read
+    BlockPanels panels = blockPanels(na, nb, GENOTYPE_LEVELS-1);
+    for(int ia=0; ia<na; ia+=panels.a_)
+        for(int jb=0; jb<nb; jb+=panels.b_)
+            for(int w0=0; w0<words; w0+=panels.words_)
+                for(int i=ia; i<min(na, ia+panels.a_); i+=BITGEMM_TILE)
+                    for(int j=jb; j<min(nb, jb+panels.b_); j+=BITGEMM_TILE)
+                        popCoverSegment(a+i, min(BITGEMM_TILE, na-i), b+j, min(BITGEMM_TILE, nb-j), nb, start, words, w0, min(words, w0+panels.words_),
+                                        tilesA[i/BITGEMM_TILE], tilesB[j/BITGEMM_TILE], sign, popCovers + i*nb+j);
+
+    for(int i=0; i<na; i+=BITGEMM_TILE)
+        for(int j=0; j<nb; j+=BITGEMM_TILE)
+            if(tilesA[i/BITGEMM_TILE].anySparse_ || tilesB[j/BITGEMM_TILE].anySparse_)
+                popCoverSparseSegment(a+i, min(BITGEMM_TILE, na-i), b+j, min(BITGEMM_TILE, nb-j), nb, start, words,
+                                      tilesA[i/BITGEMM_TILE], tilesB[j/BITGEMM_TILE], sign, popCovers + i*nb+j);
+}
+
+static inline __attribute__((always_inline)) void popCoversHelper(const Snp * a, int na, const Snp * b, int nb, bool casesOnly, int * popCovers)
+{
+    fill(popCovers, popCovers + na*nb, 0);
+    if(!casesOnly)
+        popCoverSegments(a, na, b, nb, 0, Snp::getControlWords(), 0, -1, popCovers);
+    popCoverSegments(a, na, b, nb, Snp::getCaseStart(), Snp::getCaseWords(), 1, 1, popCovers);
+}
+
+BITGEMM_POPCNT_KERNELS(countTables, (const Snp * a, int na, const Snp * b, int nb, int * counts), (a, na, b, nb, counts))
+BITGEMM_POPCNT_KERNELS(countCaseTables, (const Snp * a, int na, const Snp * b, int nb, int * counts), (a, na, b, nb, counts))
+BITGEMM_POPCNT_KERNELS(popCovers, (const Snp * a, int na, const Snp * b, int nb, bool casesOnly, int * popCovers),
+                       (a, na, b, nb, casesOnly, popCovers))
+
+template<class Model>
+static void countModelTablesDefault(const Snp * a, int na, const Snp * b, int nb, int * counts)
+{
+    countModelTablesHelper<Model>(a, na, b, nb, counts);
+}
+
+template<class Model>
+BITGEMM_POPCNT_TARGET static void countModelTablesPopcnt(const Snp * a, int na, const Snp * b, int nb, int * counts)
+{
+    countModelTablesHelper<Model>(a, na, b, nb, counts);
+}
+
+bool BitGemm::hasPopcnt()
+{
+#if defined(__x86_64__)
+    static const bool retVal = __builtin_cpu_supports("popcnt");
+    return retVal;
+#else
+    return false;
+#endif
+}
+
+void BitGemm::countTables(const Snp * a, int na, const Snp * b, int nb, int * counts)
+{
+    BITGEMM_POPCNT_CALL(countTables, (a, na, b, nb, counts));
+}
+
+template<class Model>
+void BitGemm::countModelTables(const Snp * a, int na, const Snp * b, int nb, int * counts)
+{
+    if(!Model::collapsed)
+        countTables(a, na, b, nb, counts);
+    else if(hasPopcnt())
+        countModelTablesPopcnt<Model>(a, na, b, nb, counts);
+    else
+        countModelTablesDefault<Model>(a, na, b, nb, counts);
+}
+
+#define INSTANTIATE_MODEL_TABLES(Model) \
+    template void BitGemm::countModelTables<Model>(const Snp *, int, const Snp *, int, int *);
+FOR_EACH_MODEL(INSTANTIATE_MODEL_TABLES)
+
+void BitGemm::contingencyTables(const Snp * a, int na, const Snp * b, int nb, ContingencyTable * tables)
+{
+    static thread_local vector<int> counts;
+    if(counts.size() < na*nb*TABLE_CELLS)
+        counts.resize(na*nb*TABLE_CELLS);
+    countTables(a, na, b, nb, counts.data());
+
+    for(int p=0; p<na*nb; ++p)
+    {
+        tables[p].M_.fill(0);
+        //PLUS ONE FOR CORRECTION
+        for(int k=0; k<TABLE_CELLS; ++k)
+            tables[p].M_[k] = counts[p*TABLE_CELLS+k]+1;
+    }
+}
+
+void BitGemm::countCaseTables(const Snp * a, int na, const Snp * b, int nb, int * counts)
+{
+    BITGEMM_POPCNT_CALL(countCaseTables, (a, na, b, nb, counts));
+}
+
+void BitGemm::popCovers(const Snp * a, int na, const Snp * b, int nb, int * popCovers)
+{
+    BITGEMM_POPCNT_CALL(popCovers, (a, na, b, nb, false, popCovers));
+}
+
+void BitGemm::casePopCovers(const Snp * a, int na, const Snp * b, int nb, int * popCovers)
+{
+    BITGEMM_POPCNT_CALL(popCovers, (a, na, b, nb, true, popCovers));
+}
@@ -0,0 +1,89 @@
+/**
+ * Blocked bit-matrix-multiply kernels over the packed genotype planes.
+ * Every contingency cell of a SNP pair is the AND-popcount of one plane of the first SNP
+ * with one plane of the second, so the cells for a tile of SNPs A against a tile B form the
+ * binary matrix products plane_i(A)^T * plane_j(B). The kernels walk the sample words in
+ * blocks small enough that the block of every plane of A and B stays resident in L2 while all
+ * their tile pairs are accumulated, so a SNP is read from memory once for all its partners
+ * instead of once per tile, and within a block in chunks small enough that the chunk of every
+ * plane of a tile pair stays resident in L1. When A and B are too many SNPs for a block of one
+ * chunk they are cut into panels, every panel of B met by the panel of A in turn.
+ */
+
+#ifndef BIT_GEMM_H
+#define BIT_GEMM_H
+
+#include "Snp.h"
+#include "GeneticModel.h"
+
+#include <vector>
+#include <algorithm>
+
+//SNPs per side of a tile and 64 bit words per plane chunk, 2*8 SNPs*3 planes*64 words fits in 24KB
+#define BITGEMM_TILE 8
+#define BITGEMM_CHUNK_WORDS 64
+//Bytes of the planes of a sample block, half a typical L2 so the partners' blocks are not evicted
+#define BITGEMM_L2_BYTES (512*1024)
+#define TABLE_CELLS (GENOTYPE_PAIRINGS*CONTINGENCY_COLUMNS)
+
+/* Runtime popcnt dispatch for the kernels of every file. BITGEMM_POPCNT_KERNELS(name, (params), (args))
+   defines nameDefault and namePopcnt around the always inline nameHelper, the latter compiled for the
+   popcnt instruction on x86-64, and BITGEMM_POPCNT_CALL(name, (args)) runs the one the CPU supports. */
+#if defined(__x86_64__)
+#define BITGEMM_POPCNT_TARGET __attribute__((target("popcnt")))
+#else
+#define BITGEMM_POPCNT_TARGET
+#endif
+#define BITGEMM_POPCNT_KERNELS(name, params, args) \
+    static void name##Default params { name##Helper args; } \
+    BITGEMM_POPCNT_TARGET static void name##Popcnt params { name##Helper args; }
+#define BITGEMM_POPCNT_CALL(name, args) \
+    (BitGemm::hasPopcnt() ? name##Popcnt args : name##Default args)
+
+namespace BitGemm
+{
+    //True when the CPU has the popcnt instruction, checked once
+    bool hasPopcnt();
+    
+    /** @brief Heterozygous and homozygous minor matches of word w of two SNPs in one word, as a sample
+     *  can not match on both. pa and pb point to the heterozygous plane of a segment of words words
+     */
+    static inline __attribute__((always_inline)) PACK_TYPE minorMatches(const PACK_TYPE * pa, const PACK_TYPE * pb, int w, int words)
+    {
+        return (pa[w] & pb[w]) | (pa[w+words] & pb[w+words]);
+    }
+    
+    /** @brief Raw cell counts for every pair of a[0..na) x b[0..nb)
+     *
+     *  @param counts Output of na*nb*TABLE_CELLS ints, pair (i,j) starts at (i*nb+j)*TABLE_CELLS
+     *  and is laid out as ContingencyTable::M_ without the plus one correction
+     */
+    void countTables(const Snp * a, int na, const Snp * b, int nb, int * counts);
+    
+    /** @brief countTables under a genetic model of GeneticModel.h, pair (i,j) starts at
+     *  (i*nb+j)*Model::levels^2*CONTINGENCY_COLUMNS. The collapsed models AND the ORed planes of
+     *  their levels, the others are countTables. Instantiated for every model.
+     */
+    template<class Model>
+    void countModelTables(const Snp * a, int na, const Snp * b, int nb, int * counts);
+    
+    /** @brief Corrected contingency tables for every pair of a[0..na) x b[0..nb), tables[i*nb+j]
+     */
+    void contingencyTables(const Snp * a, int na, const Snp * b, int nb, ContingencyTable * tables);
+    
+    /** @brief Popcovers (case minus control heterozygous and homozygous minor matches) for every
+     *  pair of a[0..na) x b[0..nb), popCovers[i*nb+j], same as Snp::computePopCoverAnd
+     */
+    void popCovers(const Snp * a, int na, const Snp * b, int nb, int * popCovers);
+    
+    /** @brief Case-only tables for every pair of a[0..na) x b[0..nb), reading the case segment of
+     *  the planes alone. Pair (i,j) starts at (i*nb+j)*GENOTYPE_PAIRINGS, the 9 case cells of
+     *  ContingencyTable::M_ without the plus one correction
+     */
+    void countCaseTables(const Snp * a, int na, const Snp * b, int nb, int * counts);
+    
+    //Heterozygous and homozygous minor matches among the cases alone, the case term of popCovers
+    void casePopCovers(const Snp * a, int na, const Snp * b, int nb, int * popCovers);
+}
+
+#endif //BIT_GEMM_H
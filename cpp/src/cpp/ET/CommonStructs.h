@@ -28,7 +28,39 @@ struct ParameterInfo
     
     string outputFileName_;
     
+    //Groupings tested together, the groups then noTrees_-1 randomized regroupings of them
     int noTrees_;
+    
+    //Test every pair across groups instead of the top popcovers
+    bool exhaustiveTesting_;
+    
+    //Slice 0 <= shard_ < numberShards_ of the group pairs tested by this process
+    int numberShards_;
+    int shard_;
+    //Only merge the partial results every shard wrote
+    bool mergeShards_;
+    
+    //Seconds between checkpoints of the pair testing, 0 for none, and whether to resume from one
+    float checkpointInterval_;
+    bool resume_;
+    
+    //Top pairs seeding the three-SNP test, 0 for none
+    int tripletSeedPairs_;
+    
+    //StatisticType of Statistics.h scoring the tables
+    int statistic_;
+    //GeneticModelType of GeneticModel.h coding the genotypes of the pair and marginal tests
+    int model_;
+    //Screen the pairs with the case-only test, then confirm the reported ones with the full test
+    bool caseOnly_;
+    //Test the interaction variance of a continuous trait given as the labels instead of cases and controls
+    bool quantitative_;
+    //Group the SNPs natively when above 0, joining SNPs whose genotypes differ on at most this fraction of their carriers
+    float ldDifference_;
+    //Test the member pairs of two groups only when their roots score at least this fraction of the cutoff, 0 always tests them
+    float hierarchicalThreshold_;
+    //Reciprocal pairs of a reference run, the recall of the results against it is printed when set
+    string groundTruthFileName_;
 
     
     void printSummaryRelevant(ofstream & ofs)
@@ -47,6 +79,7 @@ struct DatasetSizeInfo
     //Varies based on trial
     int mafRemoved_;
     int marginalSignificanceRemoved_;
+    int unknownRemoved_;
     int filterFileRemoved_;
     
     int passingSnps_;
@@ -0,0 +1,196 @@
+/**
+ * Genetic models as codings of the three genotypes of a SNP into the levels of its table. The
+ * dominant and recessive models merge two genotypes, so each of their levels is the OR of genotype
+ * planes and a pair table has 2x2 rows instead of 3x3, counted with 4 AND-popcounts per word instead
+ * of 9. The additive model keeps the genotypes and scores their allele dosage with the one degree of
+ * freedom trend test. Like the statistics of Statistics.h the models are policies the test loops are
+ * instantiated with.
+ */
+
+#ifndef GENETIC_MODEL_H
+#define GENETIC_MODEL_H
+
+#include "Snp.h"
+#include "Statistics.h"
+
+enum GeneticModelType { GENOTYPIC_MODEL, DOMINANT_MODEL, RECESSIVE_MODEL, ADDITIVE_MODEL, ALL_MODELS };
+
+#define NUMBER_MODELS 4
+
+//Calls X with every model, to instantiate a loop for each of them
+#define FOR_EACH_MODEL(X) X(GenotypicModel) X(DominantModel) X(RecessiveModel) X(AdditiveModel)
+
+//Suffix of the output files of a model in the all models mode
+inline string geneticModelName(int model)
+{
+    switch(model)
+    {
+        case DOMINANT_MODEL: return "dominant";
+        case RECESSIVE_MODEL: return "recessive";
+        case ADDITIVE_MODEL: return "additive";
+        default: return "genotypic";
+    }
+}
+
+//The three genotypes as they are, scored by the statistic
+struct GenotypicModel
+{
+    static const int levels = GENOTYPE_LEVELS;
+    static const bool collapsed = false;
+
+    static int levelOf(int genotype)
+    {
+        return genotype;
+    }
+
+    //Word w of the plane of a level, the genotype planes of a segment are words apart
+    static PACK_TYPE plane(const PACK_TYPE * planes, int words, int level, int w)
+    {
+        return planes[level*words + w];
+    }
+
+    template<class Statistic, int Snps>
+    static float score(const int * M)
+    {
+        return Statistic::template score<levels, Snps>(M);
+    }
+};
+
+//Carriers of the minor allele against homozygous major
+struct DominantModel
+{
+    static const int levels = 2;
+    static const bool collapsed = true;
+
+    static int levelOf(int genotype)
+    {
+        return genotype != 0;
+    }
+
+    static PACK_TYPE plane(const PACK_TYPE * planes, int words, int level, int w)
+    {
+        return level == 0 ? planes[w] : planes[words + w] | planes[2*words + w];
+    }
+
+    template<class Statistic, int Snps>
+    static float score(const int * M)
+    {
+        return Statistic::template score<levels, Snps>(M);
+    }
+};
+
+//Homozygous minor against the other two genotypes
+struct RecessiveModel
+{
+    static const int levels = 2;
+    static const bool collapsed = true;
+
+    static int levelOf(int genotype)
+    {
+        return genotype == 2;
+    }
+
+    static PACK_TYPE plane(const PACK_TYPE * planes, int words, int level, int w)
+    {
+        return level == 0 ? planes[w] | planes[words + w] : planes[2*words + w];
+    }
+
+    template<class Statistic, int Snps>
+    static float score(const int * M)
+    {
+        return Statistic::template score<levels, Snps>(M);
+    }
+};
+
+/*
+ * Cochran-Armitage trend test of the genotype table with the product of the SNPs' minor allele
+ * counts as the score of a row, the allele dosage for one SNP and the dosage interaction for a pair.
+ * It is N times the squared correlation of the row score with being a case, so it never exceeds the
+ * Pearson chi-square of the same table, and the statistic policy does not apply.
+ */
+struct AdditiveModel
+{
+    static const int levels = GENOTYPE_LEVELS;
+    static const bool collapsed = false;
+
+    static int levelOf(int genotype)
+    {
+        return genotype;
+    }
+
+    static PACK_TYPE plane(const PACK_TYPE * planes, int words, int level, int w)
+    {
+        return planes[level*words + w];
+    }
+
+    template<class Statistic, int Snps>
+    static float score(const int * M)
+    {
+        const int rows = power(levels, Snps);
+        double controls = 0.0;
+        double cases = 0.0;
+        double scoredCases = 0.0;
+        double scoredTotal = 0.0;
+        double squaredScoredTotal = 0.0;
+        for(int y=0; y<rows; ++y)
+        {
+            int dosage = 1;
+            for(int s=0, r=y; s<Snps; ++s, r/=levels)
+                dosage *= r%levels;
+            int row = M[y] + M[y+rows];
+            controls += M[y];
+            cases += M[y+rows];
+            scoredCases += dosage*M[y+rows];
+            scoredTotal += dosage*row;
+            squaredScoredTotal += dosage*dosage*row;
+        }
+        double total = controls + cases;
+        double variance = total*squaredScoredTotal - scoredTotal*scoredTotal;
+        if(variance <= 0.0)
+            return 0.0;
+        double trend = total*scoredCases - cases*scoredTotal;
+        return total*trend*trend/(cases*controls*variance);
+    }
+};
+
+/** @brief Sums raw counts of the genotype table of Snps SNPs, laid out as ContingencyTable::M_
+ *  for a pair, into the levels of the model
+ */
+template<class Model, int Snps>
+void collapseCounts(const int * genotypeCounts, int * modelCounts)
+{
+    const int genotypeRows = power(GENOTYPE_LEVELS, Snps);
+    const int modelRows = power(Model::levels, Snps);
+    for(int k=0; k<modelRows*CONTINGENCY_COLUMNS; ++k)
+        modelCounts[k] = 0;
+    for(int y=0; y<genotypeRows; ++y)
+    {
+        int row = 0;
+        for(int s=0, r=y, stride=1; s<Snps; ++s, r/=GENOTYPE_LEVELS, stride*=Model::levels)
+            row += Model::levelOf(r%GENOTYPE_LEVELS)*stride;
+        modelCounts[row] += genotypeCounts[y];
+        modelCounts[row+modelRows] += genotypeCounts[y+genotypeRows];
+    }
+}
+
+//Adds the plus one correction to raw counts of a model table of Snps SNPs and scores it
+template<class Statistic, class Model, int Snps>
+float scoreModelCounts(const int * counts)
+{
+    const int cells = power(Model::levels, Snps)*CONTINGENCY_COLUMNS;
+    int M[cells];
+    for(int k=0; k<cells; ++k)
+        M[k] = counts[k]+1;
+    return Model::template score<Statistic, Snps>(M);
+}
+
+//Pearson chi-square of the raw genotype counts of one SNP under the model, the marginal filter
+template<class Model>
+float marginalChiSquare(const SmallContingencyTable & counts)
+{
+    int modelCounts[Model::levels*CONTINGENCY_COLUMNS];
+    collapseCounts<Model, 1>(counts.M_.data(), modelCounts);
+    return scoreModelCounts<PearsonChiSquare, Model, 1>(modelCounts);
+}
+
+#endif //GENETIC_MODEL_H
@@ -0,0 +1,191 @@
+#include "GenotypeArena.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <algorithm>
+#include <omp.h>
+
+GenotypeArena::GenotypeArena(int numberSnps, int numberControls, int numberCases)
+{
+    numberSnps_ = numberSnps;
+    numberControls_ = numberControls;
+    numberCases_ = numberCases;
+    controlWords_ = (numberControls + PACK_SIZE - 1)/PACK_SIZE;
+    caseWords_ = (numberCases + PACK_SIZE - 1)/PACK_SIZE;
+    
+    size_t lineWords = ARENA_ALIGNMENT/sizeof(PACK_TYPE);
+    stride_ = (getPlaneWords() + lineWords - 1)/lineWords*lineWords;
+    
+    void * data = NULL;
+    size_t bytes = stride_*(numberSnps > 0 ? numberSnps : 1)*sizeof(PACK_TYPE);
+    if(posix_memalign(&data, ARENA_ALIGNMENT, bytes) != 0)
+        throw std::bad_alloc();
+    memset(data, 0, bytes);
+    data_ = (PACK_TYPE*)data;
+}
+
+GenotypeArena::~GenotypeArena()
+{
+    free(data_);
+}
+
+PACK_TYPE * GenotypeArena::getPlanes(int slot)
+{
+    return data_ + slot*stride_;
+}
+
+const PACK_TYPE * GenotypeArena::getPlanes(int slot)const
+{
+    return data_ + slot*stride_;
+}
+
+int GenotypeArena::size()const
+{
+    return numberSnps_;
+}
+
+int GenotypeArena::getControlNo()const
+{
+    return numberControls_;
+}
+
+int GenotypeArena::getCaseNo()const
+{
+    return numberCases_;
+}
+
+int GenotypeArena::getControlWords()const
+{
+    return controlWords_;
+}
+
+int GenotypeArena::getCaseWords()const
+{
+    return caseWords_;
+}
+
+int GenotypeArena::getCaseStart()const
+{
+    return GENOTYPE_LEVELS*controlWords_;
+}
+
+int GenotypeArena::getPlaneWords()const
+{
+    return GENOTYPE_LEVELS*(controlWords_ + caseWords_);
+}
+
+int GenotypeArena::getSlot(const PACK_TYPE * planes)const
+{
+    return (planes - data_)/stride_;
+}
+
+//In order so no slot is overwritten before it has been moved, the space past the kept slots is kept
+void GenotypeArena::compact(const vector<int> & keptSlots)
+{
+    for(int k=0; k<keptSlots.size(); ++k)
+        if(keptSlots[k] != k)
+        {
+            memcpy(getPlanes(k), getPlanes(keptSlots[k]), stride_*sizeof(PACK_TYPE));
+            if(!segments_.empty())
+                copy(segments_.begin() + 2*keptSlots[k], segments_.begin() + 2*keptSlots[k] + 2, segments_.begin() + 2*k);
+        }
+    numberSnps_ = keptSlots.size();
+    if(!segments_.empty())
+        segments_.resize(2*numberSnps_);
+}
+
+shared_ptr<GenotypeArena> GenotypeArena::gather(const vector<int> & slots)const
+{
+    shared_ptr<GenotypeArena> retVal = make_shared<GenotypeArena>(slots.size(), numberControls_, numberCases_);
+    for(int k=0; k<slots.size(); ++k)
+        memcpy(retVal->getPlanes(k), getPlanes(slots[k]), stride_*sizeof(PACK_TYPE));
+    
+    if(!segments_.empty())
+    {
+        retVal->segments_.resize(2*slots.size());
+        for(int k=0; k<slots.size(); ++k)
+            for(int s=0; s<2; ++s)
+            {
+                SparseSegment segment = segments_[2*slots[k]+s];
+                const uint32_t * entries = getEntries(segment);
+                segment.begin_ = retVal->entries_.size();
+                retVal->entries_.insert(retVal->entries_.end(), entries, entries + segment.size());
+                retVal->segments_[2*k+s] = segment;
+            }
+    }
+    return retVal;
+}
+
+//Genotype counts of a segment of words words and samples samples starting at planes
+static SparseSegment countGenotypes(const PACK_TYPE * planes, int words, int samples)
+{
+    SparseSegment retVal;
+    int known = 0;
+    for(int level=0; level<GENOTYPE_LEVELS; ++level)
+    {
+        retVal.counts_[level] = 0;
+        for(int w=0; w<words; ++w)
+            retVal.counts_[level] += POPCOUNT_FUNCTION(planes[level*words + w]);
+        known += retVal.counts_[level];
+    }
+    retVal.counts_[UNKNOWN_LEVEL] = samples - known;
+    
+    retVal.sparse_ = (long long int)(samples - retVal.counts_[0])*SPARSE_SAMPLE_RATIO <= samples;
+    retVal.begin_ = 0;
+    return retVal;
+}
+
+//Writes the sample lists of a sparse segment, the padding past the last sample is not unknown
+static void listSegment(const PACK_TYPE * planes, int words, int samples, uint32_t * entries)
+{
+    for(int level=1; level<=UNKNOWN_LEVEL; ++level)
+        for(int w=0; w<words; ++w)
+        {
+            PACK_TYPE valid = samples - w*PACK_SIZE >= PACK_SIZE ? ~(PACK_TYPE)0 : ((PACK_TYPE)1 << (samples - w*PACK_SIZE)) - 1;
+            PACK_TYPE listed = level == UNKNOWN_LEVEL ? ~(planes[w] | planes[words + w] | planes[2*words + w]) & valid
+                                                      : planes[level*words + w];
+            while(listed != 0)
+            {
+                *entries++ = w*PACK_SIZE + __builtin_ctzll(listed);
+                listed &= listed - 1;
+            }
+        }
+}
+
+void GenotypeArena::indexSparseSegments(int maxThreadUsage)
+{
+    const int words[2] = {controlWords_, caseWords_};
+    const int samples[2] = {numberControls_, numberCases_};
+    const int starts[2] = {0, getCaseStart()};
+    
+    segments_.resize(2*numberSnps_);
+    #pragma omp parallel for num_threads(maxThreadUsage) schedule(static)
+    for(int i=0; i<numberSnps_; ++i)
+        for(int s=0; s<2; ++s)
+            segments_[2*i+s] = countGenotypes(getPlanes(i) + starts[s], words[s], samples[s]);
+    
+    size_t total = 0;
+    for(int k=0; k<segments_.size(); ++k)
+    {
+        segments_[k].begin_ = total;
+        total += segments_[k].size();
+    }
+    entries_.resize(total);
+    
+    #pragma omp parallel for num_threads(maxThreadUsage) schedule(dynamic, 64)
+    for(int i=0; i<numberSnps_; ++i)
+        for(int s=0; s<2; ++s)
+            if(segments_[2*i+s].sparse_)
+                listSegment(getPlanes(i) + starts[s], words[s], samples[s], &entries_[segments_[2*i+s].begin_]);
+}
+
+const SparseSegment * GenotypeArena::getSegments(int slot)const
+{
+    return segments_.empty() ? NULL : &segments_[2*slot];
+}
+
+const uint32_t * GenotypeArena::getEntries(const SparseSegment & segment)const
+{
+    return entries_.data() + segment.begin_;
+}
@@ -0,0 +1,103 @@
+/**
+ * One contiguous, cache line aligned block holding the packed genotype planes of many SNPs. Every
+ * slot has the same stride, rounded up to whole cache lines, and is laid out as controls 0 , 1 , 2
+ * then cases 0 , 1 , 2. Snps are views of a slot, the arena is shared by every Snp pointing into it.
+ * Once packed the arena can also index its sparse segments, those of a rare variant where few samples
+ * are off the homozygous major genotype, as sorted lists of those samples so the kernels can intersect
+ * them in time proportional to the carriers instead of the samples.
+ */
+
+#ifndef GENOTYPE_ARENA_H
+#define GENOTYPE_ARENA_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+#include <memory>
+
+#define GENOTYPE_LEVELS 3
+
+#define PACK_SIZE 64
+#define PACK_TYPE uint64_t
+#define POPCOUNT_FUNCTION __builtin_popcountll
+
+#define ARENA_ALIGNMENT 64
+
+//A segment is listed when at most one in SPARSE_SAMPLE_RATIO of its samples is off the homozygous major genotype
+#define SPARSE_SAMPLE_RATIO 64
+//Level of the unknown genotypes in the sparse counts and lists
+#define UNKNOWN_LEVEL GENOTYPE_LEVELS
+
+using namespace std;
+
+//Genotype counts of one sample segment of a slot, and the samples off the homozygous major genotype when they are few
+struct SparseSegment
+{
+    //Samples of levels 0 , 1 , 2 then of the unknown genotypes
+    int counts_[GENOTYPE_LEVELS+1];
+    bool sparse_;
+    //Sorted samples of levels 1 , 2 then unknown, back to back in the arena's entry pool from begin_
+    size_t begin_;
+    
+    //Listed samples, none for a dense segment
+    int size()const
+    {
+        return sparse_ ? counts_[1] + counts_[2] + counts_[UNKNOWN_LEVEL] : 0;
+    }
+};
+
+class GenotypeArena
+{
+    public:
+        //Zeroed planes for numberSnps slots of numberControls and numberCases samples
+        GenotypeArena(int numberSnps, int numberControls, int numberCases);
+        ~GenotypeArena();
+        
+        PACK_TYPE * getPlanes(int slot);
+        const PACK_TYPE * getPlanes(int slot)const;
+        
+        int size()const;
+        int getControlNo()const;
+        int getCaseNo()const;
+        int getControlWords()const;
+        int getCaseWords()const;
+        int getCaseStart()const;
+        //Words used by one slot, without the padding up to the stride
+        int getPlaneWords()const;
+        
+        //Slot holding the given planes
+        int getSlot(const PACK_TYPE * planes)const;
+        
+        //Moves slot keptSlots[k] to slot k and shrinks to the kept slots, keptSlots must be increasing
+        void compact(const vector<int> & keptSlots);
+        //New arena whose slot k is a copy of slot slots[k], views of this arena stay valid
+        shared_ptr<GenotypeArena> gather(const vector<int> & slots)const;
+        
+        /** @brief Counts the genotypes of every segment of every slot and lists the sparse ones
+         *
+         *  Call once the planes are packed, the index is not updated when they change afterwards.
+         *  compact and gather carry it along.
+         */
+        void indexSparseSegments(int maxThreadUsage);
+        //Controls then cases segment of a slot, NULL while the arena is not indexed
+        const SparseSegment * getSegments(int slot)const;
+        const uint32_t * getEntries(const SparseSegment & segment)const;
+        
+    private:
+        GenotypeArena(const GenotypeArena & cpy);
+        GenotypeArena & operator=(const GenotypeArena & cpy);
+        
+        PACK_TYPE * data_;
+        int numberSnps_;
+        int numberControls_;
+        int numberCases_;
+        int controlWords_;
+        int caseWords_;
+        size_t stride_;
+        
+        //Two per slot, empty while not indexed
+        vector<SparseSegment> segments_;
+        vector<uint32_t> entries_;
+};
+
+#endif //GENOTYPE_ARENA_H
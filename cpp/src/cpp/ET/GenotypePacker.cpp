@@ -0,0 +1,188 @@
+#include "GenotypePacker.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/*
+ * The byte path is written once as always inlined helpers over a kernel policy, and instantiated
+ * for the default target and for AVX2 with BMI2. The AVX2 kernel compares 64 genotype bytes per
+ * level at once and turns the results into plane bits with movemask, then pext splits those bits
+ * into the case and control groups. The faster one is picked at runtime so the mex still loads on
+ * machines without it.
+ */
+
+//Appends runs of bits to consecutive plane words
+struct PlaneWriter
+{
+    PACK_TYPE * out_;
+    PACK_TYPE word_;
+    int fill_;
+
+    PlaneWriter(PACK_TYPE * out) : out_(out), word_(0), fill_(0) {}
+
+    inline void append(PACK_TYPE bits, int count)
+    {
+        if(count == 0)
+            return;
+        word_ |= bits << fill_;
+        fill_ += count;
+        if(fill_ >= PACK_SIZE)
+        {
+            *out_++ = word_;
+            fill_ -= PACK_SIZE;
+            word_ = fill_ > 0 ? bits >> (count - fill_) : 0;
+        }
+    }
+
+    inline void flush()
+    {
+        if(fill_ > 0)
+            *out_ = word_;
+    }
+};
+
+//Level masks of up to PACK_SIZE bytes, bit i set when byte i is base+level
+static inline void levelMasksScalar(const uint8_t * genotypes, int count, uint8_t base, PACK_TYPE * masks)
+{
+    masks[0] = masks[1] = masks[2] = 0;
+    for(int i=0; i<count; ++i)
+    {
+        uint8_t level = genotypes[i] - base;
+        if(level < GENOTYPE_LEVELS)
+            masks[level] |= (PACK_TYPE)1<<i;
+    }
+}
+
+//Bits of value selected by mask, moved down to the low bits in order
+static inline PACK_TYPE extractScalar(PACK_TYPE value, PACK_TYPE mask)
+{
+    PACK_TYPE retVal = 0;
+    for(int k=0; mask != 0; mask &= mask-1, ++k)
+        if(value & mask & -mask)
+            retVal |= (PACK_TYPE)1<<k;
+    return retVal;
+}
+
+struct ScalarKernel
+{
+    static inline __attribute__((always_inline)) void levelMasks(const uint8_t * genotypes, uint8_t base, PACK_TYPE * masks)
+    {
+        levelMasksScalar(genotypes, PACK_SIZE, base, masks);
+    }
+
+    static inline __attribute__((always_inline)) PACK_TYPE extract(PACK_TYPE value, PACK_TYPE mask)
+    {
+        return extractScalar(value, mask);
+    }
+};
+
+#if defined(__x86_64__)
+struct Avx2Kernel
+{
+    __attribute__((target("avx2,bmi2"))) static inline void levelMasks(const uint8_t * genotypes, uint8_t base, PACK_TYPE * masks)
+    {
+        __m256i low = _mm256_loadu_si256((const __m256i*)genotypes);
+        __m256i high = _mm256_loadu_si256((const __m256i*)(genotypes + 32));
+        for(int l=0; l<GENOTYPE_LEVELS; ++l)
+        {
+            __m256i level = _mm256_set1_epi8((char)(base + l));
+            uint32_t lowBits = _mm256_movemask_epi8(_mm256_cmpeq_epi8(low, level));
+            uint32_t highBits = _mm256_movemask_epi8(_mm256_cmpeq_epi8(high, level));
+            masks[l] = ((PACK_TYPE)highBits<<32) | lowBits;
+        }
+    }
+
+    __attribute__((target("avx2,bmi2"))) static inline PACK_TYPE extract(PACK_TYPE value, PACK_TYPE mask)
+    {
+        return _pext_u64(value, mask);
+    }
+};
+#endif
+
+template<class Kernel>
+static inline __attribute__((always_inline)) void packBytesHelper(const uint8_t * genotypes, int numberSamples, uint8_t base, const PACK_TYPE * caseMask,
+                                                                   PACK_TYPE * controlPlanes, int controlWords, PACK_TYPE * casePlanes, int caseWords)
+{
+    PlaneWriter controls[GENOTYPE_LEVELS] = {PlaneWriter(controlPlanes), PlaneWriter(controlPlanes + controlWords), PlaneWriter(controlPlanes + 2*controlWords)};
+    PlaneWriter cases[GENOTYPE_LEVELS] = {PlaneWriter(casePlanes), PlaneWriter(casePlanes + caseWords), PlaneWriter(casePlanes + 2*caseWords)};
+
+    for(int s=0; s<numberSamples; s+=PACK_SIZE)
+    {
+        int count = min(PACK_SIZE, numberSamples-s);
+        PACK_TYPE masks[GENOTYPE_LEVELS];
+        if(count == PACK_SIZE)
+            Kernel::levelMasks(genotypes + s, base, masks);
+        else
+            levelMasksScalar(genotypes + s, count, base, masks);
+
+        PACK_TYPE valid = count == PACK_SIZE ? ~(PACK_TYPE)0 : ((PACK_TYPE)1<<count)-1;
+        PACK_TYPE isCase = caseMask != NULL ? caseMask[s/PACK_SIZE] & valid : 0;
+        PACK_TYPE isControl = ~isCase & valid;
+
+        //Without cases every bit stays where it is
+        if(isCase == 0)
+        {
+            for(int l=0; l<GENOTYPE_LEVELS; ++l)
+                controls[l].append(masks[l], count);
+            continue;
+        }
+
+        int numberCases = POPCOUNT_FUNCTION(isCase);
+        for(int l=0; l<GENOTYPE_LEVELS; ++l)
+        {
+            controls[l].append(Kernel::extract(masks[l], isControl), count - numberCases);
+            cases[l].append(Kernel::extract(masks[l], isCase), numberCases);
+        }
+    }
+
+    for(int l=0; l<GENOTYPE_LEVELS; ++l)
+    {
+        controls[l].flush();
+        cases[l].flush();
+    }
+}
+
+static void packBytesDefault(const uint8_t * genotypes, int numberSamples, uint8_t base, const PACK_TYPE * caseMask,
+                             PACK_TYPE * controlPlanes, int controlWords, PACK_TYPE * casePlanes, int caseWords)
+{
+    packBytesHelper<ScalarKernel>(genotypes, numberSamples, base, caseMask, controlPlanes, controlWords, casePlanes, caseWords);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2,bmi2,popcnt"))) static void packBytesAvx2(const uint8_t * genotypes, int numberSamples, uint8_t base, const PACK_TYPE * caseMask,
+                                                                       PACK_TYPE * controlPlanes, int controlWords, PACK_TYPE * casePlanes, int caseWords)
+{
+    packBytesHelper<Avx2Kernel>(genotypes, numberSamples, base, caseMask, controlPlanes, controlWords, casePlanes, caseWords);
+}
+
+static const bool hasAvx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+#else
+static const bool hasAvx2 = false;
+#define packBytesAvx2 packBytesDefault
+#endif
+
+void GenotypePacker::packBytes(const uint8_t * genotypes, int numberSamples, uint8_t base, PACK_TYPE * planes, int planeWords)
+{
+    if(hasAvx2)
+        packBytesAvx2(genotypes, numberSamples, base, NULL, planes, planeWords, NULL, 0);
+    else
+        packBytesDefault(genotypes, numberSamples, base, NULL, planes, planeWords, NULL, 0);
+}
+
+void GenotypePacker::packBytes(const uint8_t * genotypes, int numberSamples, uint8_t base, const PACK_TYPE * caseMask,
+                               PACK_TYPE * planes, int controlWords, int caseStart, int caseWords)
+{
+    if(hasAvx2)
+        packBytesAvx2(genotypes, numberSamples, base, caseMask, planes, controlWords, planes + caseStart, caseWords);
+    else
+        packBytesDefault(genotypes, numberSamples, base, caseMask, planes, controlWords, planes + caseStart, caseWords);
+}
+
+vector<PACK_TYPE> GenotypePacker::createCaseMask(const vector<int> & caseSamples, int numberSamples)
+{
+    vector<PACK_TYPE> retVal((numberSamples + PACK_SIZE - 1)/PACK_SIZE, 0);
+    for(int i=0; i<caseSamples.size(); ++i)
+        retVal[caseSamples[i]/PACK_SIZE] |= (PACK_TYPE)1<<(caseSamples[i]%PACK_SIZE);
+    return retVal;
+}
@@ -0,0 +1,156 @@
+/**
+ * Packs genotypes straight from a column-major numeric buffer, as handed to the mex by MATLAB, into the
+ * bit planes of already allocated Snps. The buffer may hold one row per SNP or one row per sample, the
+ * layout is described by the distance between consecutive SNPs and consecutive samples. Cases and
+ * controls are picked out of the shared sample dimension by index lists so no split copies are needed.
+ * A block of SNPs is walked sample by sample, keeping the word being built for every SNP of the block
+ * in registers and storing it once it is full. One byte genotypes with the samples of a SNP contiguous
+ * take the vectorized byte path instead, 64 samples at a time.
+ *
+ * Sample i of a group is bit i%PACK_SIZE of word i/PACK_SIZE of each plane.
+ */
+
+#ifndef GENOTYPE_PACKER_H
+#define GENOTYPE_PACKER_H
+
+#include "Snp.h"
+
+#include <vector>
+#include <omp.h>
+
+#define PACK_SNP_BLOCK 64
+
+using namespace std;
+
+struct GenotypeLayout
+{
+    //Element (snp, sample) lives at snp*snpStride_ + sample*sampleStride_
+    size_t snpStride_;
+    size_t sampleStride_;
+    //Buffer SNP of each Snp, indexed by Snp::getIndex()
+    const int * snpRows_;
+};
+
+namespace GenotypePacker
+{
+    /** @brief Packs bytes equal to base, base+1 and base+2 into the three consecutive planes at planes
+     *
+     *  Any other byte value is left unknown. Every sample goes to the same group of planes.
+     */
+    void packBytes(const uint8_t * genotypes, int numberSamples, uint8_t base, PACK_TYPE * planes, int planeWords);
+
+    /** @brief Packs one contiguous column of numberSamples byte genotypes into the planes of a slot
+     *
+     *  @param caseMask Bit i%PACK_SIZE of word i/PACK_SIZE is set when sample i is a case
+     */
+    void packBytes(const uint8_t * genotypes, int numberSamples, uint8_t base, const PACK_TYPE * caseMask,
+                   PACK_TYPE * planes, int controlWords, int caseStart, int caseWords);
+
+    vector<PACK_TYPE> createCaseMask(const vector<int> & caseSamples, int numberSamples);
+
+    //Genotype level of one value, -1 when unknown. Truncates like the ascii conversion did
+    template<class T>
+    inline int genotypeLevel(T value)
+    {
+        if(value > -1 && value < GENOTYPE_LEVELS)
+            return (int)value;
+        return -1;
+    }
+
+    inline int genotypeLevel(bool value)
+    {
+        return value ? 1 : 0;
+    }
+
+    //Splits the sample dimension by a label vector, nonzero marks a case
+    template<class T>
+    void splitSamples(const T * labels, int numberSamples, vector<int> & controlSamples, vector<int> & caseSamples)
+    {
+        controlSamples.clear();
+        caseSamples.clear();
+        for(int i=0; i<numberSamples; ++i)
+        {
+            if(labels[i] != 0)
+                caseSamples.push_back(i);
+            else
+                controlSamples.push_back(i);
+        }
+    }
+
+    //Packs the given samples of a block of Snps into the planes starting at planeStart
+    template<class T>
+    void packBlock(const T * genotypes, const GenotypeLayout & layout, const vector<int> & samples,
+                   Snp * snps, int numberBlockSnps, int planeStart, int planeWords)
+    {
+        PACK_TYPE words[GENOTYPE_LEVELS][PACK_SNP_BLOCK];
+        size_t offsets[PACK_SNP_BLOCK];
+        for(int k=0; k<numberBlockSnps; ++k)
+            offsets[k] = layout.snpRows_[snps[k].getIndex()]*layout.snpStride_;
+
+        for(int w=0; w<planeWords; ++w)
+        {
+            for(int l=0; l<GENOTYPE_LEVELS; ++l)
+                fill(words[l], words[l] + numberBlockSnps, 0);
+
+            int sampleEnd = min((int)samples.size(), (w+1)*PACK_SIZE);
+            for(int s=w*PACK_SIZE; s<sampleEnd; ++s)
+            {
+                const T * column = genotypes + samples[s]*layout.sampleStride_;
+                PACK_TYPE mask = (PACK_TYPE)1<<(s%PACK_SIZE);
+                for(int k=0; k<numberBlockSnps; ++k)
+                {
+                    int level = genotypeLevel(column[offsets[k]]);
+                    if(level >= 0)
+                        words[level][k] |= mask;
+                }
+            }
+
+            for(int k=0; k<numberBlockSnps; ++k)
+                for(int l=0; l<GENOTYPE_LEVELS; ++l)
+                    snps[k].allSamples_[planeStart + l*planeWords + w] = words[l][k];
+        }
+    }
+
+    //Packs count Snps, taking the byte path when the samples of a SNP are contiguous bytes
+    template<class T>
+    void packSnpBlock(const T * genotypes, const GenotypeLayout & layout, const vector<int> & controlSamples,
+                      const vector<int> & caseSamples, const vector<PACK_TYPE> & caseMask, Snp * snps, int count)
+    {
+        if(sizeof(T) == 1 && layout.sampleStride_ == 1)
+        {
+            int numberSamples = controlSamples.size() + caseSamples.size();
+            for(int k=0; k<count; ++k)
+            {
+                const uint8_t * column = (const uint8_t*)(genotypes + layout.snpRows_[snps[k].getIndex()]*layout.snpStride_);
+                packBytes(column, numberSamples, 0, caseMask.data(), snps[k].allSamples_,
+                          Snp::getControlWords(), Snp::getCaseStart(), Snp::getCaseWords());
+            }
+            return;
+        }
+        
+        for(int begin=0; begin<count; begin+=PACK_SNP_BLOCK)
+        {
+            int blockSnps = min(PACK_SNP_BLOCK, count - begin);
+            packBlock(genotypes, layout, controlSamples, snps + begin, blockSnps, 0, Snp::getControlWords());
+            packBlock(genotypes, layout, caseSamples, snps + begin, blockSnps, Snp::getCaseStart(), Snp::getCaseWords());
+        }
+    }
+
+    //Fills the planes of every Snp from the buffer, in parallel over blocks of SNPs
+    template<class T>
+    void packSnps(const T * genotypes, const GenotypeLayout & layout, const vector<int> & controlSamples,
+                  const vector<int> & caseSamples, vector<Snp> & snps, int maxThreadUsage)
+    {
+        vector<PACK_TYPE> caseMask = createCaseMask(caseSamples, controlSamples.size() + caseSamples.size());
+        int numberBlocks = (snps.size() + PACK_SNP_BLOCK - 1)/PACK_SNP_BLOCK;
+
+        #pragma omp parallel for num_threads(maxThreadUsage) schedule(dynamic)
+        for(int b=0; b<numberBlocks; ++b)
+        {
+            int begin = b*PACK_SNP_BLOCK;
+            packSnpBlock(genotypes, layout, controlSamples, caseSamples, caseMask, &snps[begin], min(PACK_SNP_BLOCK, (int)snps.size() - begin));
+        }
+    }
+}
+
+#endif //GENOTYPE_PACKER_H
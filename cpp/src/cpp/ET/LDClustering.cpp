@@ -0,0 +1,227 @@
+#include "LDClustering.h"
+
+//A sampled sample, the word of its bit in the genotype 0 plane and the words between the planes of its segment
+struct SampledBit
+{
+    int word_;
+    int planeWords_;
+    PACK_TYPE mask_;
+};
+
+struct BandEntry
+{
+    uint64_t key_;
+    int snp_;
+};
+
+//SNP i of a band sorted by key, then by chromosome and base pair
+struct BandOrder
+{
+    const vector<GenomeLocation> & locations_;
+
+    bool operator()(const BandEntry & e1, const BandEntry & e2)const
+    {
+        if(e1.key_ != e2.key_)
+            return e1.key_ < e2.key_;
+        const GenomeLocation & l1 = locations_[e1.snp_];
+        const GenomeLocation & l2 = locations_[e2.snp_];
+        if(l1.chromosome_ != l2.chromosome_)
+            return l1.chromosome_ < l2.chromosome_;
+        if(l1.basePair_ != l2.basePair_)
+            return l1.basePair_ < l2.basePair_;
+        return e1.snp_ < e2.snp_;
+    }
+};
+
+static SampledBit sampledBit(int sample, int numberControls)
+{
+    SampledBit retVal;
+    if(sample < numberControls)
+    {
+        retVal.word_ = sample/PACK_SIZE;
+        retVal.planeWords_ = Snp::getControlWords();
+    }
+    else
+    {
+        sample -= numberControls;
+        retVal.word_ = Snp::getCaseStart() + sample/PACK_SIZE;
+        retVal.planeWords_ = Snp::getCaseWords();
+    }
+    retVal.mask_ = (PACK_TYPE)1<<(sample%PACK_SIZE);
+    return retVal;
+}
+
+//Genotype 0, 1 or 2 of the sampled sample, 3 when unknown
+static uint64_t genotypeAt(const Snp & snp, const SampledBit & bit)
+{
+    for(int level=0; level<GENOTYPE_LEVELS; ++level)
+        if(snp.allSamples_[bit.word_ + level*bit.planeWords_] & bit.mask_)
+            return level;
+    return GENOTYPE_LEVELS;
+}
+
+static int findRoot(vector<atomic<int>> & parents, int i)
+{
+    int parent = parents[i].load();
+    while(parent != i)
+    {
+        int grandparent = parents[parent].load();
+        //Path halving, a failed exchange only means another thread already moved i up
+        parents[i].compare_exchange_weak(parent, grandparent);
+        i = grandparent;
+        parent = parents[i].load();
+    }
+    return i;
+}
+
+//The larger root is linked below the smaller one, so the root of a cluster is its first SNP
+static void unite(vector<atomic<int>> & parents, int a, int b)
+{
+    while(true)
+    {
+        a = findRoot(parents, a);
+        b = findRoot(parents, b);
+        if(a == b)
+            return;
+        if(a < b)
+            swap(a, b);
+        int expected = a;
+        if(parents[a].compare_exchange_strong(expected, b))
+            return;
+    }
+}
+
+//Samples off genotype 0, the unknown ones included
+static vector<int> countCarriers(const vector<Snp> & snps, int maxThreadUsage)
+{
+    vector<int> retVal(snps.size());
+    if(snps.empty())
+        return retVal;
+    int samples = snps[0].getControlNo() + snps[0].getCaseNo();
+    #pragma omp parallel for schedule(static) num_threads(maxThreadUsage)
+    for(int i=0; i<snps.size(); ++i)
+    {
+        SmallContingencyTable counts = snps[i].computeGenotypeCounts();
+        retVal[i] = samples - counts.M_[0] - counts.M_[GENOTYPE_LEVELS];
+    }
+    return retVal;
+}
+
+//Joins a and b when they are near-duplicates, true when they were compared
+static bool confirmPair(const vector<Snp> & snps, const vector<int> & carriers, float maxDifference, vector<atomic<int>> & parents, int a, int b)
+{
+    if(findRoot(parents, a) == findRoot(parents, b))
+        return false;
+    if(snps[a].computeDifferences(snps[b]) <= maxDifference*(carriers[a] + carriers[b]))
+        unite(parents, a, b);
+    return true;
+}
+
+static vector<vector<int>> collectClusters(vector<atomic<int>> & parents)
+{
+    vector<vector<int>> retVal;
+    vector<int> clusterOf(parents.size(), -1);
+    for(int i=0; i<parents.size(); ++i)
+    {
+        int root = findRoot(parents, i);
+        if(clusterOf[root] < 0)
+        {
+            clusterOf[root] = retVal.size();
+            retVal.push_back(vector<int>());
+        }
+        retVal[clusterOf[root]].push_back(i);
+    }
+    return retVal;
+}
+
+vector<vector<int>> LDClustering::cluster(const vector<Snp> & snps, const vector<GenomeLocation> & locations, float maxDifference, int maxThreadUsage)
+{
+    int n = snps.size();
+    vector<atomic<int>> parents(n);
+    for(int i=0; i<n; ++i)
+        parents[i].store(i);
+    if(n < 2)
+        return collectClusters(parents);
+
+    int numberControls = snps[0].getControlNo();
+    int numberSamples = numberControls + snps[0].getCaseNo();
+    mt19937 generator(LD_HASH_SEED);
+    uniform_int_distribution<int> sampleDistribution(0, numberSamples-1);
+    vector<SampledBit> bits(LD_HASH_BANDS*LD_HASH_POSITIONS);
+    for(int k=0; k<bits.size(); ++k)
+        bits[k] = sampledBit(sampleDistribution(generator), numberControls);
+
+    //2 bits per sampled genotype, a key of 0 has every sampled genotype 0 and is not bucketed
+    vector<vector<BandEntry>> bands(LD_HASH_BANDS, vector<BandEntry>(n));
+    #pragma omp parallel for schedule(static) num_threads(maxThreadUsage)
+    for(int i=0; i<n; ++i)
+    {
+        for(int b=0; b<LD_HASH_BANDS; ++b)
+        {
+            uint64_t key = 0;
+            for(int k=0; k<LD_HASH_POSITIONS; ++k)
+                key |= genotypeAt(snps[i], bits[b*LD_HASH_POSITIONS + k])<<(2*k);
+            bands[b][i].key_ = key;
+            bands[b][i].snp_ = i;
+        }
+    }
+    BandOrder order = {locations};
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(maxThreadUsage)
+    for(int b=0; b<LD_HASH_BANDS; ++b)
+        sort(bands[b].begin(), bands[b].end(), order);
+
+    vector<int> carriers = countCarriers(snps, maxThreadUsage);
+    long long int candidates = 0;
+    for(int b=0; b<LD_HASH_BANDS; ++b)
+    {
+        const vector<BandEntry> & band = bands[b];
+        #pragma omp parallel for schedule(dynamic, 1024) num_threads(maxThreadUsage) reduction(+:candidates)
+        for(int p=0; p<n; ++p)
+        {
+            if(band[p].key_ == 0)
+                continue;
+            const GenomeLocation & location = locations[band[p].snp_];
+            for(int q=p+1; q<n && q<=p+LD_BUCKET_NEIGHBOURS; ++q)
+            {
+                //Sorted by location within a bucket, the rest of it is out of range
+                if(band[q].key_ != band[p].key_ || !location.inLinkageDisequilibrium(locations[band[q].snp_]))
+                    break;
+                candidates += confirmPair(snps, carriers, maxDifference, parents, band[p].snp_, band[q].snp_);
+            }
+        }
+    }
+
+    vector<vector<int>> retVal = collectClusters(parents);
+    cout<<"---LD Clustering: "<<candidates<<" candidate pairs compared, "<<retVal.size()<<" groups"<<endl;
+    return retVal;
+}
+
+vector<vector<int>> LDClustering::clusterAllPairs(const vector<Snp> & snps, const vector<GenomeLocation> & locations, float maxDifference, int maxThreadUsage)
+{
+    int n = snps.size();
+    vector<atomic<int>> parents(n);
+    for(int i=0; i<n; ++i)
+        parents[i].store(i);
+
+    vector<BandEntry> sorted(n);
+    for(int i=0; i<n; ++i)
+    {
+        sorted[i].key_ = 0;
+        sorted[i].snp_ = i;
+    }
+    BandOrder order = {locations};
+    sort(sorted.begin(), sorted.end(), order);
+
+    vector<int> carriers = countCarriers(snps, maxThreadUsage);
+    #pragma omp parallel for schedule(dynamic, 64) num_threads(maxThreadUsage)
+    for(int p=0; p<n; ++p)
+    {
+        const GenomeLocation & location = locations[sorted[p].snp_];
+        for(int q=p+1; q<n && location.inLinkageDisequilibrium(locations[sorted[q].snp_]); ++q)
+        {
+            if(snps[sorted[p].snp_].computeDifferences(snps[sorted[q].snp_]) <= maxDifference*(carriers[sorted[p].snp_] + carriers[sorted[q].snp_]))
+                unite(parents, sorted[p].snp_, sorted[q].snp_);
+        }
+    }
+    return collectClusters(parents);
+}
@@ -0,0 +1,48 @@
+/**
+ * Groups SNPs in linkage disequilibrium from their genotypes instead of given group ids. Near-duplicate
+ * SNPs are found by locality-sensitive hashing on sampled bit positions: each of LD_HASH_BANDS bands
+ * keys every SNP by its genotypes at LD_HASH_POSITIONS fixed random samples, so two SNPs differing on
+ * a fraction d of the samples share the key of a band with probability (1-d)^LD_HASH_POSITIONS while
+ * unrelated SNPs rarely do. The SNPs of a band are sorted by key and location, and every SNP is only
+ * compared with the next LD_BUCKET_NEIGHBOURS SNPs of its bucket in LD range, so the candidate search
+ * is a sort per band instead of all pairs. Candidates are confirmed with Snp::computeDifferences and
+ * merged into groups by a lock-free union-find.
+ */
+
+#ifndef LD_CLUSTERING_H
+#define LD_CLUSTERING_H
+
+#include "Snp.h"
+#include "LDGroup.h"
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <random>
+#include <stdint.h>
+#include <omp.h>
+
+#define LD_HASH_BANDS 8
+#define LD_HASH_POSITIONS 16
+#define LD_BUCKET_NEIGHBOURS 16
+//Seed of the sampled positions, so the same inputs always give the same groups
+#define LD_HASH_SEED 20190117
+
+using namespace std;
+
+namespace LDClustering
+{
+    /** @brief Clusters of positions in snps, every SNP in exactly one of them
+     *
+     *  Two SNPs are joined when they are in LD range of each other and their genotypes differ on at
+     *  most maxDifference of their carriers together, the samples off genotype 0 in either. Clusters
+     *  are the connected SNPs, ordered by their first SNP, with the SNPs in their order in snps.
+     */
+    vector<vector<int>> cluster(const vector<Snp> & snps, const vector<GenomeLocation> & locations, float maxDifference, int maxThreadUsage);
+
+    /** @brief The clusters of cluster from every pair in LD range, the quadratic reference it is checked against
+     */
+    vector<vector<int>> clusterAllPairs(const vector<Snp> & snps, const vector<GenomeLocation> & locations, float maxDifference, int maxThreadUsage);
+}
+
+#endif //LD_CLUSTERING_H
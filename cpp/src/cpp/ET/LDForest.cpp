@@ -2,15 +2,50 @@
 
 LDForest::LDForest( int topKSnps, int numberControlSamples, int numberCaseSamples, int numberSnps)
 {
-    topSnpList_ = TopSnpList(topKSnps, numberSnps, 0);
+    topSnpLists_.push_back(TopSnpList(topKSnps, numberSnps, 0));
+    phenotypes_ = NULL;
+    trait_ = NULL;
+    //Every cell and total of a corrected table, up to the triples
+    CountTable::reserve(numberControlSamples + numberCaseSamples + TRIPLET_CELLS);
     
     outputDirectory_ = FilePath();
     outputDirectory_.moveDown("output");
 }
 
-void LDForest::insert(const Snp & snp, char chromosome, int basePair)
+void LDForest::setPhenotypes(const PhenotypeSet * phenotypes)
 {
-    ldgroups_.push_back(LDGroup(snp, chromosome, basePair));
+    phenotypes_ = phenotypes;
+    topSnpLists_.resize(phenotypes_ != NULL ? phenotypes_->size() : 1, topSnpLists_[0]);
+}
+
+void LDForest::setAllModels()
+{
+    topSnpLists_.resize(NUMBER_MODELS, topSnpLists_[0]);
+}
+
+void LDForest::setQuantitativeTrait(const QuantitativeTrait * trait)
+{
+    trait_ = trait;
+}
+
+void LDForest::reserve(int numberSnps)
+{
+    snps_.reserve(numberSnps);
+    genomeLocations_.reserve(numberSnps);
+    if(phenotypes_ != NULL)
+        activePhenotypes_.reserve(numberSnps);
+}
+
+void LDForest::insert(Snp snp, GenomeLocation location)
+{
+    snps_.push_back(move(snp));
+    genomeLocations_.push_back(move(location));
+}
+
+void LDForest::insert(Snp snp, GenomeLocation location, uint64_t activePhenotypes)
+{
+    insert(move(snp), move(location));
+    activePhenotypes_.push_back(activePhenotypes);
 }
 
 int LDForest::size()const
@@ -18,74 +53,810 @@ int LDForest::size()const
     return ldgroups_.size();
 }
 
-void LDForest::createGroups(vector<vector<int>> clusterIndices)
+int LDForest::getNumberSnps()const
+{
+    return snps_.size();
+}
+
+/*
+ * One pass lays the clusters out back to back. When every Snp views the same arena their slots are
+ * gathered into a new arena in the same order, so the planes of a group are contiguous as well.
+ */
+void LDForest::createGroups(const vector<vector<int>> & clusterIndices)
 {
     cout<<"---Creating LD Groups"<<endl;
-    vector<LDGroup> createdGroups;
+    vector<int> order;
+    order.reserve(snps_.size());
+    vector<int> groupStarts;
     for(int c = 0; c < clusterIndices.size(); c++) {
-        if(clusterIndices[c].size() > 1) {
-            LDGroup prevGroup(ldgroups_[clusterIndices[c][0]], ldgroups_[clusterIndices[c][1]]);
-            for(int i = 2; i < clusterIndices[c].size(); i++) {
-                LDGroup potentialGroup(prevGroup, ldgroups_[clusterIndices[c][i]]);
-                prevGroup.nodes_ = potentialGroup.nodes_;
-                prevGroup.genomeLocations_ = potentialGroup.genomeLocations_;
-            }
-            LDGroup finalgroup(prevGroup);
+        if(clusterIndices[c].empty())
+            continue;
+        groupStarts.push_back(order.size());
+        order.insert(order.end(), clusterIndices[c].begin(), clusterIndices[c].end());
+    }
+    groupStarts.push_back(order.size());
+    
+    bool sharedArena = !snps_.empty();
+    for(int i=1; i<snps_.size() && sharedArena; ++i)
+        sharedArena = snps_[i].getArena() == snps_[0].getArena();
+    
+    vector<Snp> groupedSnps;
+    vector<GenomeLocation> groupedLocations;
+    groupedSnps.reserve(order.size());
+    groupedLocations.reserve(order.size());
+    if(sharedArena)
+    {
+        vector<int> slots(order.size());
+        for(int k=0; k<order.size(); ++k)
+            slots[k] = snps_[order[k]].getSlot();
+        shared_ptr<GenotypeArena> arena = snps_[0].getArena()->gather(slots);
+        for(int k=0; k<order.size(); ++k)
+            groupedSnps.push_back(Snp(snps_[order[k]].getIndex(), arena, k, snps_[order[k]].getWeight()));
+    }
+    else
+    {
+        for(int k=0; k<order.size(); ++k)
+            groupedSnps.push_back(move(snps_[order[k]]));
+    }
+    for(int k=0; k<order.size(); ++k)
+        groupedLocations.push_back(move(genomeLocations_[order[k]]));
+    snps_ = move(groupedSnps);
+    genomeLocations_ = move(groupedLocations);
+    if(!activePhenotypes_.empty())
+    {
+        vector<uint64_t> groupedPhenotypes(order.size());
+        for(int k=0; k<order.size(); ++k)
+            groupedPhenotypes[k] = activePhenotypes_[order[k]];
+        activePhenotypes_ = move(groupedPhenotypes);
+    }
+    
+    ldgroups_.clear();
+    ldgroups_.reserve(groupStarts.size()-1);
+    for(int g=0; g+1<groupStarts.size(); ++g)
+    {
+        int start = groupStarts[g];
+        if(activePhenotypes_.empty())
+            ldgroups_.push_back(LDGroup(&snps_[start], &genomeLocations_[start], groupStarts[g+1] - start));
+        else
+            ldgroups_.push_back(LDGroup(&snps_[start], &genomeLocations_[start], &activePhenotypes_[start], groupStarts[g+1] - start));
+    }
+    cout<<"The number of LD Groups: "<<size()<<endl;
+}
+
+void LDForest::createLDGroups(float maxDifference, int maxThreadUsage)
+{
+    createGroups(LDClustering::cluster(snps_, genomeLocations_, maxDifference, maxThreadUsage));
+}
+
+/*
+ * Each randomized grouping cuts the groups into windows of RANDOM_GROUPING_WINDOW neighbouring groups
+ * and deals the SNPs of every window out again at random, keeping the group sizes, so the popcovers
+ * rank other member pairs. The Snps are copies viewing the same arena slots, the planes are shared.
+ */
+void LDForest::createRandomGroupings(int numberTrees)
+{
+    mt19937 generator(RANDOM_GROUPING_SEED);
+    randomGroupings_.clear();
+    randomGroupings_.resize(max(numberTrees-1, 0));
+    for(int t=0; t<randomGroupings_.size(); ++t)
+    {
+        vector<int> order(snps_.size());
+        for(int k=0; k<order.size(); ++k)
+            order[k] = k;
+        int windowBegin = 0;
+        for(int g=0; g<size(); ++g)
+        {
+            int windowEnd = (ldgroups_[g].nodes_ - snps_.data()) + ldgroups_[g].size();
+            if((g+1)%RANDOM_GROUPING_WINDOW == 0 || g+1 == size())
             {
-                createdGroups.push_back(finalgroup);
+                shuffle(order.begin() + windowBegin, order.begin() + windowEnd, generator);
+                windowBegin = windowEnd;
             }
         }
-        else if(clusterIndices[c].size() == 1) {
-            createdGroups.push_back(ldgroups_[clusterIndices[c][0]]);
+        
+        RandomGrouping & grouping = randomGroupings_[t];
+        grouping.snps_.reserve(order.size());
+        grouping.genomeLocations_.reserve(order.size());
+        for(int k=0; k<order.size(); ++k)
+        {
+            grouping.snps_.push_back(snps_[order[k]]);
+            grouping.genomeLocations_.push_back(genomeLocations_[order[k]]);
+        }
+        grouping.ldgroups_.reserve(size());
+        for(int g=0; g<size(); ++g)
+        {
+            int start = ldgroups_[g].nodes_ - snps_.data();
+            grouping.ldgroups_.push_back(LDGroup(&grouping.snps_[start], &grouping.genomeLocations_[start], ldgroups_[g].size()));
         }
     }
-    
-    ldgroups_ = createdGroups;
-    cout<<"The number of LD Groups: "<<size()<<endl;
+    cout<<"The number of randomized groupings: "<<randomGroupings_.size()<<endl;
+}
+
+const TopSnpList & LDForest::getTopSnpList(int list)const
+{
+    return topSnpLists_[list];
+}
+
+const vector<LDGroup> & LDForest::getGrouping(int grouping)const
+{
+    return grouping == 0 ? ldgroups_ : randomGroupings_[grouping-1].ldgroups_;
+}
+
+double LDForest::estimatePairCost(int sizeA, int sizeB, bool exhaustive)const
+{
+    int pairs = sizeA*sizeB;
+    if(exhaustive)
+        return pairs*TEST_COST;
+    return pairs*POPCOVER_COST + min(POPCOVER_TOP_K, pairs)*TEST_COST;
+}
+
+/*
+ * The row-major pair sequence is first cut into numberShards runs of equal estimated cost, the same
+ * cut in every process, and only the pairs of the given shard are tiled.
+ */
+vector<PairTile> LDForest::createTiles(const vector<LDGroup> & groups, int grouping, int numberThreads, bool exhaustive, int shard, int numberShards)const
+{
+    double totalCost = 0.0;
+    for(int i=0; i<groups.size(); ++i)
+        for(int j=i+1; j<groups.size(); ++j)
+            totalCost += estimatePairCost(groups[i].size(), groups[j].size(), exhaustive);
+    double shardBegin = totalCost*shard/numberShards;
+    double shardEnd = totalCost*(shard+1)/numberShards;
+
+    //Cut the row-major pair sequence whenever a tile reaches its share of the cost
+    double targetCost = max(totalCost/numberShards/(numberThreads*TILES_PER_THREAD), 1.0);
+    vector<PairTile> tiles;
+    PairTile tile{0, 1, 0, 1, 0, 0.0, grouping};
+    double costBefore = 0.0;
+    for(int i=0; i<groups.size(); ++i)
+    {
+        for(int j=i+1; j<groups.size(); ++j)
+        {
+            double cost = estimatePairCost(groups[i].size(), groups[j].size(), exhaustive);
+            bool inShard = costBefore >= shardBegin && (costBefore < shardEnd || shard == numberShards-1);
+            costBefore += cost;
+            if(!inShard)
+                continue;
+            
+            if(tile.pairs_ == 0)
+            {
+                tile.rowBegin_ = i;
+                tile.colBegin_ = j;
+            }
+            tile.cost_ += cost;
+            tile.pairs_++;
+            //Ends just past the current pair
+            tile.rowEnd_ = (j+1 < groups.size()) ? i : i+1;
+            tile.colEnd_ = (j+1 < groups.size()) ? j+1 : i+2;
+            if(tile.cost_ >= targetCost)
+            {
+                tiles.push_back(tile);
+                tile.pairs_ = 0;
+                tile.cost_ = 0.0;
+            }
+        }
+    }
+    if(tile.pairs_ > 0)
+        tiles.push_back(tile);
+    return tiles;
 }
 
+//The statistic is picked once here, everything below runs the loops instantiated for it
 void LDForest::testGroups(int maxThreadUsage,  ParameterInfo parameterInfo)
 {
+    switch(parameterInfo.statistic_)
+    {
+        case G_TEST: testGroupsWith<GTest>(maxThreadUsage, parameterInfo); break;
+        case MUTUAL_INFORMATION: testGroupsWith<MutualInformation>(maxThreadUsage, parameterInfo); break;
+        case INTERACTION_CONTRAST: testGroupsWith<InteractionContrast>(maxThreadUsage, parameterInfo); break;
+        default: testGroupsWith<PearsonChiSquare>(maxThreadUsage, parameterInfo);
+    }
+}
+
+/*
+ * Without checkpoints every tile runs in one scheduler pass. With them the tiles run in epochs sized
+ * from the measured speed to last about checkpointInterval_ seconds, and the finished tiles and the
+ * lists are written between epochs, when no thread is inserting. The testing loop itself is the same.
+ */
+template<class Statistic>
+void LDForest::testGroupsWith(int maxThreadUsage,  ParameterInfo parameterInfo)
+{
+    //The randomized groupings run in the same scheduler pass, after the tiles of the groups
+    bool checkpointing = parameterInfo.checkpointInterval_ > 0.0;
+    int tileThreads = checkpointing || parameterInfo.resume_ ? CHECKPOINT_TILE_THREADS : maxThreadUsage;
+    vector<PairTile> tiles;
+    for(int g=0; g<=randomGroupings_.size(); ++g)
+    {
+        vector<PairTile> groupingTiles = createTiles(getGrouping(g), g, tileThreads, parameterInfo.exhaustiveTesting_, parameterInfo.shard_, parameterInfo.numberShards_);
+        tiles.insert(tiles.end(), groupingTiles.begin(), groupingTiles.end());
+    }
+    long long int totalPairs = 0;
+    double totalCost = 0.0;
+    for(int t=0; t<tiles.size(); ++t)
+    {
+        totalPairs += tiles[t].pairs_;
+        totalCost += tiles[t].cost_;
+    }
     cout<<"---Testing Pairs"<<endl;
-    cout<<"\tFinished 0/"<<size()<<"               \r"<<flush;
+    if(parameterInfo.numberShards_ > 1)
+        cout<<"\tShard "<<parameterInfo.shard_+1<<"/"<<parameterInfo.numberShards_<<endl;
+    
+    string checkpointName = (parameterInfo.numberShards_ > 1 ? shardFileName(parameterInfo.outputFileName_, parameterInfo.shard_, parameterInfo.numberShards_)
+                                                             : parameterInfo.outputFileName_) + ".checkpoint";
+    uint64_t fingerprint = checkpointing || parameterInfo.resume_ ? runFingerprint(tiles, parameterInfo, maxThreadUsage) : 0;
+    vector<char> tileDone(tiles.size(), 0);
+    atomic<long long int> pairsFinished(0);
+    if(parameterInfo.resume_ && readCheckpoint(checkpointName, fingerprint, tileDone))
+    {
+        for(int t=0; t<tiles.size(); ++t)
+            if(tileDone[t])
+                pairsFinished += tiles[t].pairs_;
+        cout<<"\tResumed with "<<pairsFinished<<"/"<<totalPairs<<" pairs done"<<endl;
+    }
+    cout<<"\tFinished "<<pairsFinished<<"/"<<totalPairs<<"               \r"<<flush;
+    
+    for(int p=0; p<topSnpLists_.size(); ++p)
+        topSnpLists_[p].reserveThreads(maxThreadUsage);
+    
+    for(int g=0; g<=randomGroupings_.size(); ++g)
+    {
+        vector<LDGroup> & groups = g == 0 ? ldgroups_ : randomGroupings_[g-1].ldgroups_;
+        #pragma omp parallel for num_threads(maxThreadUsage) schedule(dynamic, 64)
+        for(int i=0; i<groups.size(); ++i)
+            groups[i].summarize();
+    }
+    
+    /*
+     * A pair met again in another grouping is scored once, the filter is sized for the member pairs the
+     * groupings can score. The groups only mark their pairs and run before the randomized groupings,
+     * which skip the marked ones, so a false positive of the filter can only cost a randomized grouping
+     * a pair and every pair of a single grouping is still scored.
+     */
+    unique_ptr<SeenPairFilter> seenPairs;
+    if(!randomGroupings_.empty())
+    {
+        long long int scoredPairs = 0;
+        for(int g=0; g<=randomGroupings_.size(); ++g)
+        {
+            const vector<LDGroup> & groups = getGrouping(g);
+            for(int i=0; i<groups.size(); ++i)
+                for(int j=i+1; j<groups.size(); ++j)
+                {
+                    long long int pairs = (long long int)groups[i].size()*groups[j].size();
+                    scoredPairs += parameterInfo.exhaustiveTesting_ ? pairs : min((long long int)POPCOVER_TOP_K, pairs);
+                }
+        }
+        seenPairs.reset(new SeenPairFilter(scoredPairs));
+    }
     
-    int testsFinished = 0;
-    #pragma omp parallel for num_threads(maxThreadUsage) schedule(dynamic, 20)
-    for(int i=0; i<size(); ++i)
+    TopSnpListSink sink{topSnpLists_};
+    auto testTile = [&](const PairTile & tile)
     {
-		
-        for(int j=i+1; j<size(); ++j)
-            ldgroups_[i].epistasisTest(ldgroups_[j], topSnpList_);
+        const vector<LDGroup> & groups = getGrouping(tile.grouping_);
+        bool skipSeen = tile.grouping_ > 0;
+        long long int pruned = 0;
+        int i = tile.rowBegin_;
+        int j = tile.colBegin_;
+        while(i < tile.rowEnd_ || (i == tile.rowEnd_ && j < tile.colEnd_))
+        {
+            if(canPrune<Statistic>(groups[i], groups[j], parameterInfo.caseOnly_ || trait_ != NULL ? -1 : parameterInfo.model_))
+                pruned++;
+            else if(parameterInfo.caseOnly_)
+                groups[i].caseOnlyTest(groups[j], topSnpLists_[0], parameterInfo.exhaustiveTesting_);
+            else if(trait_ != NULL)
+                groups[i].quantitativeTest(groups[j], *trait_, topSnpLists_[0], parameterInfo.exhaustiveTesting_);
+            else if(phenotypes_ != NULL)
+                groups[i].template phenotypeTest<Statistic>(groups[j], *phenotypes_, sink, parameterInfo.exhaustiveTesting_);
+            else switch(parameterInfo.model_)
+            {
+                case DOMINANT_MODEL: testGroupPair<Statistic, DominantModel>(groups[i], groups[j], parameterInfo.exhaustiveTesting_, parameterInfo.hierarchicalThreshold_, seenPairs.get(), skipSeen); break;
+                case RECESSIVE_MODEL: testGroupPair<Statistic, RecessiveModel>(groups[i], groups[j], parameterInfo.exhaustiveTesting_, parameterInfo.hierarchicalThreshold_, seenPairs.get(), skipSeen); break;
+                case ADDITIVE_MODEL: testGroupPair<Statistic, AdditiveModel>(groups[i], groups[j], parameterInfo.exhaustiveTesting_, parameterInfo.hierarchicalThreshold_, seenPairs.get(), skipSeen); break;
+                case ALL_MODELS: groups[i].template modelsTest<Statistic>(groups[j], topSnpLists_, parameterInfo.exhaustiveTesting_); break;
+                default: testGroupPair<Statistic, GenotypicModel>(groups[i], groups[j], parameterInfo.exhaustiveTesting_, parameterInfo.hierarchicalThreshold_, seenPairs.get(), skipSeen);
+            }
+            
+            if(++j == groups.size())
+            {
+                ++i;
+                j = i+1;
+            }
+        }
+        for(int p=0; p<topSnpLists_.size(); ++p)
+        {
+            topSnpLists_[p].incrementGroupPairsCounter(tile.pairs_);
+            topSnpLists_[p].incrementPrunedGroupPairsCounter(pruned);
+        }
         
-        if(i % 100 == 0)
-        {   
+        long long int done = pairsFinished.fetch_add(tile.pairs_) + tile.pairs_;
+        if(done*100/totalPairs != (done-tile.pairs_)*100/totalPairs)
+        {
             #pragma omp critical
+            cout<<"\tFinished "<<done<<"/"<<totalPairs<<"               \r"<<flush;
+        }
+    };
+    
+    //The first epoch measures the speed
+    double epochCost = totalCost*FIRST_EPOCH_FRACTION;
+    int epochs = 0;
+    int next = 0;
+    while(next < tiles.size())
+    {
+        vector<int> epoch;
+        vector<PairTile> epochTiles;
+        double cost = 0.0;
+        for(; next < tiles.size() && (!checkpointing || epochTiles.empty() || cost < epochCost); ++next)
+        {
+            //The groups finish before the randomized groupings start
+            if(!epochTiles.empty() && epochTiles[0].grouping_ == 0 && tiles[next].grouping_ > 0)
+                break;
+            if(tileDone[next])
+                continue;
+            epoch.push_back(next);
+            epochTiles.push_back(tiles[next]);
+            cost += tiles[next].cost_;
+        }
+        if(epochTiles.empty())
+            break;
+        
+        TileScheduler scheduler(epochTiles, maxThreadUsage);
+        double start = omp_get_wtime();
+        scheduler.run(testTile);
+        double seconds = omp_get_wtime() - start;
+        epochs++;
+        if(!checkpointing)
+        {
+            cout<<endl;
+            scheduler.printTimings(cout);
+            continue;
+        }
+        
+        for(int k=0; k<epoch.size(); ++k)
+            tileDone[epoch[k]] = 1;
+        epochCost = seconds > 0.0 ? cost*parameterInfo.checkpointInterval_/seconds : totalCost;
+        writeCheckpoint(checkpointName, fingerprint, tileDone);
+    }
+    if(checkpointing)
+        cout<<endl<<"\tCheckpointed "<<epochs<<" epochs"<<endl;
+    if(checkpointing || parameterInfo.resume_)
+    {
+        //Only a run that stopped early needs its checkpoint
+        outputDirectory_.makeActive();
+        remove(checkpointName.c_str());
+        outputDirectory_.returnActive();
+    }
+    cout<<"\tPruned "<<topSnpLists_[0].getPrunedGroupPairs()<<"/"<<topSnpLists_[0].getGroupPairs()<<" group pairs"<<endl;
+    if(seenPairs)
+        cout<<"\tSkipped "<<seenPairs->getSeenPairs()<<" pairs scored in another grouping"<<endl;
+}
+
+template<class Statistic, class Model>
+void LDForest::testGroupPair(const LDGroup & group1, const LDGroup & group2, bool exhaustive, float hierarchicalThreshold,
+                             SeenPairFilter * seenPairs, bool skipSeen)
+{
+    //A pair of single SNPs is its own representative
+    if(hierarchicalThreshold > 0.0 && group1.size()*group2.size() > 1
+       && group1.template representativeTest<Statistic, Model>(group2, topSnpLists_[0]) < hierarchicalThreshold*topSnpLists_[0].getCutoff())
+        return;
+    if(exhaustive)
+        group1.template exhaustiveTest<Statistic, Model>(group2, topSnpLists_[0], seenPairs, skipSeen);
+    else
+        group1.template epistasisTest<Statistic, Model>(group2, topSnpLists_[0], seenPairs, skipSeen);
+}
+
+//FNV-1a over the bytes of the fingerprint
+static void hashBytes(uint64_t & hash, const void * data, size_t size)
+{
+    const unsigned char * bytes = (const unsigned char*)data;
+    for(size_t k=0; k<size; ++k)
+    {
+        hash ^= bytes[k];
+        hash *= 0x100000001B3ULL;
+    }
+}
+
+//The same a word at a time for the planes, every step still one to one so a changed word changes the hash
+static uint64_t hashWords(const PACK_TYPE * words, size_t size)
+{
+    uint64_t retVal = 0xCBF29CE484222325ULL;
+    for(size_t k=0; k<size; ++k)
+        retVal = (retVal ^ words[k])*0x100000001B3ULL;
+    return retVal;
+}
+
+/*
+ * The planes place every sample by its label, so with the case and control counts they cover the
+ * genotypes and the case mask. The phenotype masks and trait planes of those modes are added whole.
+ */
+uint64_t LDForest::runFingerprint(const vector<PairTile> & tiles, const ParameterInfo & parameterInfo, int maxThreadUsage)const
+{
+    uint64_t retVal = 0xCBF29CE484222325ULL;
+    int32_t settings[7] = {parameterInfo.statistic_, parameterInfo.model_, parameterInfo.exhaustiveTesting_, parameterInfo.caseOnly_,
+                           parameterInfo.quantitative_, parameterInfo.shard_, parameterInfo.numberShards_};
+    float thresholds[2] = {parameterInfo.maxMarginalSignificance_, parameterInfo.hierarchicalThreshold_};
+    hashBytes(retVal, settings, sizeof(settings));
+    hashBytes(retVal, thresholds, sizeof(thresholds));
+    
+    vector<uint64_t> snpHashes(snps_.size());
+    #pragma omp parallel for schedule(static) num_threads(maxThreadUsage)
+    for(int i=0; i<snps_.size(); ++i)
+        snpHashes[i] = hashWords(snps_[i].allSamples_, Snp::getPlaneWords());
+    hashBytes(retVal, snpHashes.data(), snpHashes.size()*sizeof(uint64_t));
+    if(!snps_.empty())
+    {
+        int32_t samples[2] = {snps_[0].getControlNo(), snps_[0].getCaseNo()};
+        hashBytes(retVal, samples, sizeof(samples));
+    }
+    if(phenotypes_ != NULL)
+    {
+        uint64_t masks = hashWords(phenotypes_->getMasks().data(), phenotypes_->getMasks().size());
+        hashBytes(retVal, &masks, sizeof(masks));
+    }
+    if(trait_ != NULL)
+    {
+        uint64_t planes = hashWords(trait_->getPlanes().data(), trait_->getPlanes().size());
+        hashBytes(retVal, &planes, sizeof(planes));
+    }
+    
+    for(int g=0; g<=randomGroupings_.size(); ++g)
+    {
+        const vector<LDGroup> & groups = getGrouping(g);
+        for(int i=0; i<groups.size(); ++i)
+        {
+            int32_t groupSize = groups[i].size();
+            hashBytes(retVal, &groupSize, sizeof(groupSize));
+            for(int n=0; n<groups[i].size(); ++n)
             {
-            testsFinished +=100;
-            cout<<"\tFinished "<<min(testsFinished, size())<<"/"<<size()<<"               \r"<<flush;
+                int32_t index = groups[i].nodes_[n].getIndex();
+                hashBytes(retVal, &index, sizeof(index));
             }
-                
         }
+    }
+    for(int t=0; t<tiles.size(); ++t)
+    {
+        int32_t bounds[5] = {tiles[t].rowBegin_, tiles[t].colBegin_, tiles[t].rowEnd_, tiles[t].colEnd_, tiles[t].grouping_};
+        hashBytes(retVal, bounds, sizeof(bounds));
+    }
+    return retVal;
+}
+
+//Flushes a written file, or a directory after a rename in it, to the disk
+static bool syncPath(string path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    bool retVal = fsync(fd) == 0;
+    close(fd);
+    return retVal;
+}
+
+/*
+ * The fingerprint of the run and the finished tiles as one byte each, then every TopSnpList as in a
+ * shard file. The file is written beside the old one, synced to the disk and renamed over it, and the
+ * rename is synced in turn, so a crash at any point leaves either the previous checkpoint or this one whole.
+ */
+void LDForest::writeCheckpoint(string fileName, uint64_t fingerprint, const vector<char> & tileDone)
+{
+    outputDirectory_.makeActive();
+    string tempName = fileName + ".tmp";
+    ofstream ofs(tempName, ofstream::binary);
+    int32_t header[2] = {(int32_t)tileDone.size(), (int32_t)topSnpLists_.size()};
+    ofs.write((const char*)&fingerprint, sizeof(fingerprint));
+    ofs.write((const char*)header, sizeof(header));
+    ofs.write(tileDone.data(), tileDone.size());
+    for(int p=0; p<topSnpLists_.size(); ++p)
+        topSnpLists_[p].writeBinary(ofs);
+    ofs.close();
+    size_t slash = fileName.rfind('/');
+    string directory = slash == string::npos ? "." : fileName.substr(0, slash+1);
+    if(ofs && syncPath(tempName) && rename(tempName.c_str(), fileName.c_str()) == 0)
+        syncPath(directory);
+    else
+        cout<<"\tCould not write the checkpoint "<<fileName<<endl;
+    outputDirectory_.returnActive();
+}
+
+bool LDForest::readCheckpoint(string fileName, uint64_t fingerprint, vector<char> & tileDone)
+{
+    outputDirectory_.makeActive();
+    ifstream ifs(fileName, ifstream::binary);
+    uint64_t fileFingerprint;
+    int32_t header[2];
+    ifs.read((char*)&fileFingerprint, sizeof(fileFingerprint));
+    ifs.read((char*)header, sizeof(header));
+    bool retVal = ifs && fileFingerprint == fingerprint && header[0] == tileDone.size() && header[1] == topSnpLists_.size();
+    
+    //Loaded into copies so a bad file leaves the lists empty
+    vector<char> loadedDone(tileDone.size());
+    vector<TopSnpList> loadedLists(topSnpLists_);
+    if(retVal)
+        ifs.read(loadedDone.data(), loadedDone.size());
+    for(int p=0; p<loadedLists.size() && retVal; ++p)
+        retVal = loadedLists[p].mergeBinary(ifs);
+    //A checkpoint ends with its last list
+    retVal = retVal && ifs && ifs.peek() == ifstream::traits_type::eof();
+    outputDirectory_.returnActive();
+    
+    if(!retVal)
+    {
+        cout<<"\tNo checkpoint of this run in "<<fileName<<", starting over"<<endl;
+        return false;
+    }
+    tileDone.swap(loadedDone);
+    topSnpLists_.swap(loadedLists);
+    return true;
+}
+
+void LDForest::testTriplets(int maxThreadUsage, int seedPairs, int statistic, TopTripletList & topTriplets)
+{
+    switch(statistic)
+    {
+        case G_TEST: testTripletsWith<GTest>(maxThreadUsage, seedPairs, topTriplets); break;
+        case MUTUAL_INFORMATION: testTripletsWith<MutualInformation>(maxThreadUsage, seedPairs, topTriplets); break;
+        case INTERACTION_CONTRAST: testTripletsWith<InteractionContrast>(maxThreadUsage, seedPairs, topTriplets); break;
+        default: testTripletsWith<PearsonChiSquare>(maxThreadUsage, seedPairs, topTriplets);
+    }
+}
+
+//Snp::epistasisTest with the statistic of every pair, found by SNP index
+template<class Statistic>
+static vector<float> confirmWith(const vector<Snp> & snps, const vector<int> & positions, const vector<TopPairing> & pairs)
+{
+    vector<float> retVal;
+    for(int k=0; k<pairs.size(); ++k)
+    {
+        const Snp & snp1 = snps[positions[pairs[k].indexes_.first]];
+        const Snp & snp2 = snps[positions[pairs[k].indexes_.second]];
+        retVal.push_back(snp1.epistasisTest<Statistic>(snp2));
+    }
+    return retVal;
+}
+
+vector<float> LDForest::confirmPairs(const vector<TopPairing> & pairs, int statistic)const
+{
+    int maxIndex = 0;
+    for(int k=0; k<snps_.size(); ++k)
+        maxIndex = max(maxIndex, snps_[k].getIndex());
+    vector<int> positions(maxIndex+1, -1);
+    for(int k=0; k<snps_.size(); ++k)
+        positions[snps_[k].getIndex()] = k;
+    
+    switch(statistic)
+    {
+        case G_TEST: return confirmWith<GTest>(snps_, positions, pairs);
+        case MUTUAL_INFORMATION: return confirmWith<MutualInformation>(snps_, positions, pairs);
+        case INTERACTION_CONTRAST: return confirmWith<InteractionContrast>(snps_, positions, pairs);
+        default: return confirmWith<PearsonChiSquare>(snps_, positions, pairs);
+    }
+}
+
+/*
+ * The seeds are the pairs above the cutoff, as in the cutoff pairs output, best first. The third SNPs
+ * of every seed are all members of the groups of every seed SNP, so triples stay among the SNPs the
+ * pairwise search already singled out. A triple is skipped when its third SNP is in LD with either
+ * SNP of the seed.
+ */
+template<class Statistic>
+void LDForest::testTripletsWith(int maxThreadUsage, int seedPairs, TopTripletList & topTriplets)
+{
+    cout<<"---Testing Triplets"<<endl;
+    const TopSnpList & topSnpList = topSnpLists_[0];
+    //Position in snps_ of every SNP index
+    int maxIndex = 0;
+    for(int k=0; k<snps_.size(); ++k)
+        maxIndex = max(maxIndex, snps_[k].getIndex());
+    vector<int> positions(maxIndex+1, -1);
+    for(int k=0; k<snps_.size(); ++k)
+        positions[snps_[k].getIndex()] = k;
+    vector<int> groupOf(snps_.size());
+    for(int g=0; g<size(); ++g)
+        for(int k=0; k<ldgroups_[g].size(); ++k)
+            groupOf[ldgroups_[g].nodes_ - snps_.data() + k] = g;
+    
+    vector<TopPairing> seeds;
+    for(int k=0; k<snps_.size(); ++k)
+    {
+        int partner = topSnpList.getTopPartner(snps_[k].getIndex());
+        float score = topSnpList.getTopScore(snps_[k].getIndex());
+        if(partner != -1 && score > 0 && score >= topSnpList.getCutoff()-1 && snps_[k].getIndex() < partner)
+            seeds.push_back(TopPairing(snps_[k].getIndex(), partner, score));
+    }
+    sort(seeds.rbegin(), seeds.rend(), TopPairing::orderByScore);
+    if(seeds.size() > seedPairs)
+        seeds.erase(seeds.begin() + seedPairs, seeds.end());
+    
+    vector<char> candidateGroup(size(), 0);
+    for(int s=0; s<seeds.size(); ++s)
+    {
+        candidateGroup[groupOf[positions[seeds[s].indexes_.first]]] = 1;
+        candidateGroup[groupOf[positions[seeds[s].indexes_.second]]] = 1;
+    }
+    vector<int> candidates;
+    int candidateSnps = 0;
+    for(int g=0; g<size(); ++g)
+        if(candidateGroup[g])
+        {
+            candidates.push_back(g);
+            candidateSnps += ldgroups_[g].size();
+        }
+    cout<<"\t"<<seeds.size()<<" seed pairs, "<<candidateSnps<<" third SNPs"<<endl;
+    
+    #pragma omp parallel for num_threads(maxThreadUsage) schedule(dynamic)
+    for(int s=0; s<seeds.size(); ++s)
+    {
+        static thread_local vector<int> counts;
+        int a = positions[seeds[s].indexes_.first];
+        int b = positions[seeds[s].indexes_.second];
+        long long int testsDone = 0;
+        for(int g=0; g<candidates.size(); ++g)
+        {
+            const LDGroup & group = ldgroups_[candidates[g]];
+            if(counts.size() < group.size()*TRIPLET_CELLS)
+                counts.resize(group.size()*TRIPLET_CELLS);
+            TripletTest::countTables(snps_[a], snps_[b], group.nodes_, group.size(), counts.data());
             
+            for(int k=0; k<group.size(); ++k)
+            {
+                int c = group.nodes_ - snps_.data() + k;
+                if(c == a || c == b || genomeLocations_[c].inLinkageDisequilibrium(genomeLocations_[a])
+                    || genomeLocations_[c].inLinkageDisequilibrium(genomeLocations_[b]))
+                    continue;
+                TripletContingencyTable t;
+                //PLUS ONE FOR CORRECTION
+                for(int cell=0; cell<TRIPLET_CELLS; ++cell)
+                    t.M_[cell] = counts[k*TRIPLET_CELLS + cell]+1;
+                topTriplets.attemptInsert(snps_[a].getIndex(), snps_[b].getIndex(), snps_[c].getIndex(), t.template score<Statistic>());
+                testsDone++;
+            }
+        }
+        topTriplets.incrementTestsCounter(testsDone);
+    }
+    cout<<"\tTriplet Tests: "<<topTriplets.getTests()<<endl;
+}
+
+void LDForest::testPermutations(PermutationTest & permutations, int maxThreadUsage, ParameterInfo parameterInfo)
+{
+    switch(parameterInfo.statistic_)
+    {
+        case G_TEST: testPermutationsWith<GTest>(permutations, maxThreadUsage, parameterInfo); break;
+        case MUTUAL_INFORMATION: testPermutationsWith<MutualInformation>(permutations, maxThreadUsage, parameterInfo); break;
+        case INTERACTION_CONTRAST: testPermutationsWith<InteractionContrast>(permutations, maxThreadUsage, parameterInfo); break;
+        default: testPermutationsWith<PearsonChiSquare>(permutations, maxThreadUsage, parameterInfo);
+    }
+}
+
+/*
+ * The same tiles as testGroups, run once per batch of permutations. Only the LD span prunes, the
+ * score bounds hold for the observed labels alone. Every shuffled mask keeps the number of cases so
+ * the SNPs and groups chosen under the observed labels are kept for each permutation.
+ */
+template<class Statistic>
+void LDForest::testPermutationsWith(PermutationTest & permutations, int maxThreadUsage, ParameterInfo parameterInfo)
+{
+    cout<<"---Testing Permutations"<<endl;
+    cout<<"\tFinished 0/"<<permutations.size()<<"               \r"<<flush;
+    
+    vector<PairTile> tiles = createTiles(ldgroups_, 0, maxThreadUsage, parameterInfo.exhaustiveTesting_, 0, 1);
+    for(int b=0; b<permutations.getBatchNo(); ++b)
+    {
+        const PhenotypeSet & batch = permutations.getBatch(b);
+        PermutationSink sink{permutations, b*MAX_PHENOTYPES};
+        TileScheduler scheduler(tiles, maxThreadUsage);
+        scheduler.run([&](const PairTile & tile)
+        {
+            int i = tile.rowBegin_;
+            int j = tile.colBegin_;
+            while(i < tile.rowEnd_ || (i == tile.rowEnd_ && j < tile.colEnd_))
+            {
+                if(!ldgroups_[i].allInLinkageDisequilibrium(ldgroups_[j]))
+                    ldgroups_[i].template phenotypeTest<Statistic>(ldgroups_[j], batch, sink, parameterInfo.exhaustiveTesting_);
+                
+                if(++j == size())
+                {
+                    ++i;
+                    j = i+1;
+                }
+            }
+        });
+        cout<<"\tFinished "<<b*MAX_PHENOTYPES + batch.size()<<"/"<<permutations.size()<<"               \r"<<flush;
     }
     cout<<endl;
 }
 
-TopSnpList LDForest::writeResults(string fileName, ParameterInfo parameterInfo, DatasetSizeInfo datasetSizeInfo)
+/*
+ * A group pair can be skipped when every member pair is estimated to be in LD, or when no member
+ * pair can score above the cutoff nor above the current best of either SNP. The cutoff and best
+ * scores only ever rise so a skipped pair could not have changed the results. The score bound
+ * needs the case/control split of the planes, so with several phenotypes or models only the LD span
+ * prunes. It bounds the Pearson chi-square of the genotype table, which the additive trend test never
+ * exceeds, so the other statistics, the collapsed models and the case-only and quantitative tests,
+ * model -1, are only pruned by LD.
+ */
+template<class Statistic>
+bool LDForest::canPrune(const LDGroup & group1, const LDGroup & group2, int model)const
+{
+    if(group1.allInLinkageDisequilibrium(group2))
+        return true;
+    bool bounded = model == ADDITIVE_MODEL || (model == GENOTYPIC_MODEL && Statistic::boundedByChiSquare);
+    if(topSnpLists_.size() > 1 || !bounded)
+        return false;
+    
+    const TopSnpList & topSnpList = topSnpLists_[0];
+    float bound = group1.epistasisBound(group2);
+    if(bound > topSnpList.getCutoff())
+        return false;
+    return bound <= group1.minimumTopScore(topSnpList) && bound <= group2.minimumTopScore(topSnpList);
+}
+
+/*
+ * A shard file holds the shard position and every TopSnpList of the run, so the merge can check it
+ * belongs to the same analysis before folding it in.
+ */
+string LDForest::shardFileName(string fileName, int shard, int numberShards)
+{
+    return fileName + ".shard" + to_string(shard+1) + "of" + to_string(numberShards);
+}
+
+void LDForest::writeShard(string fileName, int shard, int numberShards)
+{
+    outputDirectory_.makeActive();
+    ofstream ofs(shardFileName(fileName, shard, numberShards), ofstream::binary);
+    int32_t header[3] = {shard, numberShards, (int32_t)topSnpLists_.size()};
+    ofs.write((const char*)header, sizeof(header));
+    for(int p=0; p<topSnpLists_.size(); ++p)
+        topSnpLists_[p].writeBinary(ofs);
+    ofs.close();
+    outputDirectory_.returnActive();
+}
+
+bool LDForest::mergeShards(string fileName, int numberShards)
 {
-    topSnpList_.calculateFormattedResults();
+    outputDirectory_.makeActive();
+    bool retVal = true;
+    for(int shard=0; shard<numberShards && retVal; ++shard)
+    {
+        ifstream ifs(shardFileName(fileName, shard, numberShards), ifstream::binary);
+        int32_t header[3];
+        ifs.read((char*)header, sizeof(header));
+        retVal = ifs && header[0] == shard && header[1] == numberShards && header[2] == topSnpLists_.size();
+        for(int p=0; p<topSnpLists_.size() && retVal; ++p)
+            retVal = topSnpLists_[p].mergeBinary(ifs);
+        if(!retVal)
+            cout<<"Could not merge "<<shardFileName(fileName, shard, numberShards)<<endl;
+    }
+    outputDirectory_.returnActive();
+    return retVal;
+}
+
+TopSnpList LDForest::writeResults(string fileName, ParameterInfo parameterInfo, DatasetSizeInfo datasetSizeInfo, int phenotype)
+{
+    TopSnpList & topSnpList = topSnpLists_[phenotype];
+    topSnpList.calculateFormattedResults();
     
     outputDirectory_.makeActive();
     ofstream ofs;
     
+    //Read before the ground truth files of this run are written over it
+    if(!parameterInfo.groundTruthFileName_.empty())
+    {
+        float recall = topSnpList.calculateRecall(parameterInfo.groundTruthFileName_);
+        if(recall < 0.0)
+            cout<<"\tNo ground truth in "<<parameterInfo.groundTruthFileName_<<endl;
+        else
+            cout<<"\tRecall of "<<parameterInfo.groundTruthFileName_<<": "<<recall<<endl;
+    }
+    
     if(parameterInfo.maxUnknownFraction_ == 0.0)
     {
-        ofs.open("reciprocalPairs.gt");
-        topSnpList_.printReciprocalPairs(ofs);
+        //Every phenotype has its own ground truth files
+        string groundTruthPrefix = topSnpLists_.size() > 1 ? fileName + "." : "";
+        ofs.open(groundTruthPrefix + "reciprocalPairs.gt");
+        topSnpList.printReciprocalPairs(ofs);
         ofs.close();
         
-        ofs.open("cutoffPairs.gt");
-        topSnpList_.printCutoffPairs(ofs);
+        ofs.open(groundTruthPrefix + "cutoffPairs.gt");
+        topSnpList.printCutoffPairs(ofs);
         ofs.close();
     }
     
@@ -101,32 +872,36 @@ TopSnpList LDForest::writeResults(string fileName, ParameterInfo parameterInfo,
     ofs.open(fileName + ".summary", ofstream::out | ofstream::app);
     
     if(needsHeader)
-        ofs <<"output_file\tsnps_input\tcase_samples\tcontrol_samples\tmax_marginal_significance\tsnps_ignored_marginal_significance\tno_of_tests\tpairs_reported"<<endl;
+        ofs <<"output_file\tsnps_input\tcase_samples\tcontrol_samples\tmax_marginal_significance\tsnps_ignored_marginal_significance\tno_of_tests\tpairs_reported\tgroup_pairs\tgroup_pairs_pruned\tpruning_rate"<<endl;
 
     ofs<<parameterInfo.outputFileName_<<"\t";
     datasetSizeInfo.printDimensions(ofs); ofs<<"\t";
     parameterInfo.printSummaryRelevant(ofs); ofs<<"\t";
     datasetSizeInfo.printSubsetDimensions(ofs); ofs<<"\t";
 
-    long long totalTestsPerformed = (topSnpList_.getLeafTests())/2; //Divide by two because each test was counted in each 
+    long long totalTestsPerformed = (topSnpList.getLeafTests())/2; //Divide by two because each test was counted in each 
     ofs<<totalTestsPerformed<<"\t";
     
-    ofs<<topSnpList_.getNumberOfReciprocalPairs();
+    ofs<<topSnpList.getNumberOfReciprocalPairs()<<"\t";
+    
+    long long int groupPairs = topSnpList.getGroupPairs();
+    ofs<<groupPairs<<"\t"<<topSnpList.getPrunedGroupPairs()<<"\t";
+    ofs<<(groupPairs > 0 ? (double)topSnpList.getPrunedGroupPairs()/groupPairs : 0.0);
     ofs<<endl;
     ofs.close();
     
     ofs.open(fileName + ".reciprocalPairs", ofstream::out | ofstream::app);
-    topSnpList_.printReciprocalPairScores(ofs);
+    topSnpList.printReciprocalPairScores(ofs);
     ofs.close();
     
     ofs.open(fileName + ".cutoffPairs", ofstream::out | ofstream::app);
-    topSnpList_.printCutoffPairScores(ofs);
+    topSnpList.printCutoffPairScores(ofs);
     ofs.close();
     
     outputDirectory_.returnActive();
     
     cout<<"---Done"<<endl;
-    cout<<"\tLeaf Tests: "<<topSnpList_.getLeafTests()<<endl;
-    cout<<"\tInternal Tests: "<<topSnpList_.getInternalTests()<<endl;
-    return topSnpList_;
+    cout<<"\tLeaf Tests: "<<topSnpList.getLeafTests()<<endl;
+    cout<<"\tInternal Tests: "<<topSnpList.getInternalTests()<<endl;
+    return topSnpList;
 }
\ No newline at end of file
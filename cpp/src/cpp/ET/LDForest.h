@@ -2,7 +2,8 @@
  * @author Tyler Cowman
  *  
  * Acts as a wrapper for a collection of LD-Groups and associated functionality
- * such as merging and testing the set of groups.
+ * such as merging and testing the set of groups. The forest owns the inserted Snps, once grouped
+ * they are reordered so every group is a contiguous range of them and of their arena slots.
  */
 
 
@@ -14,6 +15,10 @@
 #include "LDGroup.h"
 #include "TopSnpList.h"
 #include "FilePath.h"
+#include "TileScheduler.h"
+#include "TripletTest.h"
+#include "LDClustering.h"
+#include "SeenPairFilter.h"
 
 #include <limits.h>
 #include <vector>
@@ -22,6 +27,21 @@
 #include <iterator>
 #include <cmath>
 #include <bits/stdc++.h> 
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+
+//Relative cost of one popcover and one full contingency test of a SNP pair, used to size the pair tiles
+#define POPCOVER_COST 1.0
+#define TEST_COST 4.5
+#define TILES_PER_THREAD 64
+//Share of the estimated cost run before the first checkpoint, to measure the speed
+#define FIRST_EPOCH_FRACTION 0.01
+//Threads the tiles of a checkpointed run are sized for, whatever the threads of the call, so a resumed run gets the same tiles
+#define CHECKPOINT_TILE_THREADS 64
+//Neighbouring groups whose SNPs a randomized grouping deals out again
+#define RANDOM_GROUPING_WINDOW 8
+#define RANDOM_GROUPING_SEED 20190211
 
 using namespace std;
 class LDForest
@@ -29,20 +49,105 @@ class LDForest
     public:
         LDForest(int topKSnps, int numberControlSamples, int numberCaseSamples, int numberSnps);
         
-        void insert(const Snp & snp, char chromosome, int basePair);
+        //Switches to testing every phenotype of the set at once, with one TopSnpList each, before inserting
+        void setPhenotypes(const PhenotypeSet * phenotypes);
+        
+        //Switches to testing every genetic model at once, with one TopSnpList each, before testing
+        void setAllModels();
+        
+        //Switches to testing the interaction of the pairs on a quantitative trait, the Snps are packed with the samples in place
+        void setQuantitativeTrait(const QuantitativeTrait * trait);
+        
+        void reserve(int numberSnps);
+        void insert(Snp snp, GenomeLocation location);
+        //activePhenotypes has bit p set when the Snp passed the filters for phenotype p
+        void insert(Snp snp, GenomeLocation location, uint64_t activePhenotypes);
     
+        //Number of groups, zero until createGroups
         int size()const;
-        void createGroups(vector<vector<int>> clusterIndices);
+        int getNumberSnps()const;
+        //Each cluster lists insertion positions of Snps, inserted Snps in no cluster are dropped
+        void createGroups(const vector<vector<int>> & clusterIndices);
+        //Groups the Snps by LDClustering::cluster of their genotypes instead of given clusters
+        void createLDGroups(float maxDifference, int maxThreadUsage);
+        //Adds numberTrees-1 randomized groupings of the grouped Snps, tested with the groups by testGroups
+        void createRandomGroupings(int numberTrees);
+        //Checkpoints to the output directory every checkpointInterval_ seconds and resumes from it when asked,
+        //scores with the statistic_ of Statistics.h under the model_ of GeneticModel.h
         void testGroups(int maxThreadUsage,  ParameterInfo parameterInfo);
-        TopSnpList writeResults(string fileName, ParameterInfo parameterInfo, DatasetSizeInfo datasetSizeInfo);
+        //Repeats the pair search of testGroups under every permutation, the groups must be summarized by testGroups
+        void testPermutations(PermutationTest & permutations, int maxThreadUsage, ParameterInfo parameterInfo);
+        //Tests the seedPairs top pairs of testGroups against the members of their groups as third SNPs
+        void testTriplets(int maxThreadUsage, int seedPairs, int statistic, TopTripletList & topTriplets);
+        //Full case/control scores with the statistic of pairs found by a case-only testGroups, the SNPs must be inserted
+        vector<float> confirmPairs(const vector<TopPairing> & pairs, int statistic)const;
+        //Partial results of the shard tested by testGroups, in the output directory
+        void writeShard(string fileName, int shard, int numberShards);
+        //Folds the partial results of every shard into the lists, false when one is missing or does not match
+        bool mergeShards(string fileName, int numberShards);
+        //The list of one phenotype or model, 0 outside the multi-phenotype and all models modes
+        const TopSnpList & getTopSnpList(int list = 0)const;
+        //Writes the results of one phenotype or model, 0 outside the multi-phenotype and all models modes
+        TopSnpList writeResults(string fileName, ParameterInfo parameterInfo, DatasetSizeInfo datasetSizeInfo, int phenotype = 0);
     
     private:        
         //Results output
         void writeGroundTruthList();
         
+        //The tests above with the statistic fixed
+        template<class Statistic>
+        void testGroupsWith(int maxThreadUsage,  ParameterInfo parameterInfo);
+        template<class Statistic>
+        void testPermutationsWith(PermutationTest & permutations, int maxThreadUsage, ParameterInfo parameterInfo);
+        template<class Statistic>
+        void testTripletsWith(int maxThreadUsage, int seedPairs, TopTripletList & topTriplets);
+        //Single phenotype test of a group pair under one model, of the member pairs only when the root pair
+        //scores at least hierarchicalThreshold times the cutoff, and always with a threshold of 0. The pairs
+        //already in seenPairs are skipped when skipSeen
+        template<class Statistic, class Model>
+        void testGroupPair(const LDGroup & group1, const LDGroup & group2, bool exhaustive, float hierarchicalThreshold,
+                           SeenPairFilter * seenPairs, bool skipSeen);
+        
+        double estimatePairCost(int sizeA, int sizeB, bool exhaustive)const;
+        //Tiles of shard 0 <= shard < numberShards of the pair space of the groups of a grouping
+        vector<PairTile> createTiles(const vector<LDGroup> & groups, int grouping, int numberThreads, bool exhaustive, int shard, int numberShards)const;
+        //Groups of grouping 0, ldgroups_, or of a randomized one
+        const vector<LDGroup> & getGrouping(int grouping)const;
+        static string shardFileName(string fileName, int shard, int numberShards);
+        //Hash of the settings, genotypes, labels, groups and tile bounds a checkpoint of testGroups only applies to
+        uint64_t runFingerprint(const vector<PairTile> & tiles, const ParameterInfo & parameterInfo, int maxThreadUsage)const;
+        //Finished tiles and lists of an interrupted testGroups, replaced atomically once on disk
+        void writeCheckpoint(string fileName, uint64_t fingerprint, const vector<char> & tileDone);
+        //False when the file is missing or belongs to a different run
+        bool readCheckpoint(string fileName, uint64_t fingerprint, vector<char> & tileDone);
+        //True when no pair between the two groups can change the results
+        template<class Statistic>
+        bool canPrune(const LDGroup & group1, const LDGroup & group2, int model)const;
+        
+        LDForest(const LDForest & cpy);
+        LDForest & operator=(const LDForest & cpy);
+        
+        vector<Snp> snps_;
+        vector<GenomeLocation> genomeLocations_;
+        //Only filled in the multi-phenotype mode
+        vector<uint64_t> activePhenotypes_;
+        //Ranges of snps_ and genomeLocations_
         vector<LDGroup> ldgroups_;
         
-        TopSnpList topSnpList_;
+        //The Snps of the groups regrouped, as copies viewing the same planes
+        struct RandomGrouping
+        {
+            vector<Snp> snps_;
+            vector<GenomeLocation> genomeLocations_;
+            vector<LDGroup> ldgroups_;
+        };
+        vector<RandomGrouping> randomGroupings_;
+        
+        //One per phenotype, or per model in the all models mode
+        vector<TopSnpList> topSnpLists_;
+        const PhenotypeSet * phenotypes_;
+        //NULL outside the quantitative trait mode
+        const QuantitativeTrait * trait_;
         
         FilePath outputDirectory_;
 };
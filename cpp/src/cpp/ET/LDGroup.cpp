@@ -1,40 +1,29 @@
 #include "LDGroup.h" 
 
-LDGroup::LDGroup(const Snp & snp , char chromosome, int basePair)
+LDGroup::LDGroup(const Snp * nodes, const GenomeLocation * genomeLocations, int size)
 {
-   nodes_.push_back(snp);
-   genomeLocations_.push_back(GenomeLocation(chromosome, basePair));
+    nodes_ = nodes;
+    genomeLocations_ = genomeLocations;
+    phenotypes_ = NULL;
+    size_ = size;
 }
 
-LDGroup::LDGroup(const LDGroup & cpy)
+LDGroup::LDGroup(const Snp * nodes, const GenomeLocation * genomeLocations, const uint64_t * phenotypes, int size)
 {
-    nodes_ = cpy.nodes_;
-    genomeLocations_ = cpy.genomeLocations_;
-}
-//create LD GROUP
-LDGroup::LDGroup(const LDGroup & t1, const LDGroup & t2)
-{
-    nodes_.reserve(t1.size() + t2.size());
-    genomeLocations_.reserve(t1.size() + t2.size());
-    
-    for(int i=0; i<t1.size(); i++) {
-        nodes_.push_back(t1.nodes_[i]);
-        genomeLocations_.push_back(t1.genomeLocations_[i]);
-    }
-    for(int i=0; i<t2.size(); i++) {
-        nodes_.push_back(t2.nodes_[i]);
-        genomeLocations_.push_back(t2.genomeLocations_[i]);
-    }
+    nodes_ = nodes;
+    genomeLocations_ = genomeLocations;
+    phenotypes_ = phenotypes;
+    size_ = size;
 }
 
 bool LDGroup::empty()const
 {
-    return nodes_.empty();
+    return size_ == 0;
 }
 
 int LDGroup::size()const
 {
-    return nodes_.size();
+    return size_;
 }
 
 const Snp & LDGroup::getRoot()const
@@ -47,44 +36,459 @@ int LDGroup::computeDifferences(const LDGroup & other)const
     return nodes_[0].computeDifferences(other.nodes_[0]);
 }
 
-void LDGroup::clear()
+//Weighted pairs get the case count as a bonus, pairs estimated as being in LD are never ranked
+void LDGroup::rankPopcovers(const LDGroup & other, const int * popCovers, TopPopcovers & topPopcovers)const
+{
+    int otherSize = other.size_;
+    int caseBonus = nodes_[0].getCaseNo();
+    bool checkLD = anyInLinkageDisequilibrium(other);
+    for (unsigned int i = 0; i < size_; i++) {
+        const int * row = popCovers + i*otherSize;
+        int rowBonus = nodes_[i].getWeight() ? caseBonus : 0;
+        for(int j = 0; j < otherSize; j++) {
+            int key = row[j] + (other.nodes_[j].getWeight() ? rowBonus : 0);
+            if(topPopcovers.accepts(key) && !(checkLD && genomeLocations_[i].inLinkageDisequilibrium(other.genomeLocations_[j])))
+                topPopcovers.push(HeapData(key, i, j));
+        }
+    }
+}
+
+//False when the pair was already marked in seenPairs and is skipped, the pair is marked either way
+static inline bool firstScore(SeenPairFilter * seenPairs, bool skipSeen, int snpIndex1, int snpIndex2)
 {
-    nodes_.clear();
+    if(seenPairs == NULL)
+        return true;
+    if(skipSeen)
+        return !seenPairs->testAndSet(snpIndex1, snpIndex2);
+    seenPairs->set(snpIndex1, snpIndex2);
+    return true;
 }
 
-void LDGroup::epistasisTest(const LDGroup & other, TopSnpList & topSnpList)const
+template<class Statistic, class Model>
+void LDGroup::epistasisTest(const LDGroup & other, TopSnpList & topSnpList, SeenPairFilter * seenPairs, bool skipSeen)const
 {
    
-    int top_k = std::min(10, (int)(other.nodes_.size()*nodes_.size()));
+    int top_k = std::min(POPCOVER_TOP_K, (int)(other.size_*size_));
     long long int localLeaftTestsDone = 0;
 
-    PopcoverQueue popcoverQueue;
-    for (unsigned int i = 0; i < nodes_.size(); i++) {
-        for(unsigned int j = 0; j < other.nodes_.size(); j++) {
-            if((nodes_[i].getWeight()) && (other.nodes_[j].getWeight()))
-                popcoverQueue.push(HeapData((nodes_[i].computePopCoverAnd(other.nodes_[j])+nodes_[0].getCaseNo()), i, j));
-            else
-                popcoverQueue.push(HeapData(nodes_[i].computePopCoverAnd(other.nodes_[j]), i, j));
-        }
-    }
+    //Popcovers of the whole block at once, into a scratch buffer reused by this thread
+    static thread_local vector<int> popCovers;
+    int otherSize = other.size_;
+    if(popCovers.size() < size_*otherSize)
+        popCovers.resize(size_*otherSize);
+    BitGemm::popCovers(nodes_, size_, other.nodes_, otherSize, popCovers.data());
 
-    // fill the stack based on pop cover 
+    TopPopcovers topPopcovers;
+    rankPopcovers(other, popCovers.data(), topPopcovers);
+
+    // test the pairs with the highest pop cover
+    top_k = std::min(top_k, topPopcovers.size_);
     for(int i = 0; i < top_k; i++) {
-            auto a = popcoverQueue.top();
-            int Pmax = a.key;
-            unsigned int maxIndex1 = a.index1;
-            unsigned int maxIndex2 = a.index2;
-            popcoverQueue.pop();
+            unsigned int maxIndex1 = topPopcovers[i].index1;
+            unsigned int maxIndex2 = topPopcovers[i].index2;
+            if(!firstScore(seenPairs, skipSeen, nodes_[maxIndex1].getIndex(), other.nodes_[maxIndex2].getIndex()))
+                continue;
+
+            int counts[TABLE_CELLS];
+            BitGemm::countModelTables<Model>(&nodes_[maxIndex1], 1, &other.nodes_[maxIndex2], 1, counts);
+            float score = scoreModelCounts<Statistic, Model, 2>(counts);
+            topSnpList.attemptInsert(nodes_[maxIndex1].getIndex(), other.nodes_[maxIndex2].getIndex(), score);
+            localLeaftTestsDone += 2;
+    }
+    topSnpList.incrementLeafTestsCounter(localLeaftTestsDone);
+    
+}
 
-            float score = nodes_[maxIndex1].epistasisTest(other.nodes_[maxIndex2]);
+template<class Statistic, class Model>
+void LDGroup::exhaustiveTest(const LDGroup & other, TopSnpList & topSnpList, SeenPairFilter * seenPairs, bool skipSeen)const
+{
+    long long int localLeaftTestsDone = 0;
+    const int cells = Model::levels*Model::levels*CONTINGENCY_COLUMNS;
+
+    static thread_local vector<int> counts;
+    if(counts.size() < size_*other.size_*cells)
+        counts.resize(size_*other.size_*cells);
+    BitGemm::countModelTables<Model>(nodes_, size_, other.nodes_, other.size_, counts.data());
+
+    for(unsigned int i = 0; i < size_; i++) {
+        for(unsigned int j = 0; j < other.size_; j++) {
             //check to make sure not estimated as being in LD
-            if(!genomeLocations_[maxIndex1].inLinkageDisequilibrium(other.genomeLocations_[maxIndex2]) )
+            if(!genomeLocations_[i].inLinkageDisequilibrium(other.genomeLocations_[j])
+               && firstScore(seenPairs, skipSeen, nodes_[i].getIndex(), other.nodes_[j].getIndex()))
             {
-                topSnpList.attemptInsert(nodes_[maxIndex1].getIndex(), other.nodes_[maxIndex2].getIndex(), score);
+                float score = scoreModelCounts<Statistic, Model, 2>(counts.data() + (i*other.size_+j)*cells);
+                topSnpList.attemptInsert(nodes_[i].getIndex(), other.nodes_[j].getIndex(), score);
                 localLeaftTestsDone += 2;
             }
+        }
     }
     topSnpList.incrementLeafTestsCounter(localLeaftTestsDone);
+}
+
+template<class Statistic, class Model>
+float LDGroup::representativeTest(const LDGroup & other, TopSnpList & topSnpList)const
+{
+    int counts[TABLE_CELLS];
+    BitGemm::countModelTables<Model>(nodes_, 1, other.nodes_, 1, counts);
+    topSnpList.incrementInternalTestsCounter(2);
+    return scoreModelCounts<Statistic, Model, 2>(counts);
+}
+
+/*
+ * Same selection as epistasisTest with the popcovers of the cases alone, then the independence
+ * test of the 3x3 case table. Neither pass reads the control segment of the planes.
+ */
+void LDGroup::caseOnlyTest(const LDGroup & other, TopSnpList & topSnpList, bool exhaustive)const
+{
+    long long int localLeaftTestsDone = 0;
+    int otherSize = other.size_;
+    
+    auto insertPair = [&](const int * caseCounts, unsigned int i, unsigned int j)
+    {
+        int M[GENOTYPE_PAIRINGS];
+        //PLUS ONE FOR CORRECTION
+        for(int k=0; k<GENOTYPE_PAIRINGS; ++k)
+            M[k] = caseCounts[k]+1;
+        topSnpList.attemptInsert(nodes_[i].getIndex(), other.nodes_[j].getIndex(), independenceChiSquare<GENOTYPE_LEVELS>(M));
+        localLeaftTestsDone += 2;
+    };
+    
+    static thread_local vector<int> counts;
+    if(exhaustive)
+    {
+        if(counts.size() < size_*otherSize*GENOTYPE_PAIRINGS)
+            counts.resize(size_*otherSize*GENOTYPE_PAIRINGS);
+        BitGemm::countCaseTables(nodes_, size_, other.nodes_, otherSize, counts.data());
+        for(unsigned int i = 0; i < size_; i++)
+            for(unsigned int j = 0; j < otherSize; j++)
+                if(!genomeLocations_[i].inLinkageDisequilibrium(other.genomeLocations_[j]))
+                    insertPair(counts.data() + (i*otherSize+j)*GENOTYPE_PAIRINGS, i, j);
+    }
+    else
+    {
+        static thread_local vector<int> popCovers;
+        if(popCovers.size() < size_*otherSize)
+            popCovers.resize(size_*otherSize);
+        BitGemm::casePopCovers(nodes_, size_, other.nodes_, otherSize, popCovers.data());
+        
+        TopPopcovers topPopcovers;
+        rankPopcovers(other, popCovers.data(), topPopcovers);
+        
+        int top_k = std::min(std::min(POPCOVER_TOP_K, (int)(otherSize*size_)), topPopcovers.size_);
+        for(int k = 0; k < top_k; k++) {
+            int caseCounts[GENOTYPE_PAIRINGS];
+            BitGemm::countCaseTables(&nodes_[topPopcovers[k].index1], 1, &other.nodes_[topPopcovers[k].index2], 1, caseCounts);
+            insertPair(caseCounts, topPopcovers[k].index1, topPopcovers[k].index2);
+        }
+    }
+    topSnpList.incrementLeafTestsCounter(localLeaftTestsDone);
+}
+
+/*
+ * Pairs are picked as by caseOnlyTest, the trait covers taking the place of the popcovers, and every
+ * picked pair gets its 9 cell moments from one pass over the planes of both SNPs.
+ */
+void LDGroup::quantitativeTest(const LDGroup & other, const QuantitativeTrait & trait, TopSnpList & topSnpList, bool exhaustive)const
+{
+    long long int localLeaftTestsDone = 0;
+    int otherSize = other.size_;
+    
+    auto insertPair = [&](unsigned int i, unsigned int j)
+    {
+        TraitMoments moments;
+        trait.cellMoments(&nodes_[i], 1, &other.nodes_[j], 1, &moments);
+        topSnpList.attemptInsert(nodes_[i].getIndex(), other.nodes_[j].getIndex(), QuantitativeTrait::interactionScore(moments));
+        localLeaftTestsDone += 2;
+    };
+    
+    if(exhaustive)
+    {
+        for(unsigned int i = 0; i < size_; i++)
+            for(unsigned int j = 0; j < otherSize; j++)
+                if(!genomeLocations_[i].inLinkageDisequilibrium(other.genomeLocations_[j]))
+                    insertPair(i, j);
+    }
+    else
+    {
+        static thread_local vector<int> covers;
+        if(covers.size() < size_*otherSize)
+            covers.resize(size_*otherSize);
+        trait.traitCovers(nodes_, size_, other.nodes_, otherSize, covers.data());
+        
+        TopPopcovers topPopcovers;
+        rankPopcovers(other, covers.data(), topPopcovers);
+        
+        int top_k = std::min(std::min(POPCOVER_TOP_K, (int)(otherSize*size_)), topPopcovers.size_);
+        for(int k = 0; k < top_k; k++)
+            insertPair(topPopcovers[k].index1, topPopcovers[k].index2);
+    }
+    topSnpList.incrementLeafTestsCounter(localLeaftTestsDone);
+}
+
+/*
+ * The pairs are picked as by the tests above, then the genotype table of each is counted once and
+ * summed into the table of every model. The popcovers do not depend on the model.
+ */
+template<class Statistic>
+void LDGroup::modelsTest(const LDGroup & other, vector<TopSnpList> & topSnpLists, bool exhaustive)const
+{
+    long long int localLeaftTestsDone = 0;
+    int otherSize = other.size_;
+    
+    //Scores one counted genotype table under every model
+    auto insertPair = [&](const int * pairCounts, unsigned int i, unsigned int j)
+    {
+        int modelCounts[TABLE_CELLS];
+        collapseCounts<DominantModel, 2>(pairCounts, modelCounts);
+        float dominant = scoreModelCounts<Statistic, DominantModel, 2>(modelCounts);
+        collapseCounts<RecessiveModel, 2>(pairCounts, modelCounts);
+        float recessive = scoreModelCounts<Statistic, RecessiveModel, 2>(modelCounts);
+        
+        int indexI = nodes_[i].getIndex();
+        int indexJ = other.nodes_[j].getIndex();
+        topSnpLists[GENOTYPIC_MODEL].attemptInsert(indexI, indexJ, scoreModelCounts<Statistic, GenotypicModel, 2>(pairCounts));
+        topSnpLists[DOMINANT_MODEL].attemptInsert(indexI, indexJ, dominant);
+        topSnpLists[RECESSIVE_MODEL].attemptInsert(indexI, indexJ, recessive);
+        topSnpLists[ADDITIVE_MODEL].attemptInsert(indexI, indexJ, scoreModelCounts<Statistic, AdditiveModel, 2>(pairCounts));
+        localLeaftTestsDone += 2;
+    };
     
+    static thread_local vector<int> counts;
+    if(exhaustive)
+    {
+        if(counts.size() < size_*otherSize*TABLE_CELLS)
+            counts.resize(size_*otherSize*TABLE_CELLS);
+        BitGemm::countTables(nodes_, size_, other.nodes_, otherSize, counts.data());
+        for(unsigned int i = 0; i < size_; i++)
+            for(unsigned int j = 0; j < otherSize; j++)
+                if(!genomeLocations_[i].inLinkageDisequilibrium(other.genomeLocations_[j]))
+                    insertPair(counts.data() + (i*otherSize+j)*TABLE_CELLS, i, j);
+    }
+    else
+    {
+        static thread_local vector<int> popCovers;
+        if(popCovers.size() < size_*otherSize)
+            popCovers.resize(size_*otherSize);
+        BitGemm::popCovers(nodes_, size_, other.nodes_, otherSize, popCovers.data());
+        
+        TopPopcovers topPopcovers;
+        rankPopcovers(other, popCovers.data(), topPopcovers);
+        
+        int top_k = std::min(std::min(POPCOVER_TOP_K, (int)(otherSize*size_)), topPopcovers.size_);
+        for(int k = 0; k < top_k; k++) {
+            int pairCounts[TABLE_CELLS];
+            BitGemm::countTables(&nodes_[topPopcovers[k].index1], 1, &other.nodes_[topPopcovers[k].index2], 1, pairCounts);
+            insertPair(pairCounts, topPopcovers[k].index1, topPopcovers[k].index2);
+        }
+    }
+    for(int m=0; m<NUMBER_MODELS; ++m)
+        topSnpLists[m].incrementLeafTestsCounter(localLeaftTestsDone);
 }
 
+//Position of a pair in the top popcovers of one phenotype
+struct RankedPair
+{
+    unsigned int index1;
+    unsigned int index2;
+    int phenotype;
+    int rank;
+    bool operator<(const RankedPair & rhs)const {
+        return index1 == rhs.index1 ? index2 < rhs.index2 : index1 < rhs.index1;
+    }
+};
+
+template<class Statistic, class Sink>
+void LDGroup::phenotypeTest(const LDGroup & other, const PhenotypeSet & phenotypes, Sink & sink, bool exhaustive)const
+{
+    int numberPhenotypes = phenotypes.size();
+    //Without per Snp bit sets every phenotype applies to every pair
+    uint64_t allPhenotypes = numberPhenotypes == MAX_PHENOTYPES ? ~(uint64_t)0 : ((uint64_t)1<<numberPhenotypes)-1;
+    static thread_local vector<int> counts;
+    static thread_local vector<long long int> localLeafTestsDone;
+    if(counts.size() < numberPhenotypes*TABLE_CELLS)
+        counts.resize(numberPhenotypes*TABLE_CELLS);
+    localLeafTestsDone.assign(numberPhenotypes, 0);
+    
+    //Scores the counted pair for the phenotypes in the bit set
+    auto insertPair = [&](const int * pairCounts, unsigned int i, unsigned int j, uint64_t shared)
+    {
+        for(; shared != 0; shared &= shared-1)
+        {
+            int p = __builtin_ctzll(shared);
+            ContingencyTable t;
+            t.M_.fill(0);
+            //PLUS ONE FOR CORRECTION
+            for(int k=0; k<TABLE_CELLS; ++k)
+                t.M_[k] = pairCounts[p*TABLE_CELLS+k]+1;
+            sink.insert(p, nodes_[i].getIndex(), other.nodes_[j].getIndex(), t.score<Statistic>());
+            localLeafTestsDone[p] += 2;
+        }
+    };
+    
+    if(exhaustive)
+    {
+        for(unsigned int i = 0; i < size_; i++) {
+            for(unsigned int j = 0; j < other.size_; j++) {
+                uint64_t shared = phenotypes_ != NULL ? phenotypes_[i] & other.phenotypes_[j] : allPhenotypes;
+                if(shared == 0 || genomeLocations_[i].inLinkageDisequilibrium(other.genomeLocations_[j]))
+                    continue;
+                phenotypes.countTables(nodes_[i], other.nodes_[j], shared, counts.data());
+                insertPair(counts.data(), i, j, shared);
+            }
+        }
+    }
+    else
+    {
+        static thread_local vector<TopPopcovers> topPopcovers;
+        static thread_local vector<int> popCovers;
+        topPopcovers.assign(numberPhenotypes, TopPopcovers());
+        if(popCovers.size() < size_*other.size_*numberPhenotypes)
+            popCovers.resize(size_*other.size_*numberPhenotypes);
+        phenotypes.popCovers(nodes_, size_, other.nodes_, other.size_, popCovers.data());
+        
+        bool checkLD = anyInLinkageDisequilibrium(other);
+        for(unsigned int i = 0; i < size_; i++) {
+            for(unsigned int j = 0; j < other.size_; j++) {
+                uint64_t shared = phenotypes_ != NULL ? phenotypes_[i] & other.phenotypes_[j] : allPhenotypes;
+                if(shared == 0 || (checkLD && genomeLocations_[i].inLinkageDisequilibrium(other.genomeLocations_[j])))
+                    continue;
+                const int * pairPopCovers = popCovers.data() + (i*other.size_+j)*numberPhenotypes;
+                bool weighted = nodes_[i].getWeight() && other.nodes_[j].getWeight();
+                for(; shared != 0; shared &= shared-1)
+                {
+                    int p = __builtin_ctzll(shared);
+                    int key = pairPopCovers[p] + (weighted ? phenotypes.getCaseNo(p) : 0);
+                    if(topPopcovers[p].accepts(key))
+                        topPopcovers[p].push(HeapData(key, i, j));
+                }
+            }
+        }
+        
+        //Count each pair picked by any phenotype once
+        static thread_local vector<RankedPair> ranked;
+        static thread_local vector<int> slots;
+        ranked.clear();
+        for(int p=0; p<numberPhenotypes; ++p)
+            for(int r=0; r<topPopcovers[p].size_; ++r)
+                ranked.push_back(RankedPair{topPopcovers[p][r].index1, topPopcovers[p][r].index2, p, r});
+        sort(ranked.begin(), ranked.end());
+        
+        slots.assign(numberPhenotypes*POPCOVER_TOP_K, 0);
+        if(counts.size() < ranked.size()*numberPhenotypes*TABLE_CELLS)
+            counts.resize(ranked.size()*numberPhenotypes*TABLE_CELLS);
+        int numberPairs = 0;
+        for(int begin=0, end=0; begin<ranked.size(); begin=end)
+        {
+            //Only the phenotypes that picked the pair are counted
+            uint64_t selected = 0;
+            for(end=begin; end<ranked.size() && !(ranked[begin] < ranked[end]); ++end)
+            {
+                selected |= (uint64_t)1<<ranked[end].phenotype;
+                slots[ranked[end].phenotype*POPCOVER_TOP_K + ranked[end].rank] = numberPairs;
+            }
+            phenotypes.countTables(nodes_[ranked[begin].index1], other.nodes_[ranked[begin].index2], selected,
+                                   counts.data() + (numberPairs++)*numberPhenotypes*TABLE_CELLS);
+        }
+        
+        //Then insert every phenotype's pairs in its popcover order
+        for(int p=0; p<numberPhenotypes; ++p)
+            for(int r=0; r<topPopcovers[p].size_; ++r)
+                insertPair(counts.data() + slots[p*POPCOVER_TOP_K + r]*numberPhenotypes*TABLE_CELLS,
+                           topPopcovers[p][r].index1, topPopcovers[p][r].index2, (uint64_t)1<<p);
+    }
+    
+    for(int p=0; p<numberPhenotypes; ++p)
+        sink.incrementLeafTestsCounter(p, localLeafTestsDone[p]);
+}
+
+#define INSTANTIATE_MODEL_TESTS(Statistic, Model) \
+    template void LDGroup::epistasisTest<Statistic, Model>(const LDGroup &, TopSnpList &, SeenPairFilter *, bool)const; \
+    template void LDGroup::exhaustiveTest<Statistic, Model>(const LDGroup &, TopSnpList &, SeenPairFilter *, bool)const; \
+    template float LDGroup::representativeTest<Statistic, Model>(const LDGroup &, TopSnpList &)const;
+#define INSTANTIATE_GROUP_TESTS(Statistic) \
+    INSTANTIATE_MODEL_TESTS(Statistic, GenotypicModel) \
+    INSTANTIATE_MODEL_TESTS(Statistic, DominantModel) \
+    INSTANTIATE_MODEL_TESTS(Statistic, RecessiveModel) \
+    INSTANTIATE_MODEL_TESTS(Statistic, AdditiveModel) \
+    template void LDGroup::modelsTest<Statistic>(const LDGroup &, vector<TopSnpList> &, bool)const; \
+    template void LDGroup::phenotypeTest<Statistic, TopSnpListSink>(const LDGroup &, const PhenotypeSet &, TopSnpListSink &, bool)const; \
+    template void LDGroup::phenotypeTest<Statistic, PermutationSink>(const LDGroup &, const PhenotypeSet &, PermutationSink &, bool)const;
+FOR_EACH_STATISTIC(INSTANTIATE_GROUP_TESTS)
+
+void LDGroup::summarize()
+{
+    maxGenotypeCounts_.fill(0);
+    maxUnknownCounts_.fill(0);
+    for(int n=0; n<size_; ++n)
+    {
+        SmallContingencyTable t = nodes_[n].computeGenotypeCounts();
+        t.calculateTotals();
+        for(int k=0; k<GENOTYPE_LEVELS*CONTINGENCY_COLUMNS; ++k)
+            maxGenotypeCounts_[k] = max(maxGenotypeCounts_[k], t.M_[k]);
+        maxUnknownCounts_[0] = max(maxUnknownCounts_[0], nodes_[n].getControlNo() - t.CT_[0]);
+        maxUnknownCounts_[1] = max(maxUnknownCounts_[1], nodes_[n].getCaseNo() - t.CT_[1]);
+    }
+    
+    chromosome_ = genomeLocations_[0].chromosome_;
+    minBasePair_ = genomeLocations_[0].basePair_;
+    maxBasePair_ = genomeLocations_[0].basePair_;
+    for(int n=1; n<size_; ++n)
+    {
+        if(genomeLocations_[n].chromosome_ != chromosome_)
+            chromosome_ = MIXED_CHROMOSOMES;
+        minBasePair_ = min(minBasePair_, genomeLocations_[n].basePair_);
+        maxBasePair_ = max(maxBasePair_, genomeLocations_[n].basePair_);
+    }
+}
+
+/*
+ * With C and D the corrected case and control totals, the two cells of genotype pairing k contribute
+ * (a_k*D - b_k*C)^2 / ((a_k+b_k)*C*D) <= max(a_k*D/C, b_k*C/D), and a_k, b_k can not exceed the smaller
+ * of the two SNPs' counts of their genotypes. C and D only shrink below their full values by samples
+ * missing in either SNP, and the whole statistic never exceeds C+D.
+ */
+float LDGroup::epistasisBound(const LDGroup & other)const
+{
+    int cases = nodes_[0].getCaseNo();
+    int controls = nodes_[0].getControlNo();
+    
+    float caseMax = cases + GENOTYPE_PAIRINGS;
+    float caseMin = max(0, cases - maxUnknownCounts_[1] - other.maxUnknownCounts_[1]) + GENOTYPE_PAIRINGS;
+    float controlMax = controls + GENOTYPE_PAIRINGS;
+    float controlMin = max(0, controls - maxUnknownCounts_[0] - other.maxUnknownCounts_[0]) + GENOTYPE_PAIRINGS;
+    
+    float retVal = 0.0;
+    for(int i=0; i<GENOTYPE_LEVELS; ++i)
+        for(int j=0; j<GENOTYPE_LEVELS; ++j)
+        {
+            float controlCell = min(maxGenotypeCounts_[i], other.maxGenotypeCounts_[j]) + 1;
+            float caseCell = min(maxGenotypeCounts_[i+GENOTYPE_LEVELS], other.maxGenotypeCounts_[j+GENOTYPE_LEVELS]) + 1;
+            retVal += max(caseCell*controlMax/caseMin, controlCell*caseMax/controlMin);
+        }
+    
+    return min(retVal, caseMax + controlMax);
+}
+
+float LDGroup::minimumTopScore(const TopSnpList & topSnpList)const
+{
+    float retVal = topSnpList.getTopScore(nodes_[0].getIndex());
+    for(int n=1; n<size_; ++n)
+        retVal = min(retVal, topSnpList.getTopScore(nodes_[n].getIndex()));
+    return retVal;
+}
+
+bool LDGroup::allInLinkageDisequilibrium(const LDGroup & other)const
+{
+    if(chromosome_ == MIXED_CHROMOSOMES || chromosome_ != other.chromosome_)
+        return false;
+    return max(maxBasePair_, other.maxBasePair_) - min(minBasePair_, other.minBasePair_) <= ESTIMATED_LD_RANGE;
+}
+
+bool LDGroup::anyInLinkageDisequilibrium(const LDGroup & other)const
+{
+    if(chromosome_ == MIXED_CHROMOSOMES || other.chromosome_ == MIXED_CHROMOSOMES)
+        return true;
+    if(chromosome_ != other.chromosome_)
+        return false;
+    return max(minBasePair_, other.minBasePair_) - min(maxBasePair_, other.maxBasePair_) <= ESTIMATED_LD_RANGE;
+}
@@ -2,7 +2,9 @@
  * @author Tyler Cowman
  * 
  * Class representing a single LD-Group. The SNP nodes are seperated from the genome locations 
- * to reduce the memory footprint when calculating contingecy tables.
+ * to reduce the memory footprint when calculating contingecy tables. A group is a range of the
+ * Snps and genome locations owned by the LDForest, which stores the members of a group next to
+ * each other.
  */
 
 #ifndef LDGROUP_H
@@ -10,6 +12,11 @@
 
 #include "Snp.h"
 #include "TopSnpList.h"
+#include "BitGemm.h"
+#include "PhenotypeSet.h"
+#include "PermutationTest.h"
+#include "QuantitativeTrait.h"
+#include "SeenPairFilter.h"
 
 #include <iostream>
 #include <vector>
@@ -18,16 +25,19 @@
 #include <queue>
 #include <utility>
 #include <functional>
-#include <boost/heap/binomial_heap.hpp>
-#include <queue>
+#include <array>
 #include <ctime>
 #include <cstdlib>
 
 #define ESTIMATED_LD_RANGE 1000000
+//Number of SNP pairs per group pair that are tested, chosen by highest popcover
+#define POPCOVER_TOP_K 10
+//Chromosome of a location or group spanning several chromosomes, a code SnpInfo never gives a SNP
+#define MIXED_CHROMOSOMES INT8_MIN
 
 struct GenomeLocation
 {
-    GenomeLocation(char chromosome, int basePair)
+    GenomeLocation(int8_t chromosome, int basePair)
     {
         chromosome_ = chromosome;
         basePair_ = basePair;
@@ -35,7 +45,7 @@ struct GenomeLocation
     
     GenomeLocation(const GenomeLocation & l1, const GenomeLocation & l2)
     {
-        chromosome_ = '!';
+        chromosome_ = MIXED_CHROMOSOMES;
         basePair_ = -1;
     }
     
@@ -50,7 +60,7 @@ struct GenomeLocation
             
     }
     
-    char chromosome_;
+    int8_t chromosome_;
     int basePair_;
 };
 
@@ -58,20 +68,63 @@ struct HeapData {
     int key; // pop cover
     unsigned int index1;
     unsigned int index2;
+    HeapData() : key(0), index1(0), index2(0) { }
     HeapData(int _key, unsigned int _index1, unsigned int _index2) : key(_key), index1(_index1), index2(_index2) { }
     bool operator<(HeapData const & rhs) const {
         return key == rhs.key ? index1 < rhs.index1 : key < rhs.key;
     }
 };
 
+//Bounded on-stack selection of the POPCOVER_TOP_K largest popcovers, kept sorted largest first
+struct TopPopcovers {
+    array<HeapData, POPCOVER_TOP_K> data_;
+    int size_;
+    
+    TopPopcovers() : size_(0) { }
+    
+    //Cheap rejection before building the candidate
+    bool accepts(int key) const {
+        return size_ < POPCOVER_TOP_K || key >= data_[POPCOVER_TOP_K-1].key;
+    }
+    
+    void push(const HeapData & d) {
+        if(size_ == POPCOVER_TOP_K && d < data_[size_-1])
+            return;
+        int pos = size_ < POPCOVER_TOP_K ? size_++ : size_-1;
+        while(pos > 0 && !(d < data_[pos-1])) {
+            data_[pos] = data_[pos-1];
+            --pos;
+        }
+        data_[pos] = d;
+    }
+    
+    const HeapData & operator[](int i) const {
+        return data_[i];
+    }
+};
+
+//Hands the scores of each phenotype to its own TopSnpList
+struct TopSnpListSink {
+    vector<TopSnpList> & topSnpLists_;
+    
+    void insert(int phenotype, int snpIndex1, int snpIndex2, float score) {
+        topSnpLists_[phenotype].attemptInsert(snpIndex1, snpIndex2, score);
+    }
+    
+    void incrementLeafTestsCounter(int phenotype, long long int testsDone) {
+        topSnpLists_[phenotype].incrementLeafTestsCounter(testsDone);
+    }
+};
+
 using namespace std;
 class LDGroup
 {
     public:
         
-        LDGroup(const Snp & snp, char chromosome, int basePair);
-        LDGroup(const LDGroup & cpy);
-        LDGroup(const LDGroup & t1, const LDGroup & t2);
+        //View of size consecutive Snps and their genome locations, which must outlive the group
+        LDGroup(const Snp * nodes, const GenomeLocation * genomeLocations, int size);
+        //Also views the bit set of phenotypes each Snp passed the filters for
+        LDGroup(const Snp * nodes, const GenomeLocation * genomeLocations, const uint64_t * phenotypes, int size);
     
         bool empty()const;
         int size()const;
@@ -80,16 +133,60 @@ class LDGroup
         
         int computeDifferences(const LDGroup & other)const;
         
-        void clear();
+        //The tests below score with a statistic of Statistics.h and are instantiated for each of them,
+        //the first two also for every genetic model of GeneticModel.h. Both mark the pairs they score in seenPairs
+        //and skip the ones already marked unless skipSeen is false
+        template<class Statistic, class Model>
+        void epistasisTest(const LDGroup & other, TopSnpList & topSnpList, SeenPairFilter * seenPairs = NULL, bool skipSeen = true)const;
+        //Tests every pair between the two groups instead of only the top popcovers
+        template<class Statistic, class Model>
+        void exhaustiveTest(const LDGroup & other, TopSnpList & topSnpList, SeenPairFilter * seenPairs = NULL, bool skipSeen = true)const;
+        //Score of the pair of roots standing for the two groups, counted as an internal test and not inserted
+        template<class Statistic, class Model>
+        float representativeTest(const LDGroup & other, TopSnpList & topSnpList)const;
+        //Either test above under every model at once, into topSnpLists[GeneticModelType]
+        template<class Statistic>
+        void modelsTest(const LDGroup & other, vector<TopSnpList> & topSnpLists, bool exhaustive)const;
+        //Either test above on the cases alone, scored by the case-only independence chi-square
+        void caseOnlyTest(const LDGroup & other, TopSnpList & topSnpList, bool exhaustive)const;
+        //Either test above on a quantitative trait, ranked by the trait covers and scored by the interaction analysis of variance
+        void quantitativeTest(const LDGroup & other, const QuantitativeTrait & trait, TopSnpList & topSnpList, bool exhaustive)const;
+        /*
+         * Either test above for every phenotype at once, the scores of phenotype p are handed to
+         * sink.insert(p, ...). A pair is only ranked and tested for the phenotypes both SNPs passed the
+         * filters for, and its tables for all of them come from one pass over its planes. Instantiated
+         * for TopSnpListSink and PermutationSink.
+         */
+        template<class Statistic, class Sink>
+        void phenotypeTest(const LDGroup & other, const PhenotypeSet & phenotypes, Sink & sink, bool exhaustive)const;
         
-        void epistasisTest(const LDGroup & other, TopSnpList & topSnpList)const;
+        //Caches the member maxima and genome span used by the bounds below, call once the members are final
+        void summarize();
+        //Upper bound on the Pearson chi-square of any member pair, from the members' genotype counts and the case/control totals
+        float epistasisBound(const LDGroup & other)const;
+        //Lowest current best score over the members
+        float minimumTopScore(const TopSnpList & topSnpList)const;
+        bool allInLinkageDisequilibrium(const LDGroup & other)const;
+        bool anyInLinkageDisequilibrium(const LDGroup & other)const;
 
         friend ostream& operator<< (ostream &out, const LDGroup & ldgroup);
-        typedef boost::heap::binomial_heap<HeapData> PopcoverQueue;
-        typedef PopcoverQueue::handle_type PopcoverHandle;
 
-        vector<Snp> nodes_;
-        vector<GenomeLocation> genomeLocations_;
+        //Highest popcovers over the member pairs, popCovers laid out as BitGemm::popCovers
+        void rankPopcovers(const LDGroup & other, const int * popCovers, TopPopcovers & topPopcovers)const;
+
+        const Snp * nodes_;
+        const GenomeLocation * genomeLocations_;
+        //NULL outside the multi-phenotype mode
+        const uint64_t * phenotypes_;
+        int size_;
+        
+        //Set by summarize, per genotype maximum counts over members laid out as SmallContingencyTable::M_
+        array<int, GENOTYPE_LEVELS*CONTINGENCY_COLUMNS> maxGenotypeCounts_;
+        array<int, CONTINGENCY_COLUMNS> maxUnknownCounts_;
+        //MIXED_CHROMOSOMES when the members span several chromosomes
+        int8_t chromosome_;
+        int minBasePair_;
+        int maxBasePair_;
 
 };
 #endif //LDGROUP_H
@@ -0,0 +1,71 @@
+#include "PermutationTest.h"
+
+PermutationTest::PermutationTest(int numberSamples, int numberCases, int numberPermutations, unsigned int seed) : maxima_(numberPermutations)
+{
+    for(int k=0; k<numberPermutations; ++k)
+        maxima_[k] = 0.0;
+
+    //Every permutation draws its cases as the first numberCases of a shuffled sample order
+    mt19937 generator(seed);
+    vector<int> samples(numberSamples);
+    for(int i=0; i<numberSamples; ++i)
+        samples[i] = i;
+
+    for(int k=0; k<numberPermutations; ++k)
+    {
+        if(k % MAX_PHENOTYPES == 0)
+            batches_.push_back(PhenotypeSet(numberSamples));
+        for(int i=numberSamples-1; i>0; --i)
+            swap(samples[i], samples[uniform_int_distribution<int>(0, i)(generator)]);
+        batches_.back().addPhenotype(vector<int>(samples.begin(), samples.begin() + numberCases));
+    }
+}
+
+int PermutationTest::size()const
+{
+    return maxima_.size();
+}
+
+int PermutationTest::getBatchNo()const
+{
+    return batches_.size();
+}
+
+const PhenotypeSet & PermutationTest::getBatch(int batch)const
+{
+    return batches_[batch];
+}
+
+void PermutationTest::insert(int permutation, float score)
+{
+    float current = maxima_[permutation].load(memory_order_relaxed);
+    while(score > current && !maxima_[permutation].compare_exchange_weak(current, score, memory_order_relaxed));
+}
+
+float PermutationTest::getThreshold(float alpha)const
+{
+    if(maxima_.empty())
+        return 0.0;
+
+    vector<float> sorted;
+    for(int k=0; k<maxima_.size(); ++k)
+        sorted.push_back(maxima_[k].load());
+    sort(sorted.begin(), sorted.end());
+
+    int index = (int)ceil((1.0 - alpha)*sorted.size()) - 1;
+    return sorted[max(0, min(index, (int)sorted.size()-1))];
+}
+
+double PermutationTest::getEmpiricalPValue(float score)const
+{
+    int reached = 0;
+    for(int k=0; k<maxima_.size(); ++k)
+        reached += maxima_[k].load() >= score;
+    return (reached + 1.0)/(maxima_.size() + 1.0);
+}
+
+void PermutationTest::printMaxima(ofstream & ofs)const
+{
+    for(int k=0; k<maxima_.size(); ++k)
+        ofs<<maxima_[k].load()<<endl;
+}
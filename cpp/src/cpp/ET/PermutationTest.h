@@ -0,0 +1,64 @@
+/**
+ * Permutation null of the whole pair search. The genotype planes are left as they are, each
+ * permutation is only a shuffled case mask over the samples packed in place. Up to MAX_PHENOTYPES
+ * permutations are the phenotypes of one PhenotypeSet, so every plane AND of a pair serves a whole
+ * batch of label masks. The largest score found under each permutation gives the genome-wide
+ * significance threshold and the empirical p-values of the reported pairs.
+ */
+
+#ifndef PERMUTATION_TEST_H
+#define PERMUTATION_TEST_H
+
+#include "PhenotypeSet.h"
+
+#include <vector>
+#include <atomic>
+#include <fstream>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+#define PERMUTATION_SEED 20200101
+#define PERMUTATION_ALPHA 0.05
+
+using namespace std;
+
+class PermutationTest
+{
+    public:
+        PermutationTest(int numberSamples, int numberCases, int numberPermutations, unsigned int seed);
+
+        int size()const;
+        int getBatchNo()const;
+        const PhenotypeSet & getBatch(int batch)const;
+
+        //Thread safe, keeps the largest score seen under the permutation
+        void insert(int permutation, float score);
+
+        //Score the largest score of only a fraction alpha of the permutations exceeds
+        float getThreshold(float alpha)const;
+        //Fraction of the permutations, counting the observed labels as one, whose largest score reaches score
+        double getEmpiricalPValue(float score)const;
+
+        void printMaxima(ofstream & ofs)const;
+
+    private:
+        vector<PhenotypeSet> batches_;
+        vector<atomic<float> > maxima_;
+};
+
+//Hands the scores of one batch to the PermutationTest, permutation offset_ + p for phenotype p
+struct PermutationSink
+{
+    PermutationTest & permutations_;
+    int offset_;
+
+    void insert(int phenotype, int snpIndex1, int snpIndex2, float score)
+    {
+        permutations_.insert(offset_ + phenotype, score);
+    }
+
+    void incrementLeafTestsCounter(int phenotype, long long int testsDone) { }
+};
+
+#endif //PERMUTATION_TEST_H
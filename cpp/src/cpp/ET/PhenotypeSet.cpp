@@ -0,0 +1,177 @@
+#include "PhenotypeSet.h"
+
+#include <stdexcept>
+
+/*
+ * Every sample is a case or a control of each phenotype, so a count over the controls is the count
+ * over all samples minus the one over the cases. Each AND is popcounted once in full and once per
+ * phenotype under its case mask. The kernels follow BitGemm, always inlined helpers instantiated for
+ * the default target and with the hardware popcount instruction, picked at runtime.
+ */
+
+PhenotypeSet::PhenotypeSet(int numberSamples)
+{
+    numberSamples_ = numberSamples;
+    words_ = (numberSamples + PACK_SIZE - 1)/PACK_SIZE;
+    numberPhenotypes_ = 0;
+}
+
+void PhenotypeSet::addPhenotype(const vector<int> & caseSamples)
+{
+    if(numberPhenotypes_ == MAX_PHENOTYPES)
+        throw length_error("Too many phenotypes");
+
+    vector<PACK_TYPE> caseMask(words_, 0);
+    for(int i=0; i<caseSamples.size(); ++i)
+        caseMask[caseSamples[i]/PACK_SIZE] |= (PACK_TYPE)1<<(caseSamples[i]%PACK_SIZE);
+
+    //Widen every sample word by the new phenotype's mask
+    vector<PACK_TYPE> masks;
+    masks.reserve(words_*(numberPhenotypes_+1));
+    for(int w=0; w<words_; ++w)
+    {
+        masks.insert(masks.end(), masks_.begin() + w*numberPhenotypes_, masks_.begin() + (w+1)*numberPhenotypes_);
+        masks.push_back(caseMask[w]);
+    }
+    masks_.swap(masks);
+
+    cases_.push_back(caseSamples.size());
+    controls_.push_back(numberSamples_ - caseSamples.size());
+    numberPhenotypes_++;
+}
+
+int PhenotypeSet::size()const
+{
+    return numberPhenotypes_;
+}
+
+int PhenotypeSet::getSampleNo()const
+{
+    return numberSamples_;
+}
+
+int PhenotypeSet::getCaseNo(int phenotype)const
+{
+    return cases_[phenotype];
+}
+
+int PhenotypeSet::getControlNo(int phenotype)const
+{
+    return controls_[phenotype];
+}
+
+const vector<PACK_TYPE> & PhenotypeSet::getMasks()const
+{
+    return masks_;
+}
+
+static inline __attribute__((always_inline)) void genotypeCountsHelper(const PACK_TYPE * planes, int words, const PACK_TYPE * masks,
+                                                                        int numberPhenotypes, SmallContingencyTable * tables)
+{
+    for(int p=0; p<numberPhenotypes; ++p)
+        tables[p].M_.fill(0);
+
+    for(int l=0; l<GENOTYPE_LEVELS; ++l)
+        for(int w=0; w<words; ++w)
+        {
+            PACK_TYPE x = planes[l*words + w];
+            if(x == 0)
+                continue;
+            const PACK_TYPE * wordMasks = masks + w*numberPhenotypes;
+            int total = POPCOUNT_FUNCTION(x);
+            for(int p=0; p<numberPhenotypes; ++p)
+            {
+                int cases = POPCOUNT_FUNCTION(x & wordMasks[p]);
+                tables[p].M_[l] += total - cases;
+                tables[p].M_[l+GENOTYPE_LEVELS] += cases;
+            }
+        }
+}
+
+static inline __attribute__((always_inline)) void countTablesHelper(const PACK_TYPE * pa, const PACK_TYPE * pb, int words, const PACK_TYPE * masks,
+                                                                     int numberPhenotypes, uint64_t selected, int * counts)
+{
+    int phenotypeList[MAX_PHENOTYPES];
+    int numberSelected = 0;
+    for(; selected != 0; selected &= selected-1)
+        phenotypeList[numberSelected++] = __builtin_ctzll(selected);
+
+    int totals[GENOTYPE_PAIRINGS] = {0};
+    int cases[MAX_PHENOTYPES*GENOTYPE_PAIRINGS];
+    fill(cases, cases + numberSelected*GENOTYPE_PAIRINGS, 0);
+    for(int w=0; w<words; ++w)
+    {
+        PACK_TYPE a[GENOTYPE_LEVELS] = {pa[w], pa[w+words], pa[w+2*words]};
+        PACK_TYPE b[GENOTYPE_LEVELS] = {pb[w], pb[w+words], pb[w+2*words]};
+        const PACK_TYPE * wordMasks = masks + w*numberPhenotypes;
+        for(int j=0; j<GENOTYPE_LEVELS; ++j)
+            for(int i=0; i<GENOTYPE_LEVELS; ++i)
+            {
+                //The AND shared by every phenotype
+                PACK_TYPE x = a[i] & b[j];
+                int cell = i + GENOTYPE_LEVELS*j;
+                totals[cell] += POPCOUNT_FUNCTION(x);
+                for(int k=0; k<numberSelected; ++k)
+                    cases[k*GENOTYPE_PAIRINGS + cell] += POPCOUNT_FUNCTION(x & wordMasks[phenotypeList[k]]);
+            }
+    }
+
+    for(int k=0; k<numberSelected; ++k)
+    {
+        int * table = counts + phenotypeList[k]*TABLE_CELLS;
+        for(int cell=0; cell<GENOTYPE_PAIRINGS; ++cell)
+        {
+            table[cell] = totals[cell] - cases[k*GENOTYPE_PAIRINGS + cell];
+            table[GENOTYPE_PAIRINGS + cell] = cases[k*GENOTYPE_PAIRINGS + cell];
+        }
+    }
+}
+
+static inline __attribute__((always_inline)) void popCoversHelper(const Snp * a, int na, const Snp * b, int nb, int words, const PACK_TYPE * masks,
+                                                                   int numberPhenotypes, int * popCovers)
+{
+    fill(popCovers, popCovers + na*nb*numberPhenotypes, 0);
+
+    for(int i=0; i<na; ++i)
+    {
+        const PACK_TYPE * pa = a[i].allSamples_ + words;
+        for(int j=0; j<nb; ++j)
+        {
+            const PACK_TYPE * pb = b[j].allSamples_ + words;
+            int * pairPopCovers = popCovers + (i*nb+j)*numberPhenotypes;
+            for(int w=0; w<words; ++w)
+            {
+                PACK_TYPE matches = BitGemm::minorMatches(pa, pb, w, words);
+                if(matches == 0)
+                    continue;
+                const PACK_TYPE * wordMasks = masks + w*numberPhenotypes;
+                //Cases minus controls is twice the cases minus the total
+                int total = POPCOUNT_FUNCTION(matches);
+                for(int p=0; p<numberPhenotypes; ++p)
+                    pairPopCovers[p] += 2*POPCOUNT_FUNCTION(matches & wordMasks[p]) - total;
+            }
+        }
+    }
+}
+
+BITGEMM_POPCNT_KERNELS(genotypeCounts, (const PACK_TYPE * planes, int words, const PACK_TYPE * masks, int numberPhenotypes, SmallContingencyTable * tables),
+                       (planes, words, masks, numberPhenotypes, tables))
+BITGEMM_POPCNT_KERNELS(countTables, (const PACK_TYPE * pa, const PACK_TYPE * pb, int words, const PACK_TYPE * masks, int numberPhenotypes, uint64_t selected, int * counts),
+                       (pa, pb, words, masks, numberPhenotypes, selected, counts))
+BITGEMM_POPCNT_KERNELS(popCovers, (const Snp * a, int na, const Snp * b, int nb, int words, const PACK_TYPE * masks, int numberPhenotypes, int * popCovers),
+                       (a, na, b, nb, words, masks, numberPhenotypes, popCovers))
+
+void PhenotypeSet::genotypeCounts(const Snp & snp, SmallContingencyTable * tables)const
+{
+    BITGEMM_POPCNT_CALL(genotypeCounts, (snp.allSamples_, words_, masks_.data(), numberPhenotypes_, tables));
+}
+
+void PhenotypeSet::countTables(const Snp & a, const Snp & b, uint64_t selected, int * counts)const
+{
+    BITGEMM_POPCNT_CALL(countTables, (a.allSamples_, b.allSamples_, words_, masks_.data(), numberPhenotypes_, selected, counts));
+}
+
+void PhenotypeSet::popCovers(const Snp * a, int na, const Snp * b, int nb, int * popCovers)const
+{
+    BITGEMM_POPCNT_CALL(popCovers, (a, na, b, nb, words_, masks_.data(), numberPhenotypes_, popCovers));
+}
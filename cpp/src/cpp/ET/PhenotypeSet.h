@@ -0,0 +1,69 @@
+/**
+ * Case/control splits of several phenotypes over the same samples. The genotypes are then packed
+ * once with every sample in its original position, in the control planes of the arena, and each
+ * phenotype is a case mask over those planes. A plane AND of a SNP pair is computed once and
+ * popcounted against the case and control mask of every phenotype, so testing P phenotypes costs
+ * the plane traffic of one.
+ *
+ * At most MAX_PHENOTYPES phenotypes, so the phenotypes a SNP passed the filters for fit one word.
+ */
+
+#ifndef PHENOTYPE_SET_H
+#define PHENOTYPE_SET_H
+
+#include "Snp.h"
+#include "BitGemm.h"
+
+#include <vector>
+#include <stdint.h>
+
+#define MAX_PHENOTYPES 64
+
+using namespace std;
+
+class PhenotypeSet
+{
+    public:
+        PhenotypeSet(int numberSamples);
+
+        //Samples not listed as cases are controls
+        void addPhenotype(const vector<int> & caseSamples);
+
+        int size()const;
+        int getSampleNo()const;
+        int getCaseNo(int phenotype)const;
+        int getControlNo(int phenotype)const;
+        //Word major, the case mask word of every phenotype for each sample word
+        const vector<PACK_TYPE> & getMasks()const;
+
+        /** @brief Uncorrected genotype counts of snp for every phenotype
+         *
+         *  @param tables One SmallContingencyTable per phenotype, controls 0 , 1 , 2 then cases 0 , 1 , 2
+         */
+        void genotypeCounts(const Snp & snp, SmallContingencyTable * tables)const;
+
+        /** @brief Raw cell counts of the pair for the phenotypes in the selected bit set
+         *
+         *  @param counts size()*TABLE_CELLS ints, phenotype p starts at p*TABLE_CELLS and is laid out
+         *  as ContingencyTable::M_ without the plus one correction, unselected phenotypes are not written
+         */
+        void countTables(const Snp & a, const Snp & b, uint64_t selected, int * counts)const;
+
+        /** @brief Popcovers of every pair of a[0..na) x b[0..nb) for every phenotype, same as
+         *  Snp::computePopCoverAnd on that phenotype's split
+         *
+         *  @param popCovers na*nb*size() ints, phenotype p of pair (i,j) at (i*nb+j)*size()+p
+         */
+        void popCovers(const Snp * a, int na, const Snp * b, int nb, int * popCovers)const;
+
+    private:
+        int numberSamples_;
+        int words_;
+        int numberPhenotypes_;
+        //Word major, the case mask word of every phenotype for each sample word
+        vector<PACK_TYPE> masks_;
+        vector<int> cases_;
+        vector<int> controls_;
+};
+
+#endif //PHENOTYPE_SET_H
@@ -0,0 +1,325 @@
+#include "QuantitativeTrait.h"
+
+/*
+ * The popcounts of a mask under every trait plane are added up per plane as ints over the words and
+ * only weighted by the powers of two once at the end. Of the 9 cells of a pair only the 4 where both
+ * SNPs carry the minor allele are counted, the others follow from the genotype moments of each SNP
+ * less these, with the samples one SNP misses taken off the other's moments, so most words pass
+ * 4 ANDs under the known and value planes. The kernels follow PhenotypeSet, always inlined helpers
+ * instantiated for the default target and with the hardware popcount instruction, picked at runtime.
+ */
+
+QuantitativeTrait::QuantitativeTrait(const vector<double> & values)
+{
+    numberSamples_ = values.size();
+    words_ = (numberSamples_ + PACK_SIZE - 1)/PACK_SIZE;
+    planes_.assign(words_*TRAIT_PLANES, 0);
+
+    double minimum = INFINITY;
+    double maximum = -INFINITY;
+    for(int i=0; i<numberSamples_; ++i)
+        if(!std::isnan(values[i]))
+        {
+            minimum = min(minimum, values[i]);
+            maximum = max(maximum, values[i]);
+        }
+    //A constant trait is all zeros
+    double scale = maximum > minimum ? ((1<<TRAIT_BITS) - 1)/(maximum - minimum) : 0.0;
+
+    numberKnown_ = 0;
+    double sum = 0.0;
+    for(int i=0; i<numberSamples_; ++i)
+    {
+        if(std::isnan(values[i]))
+            continue;
+        unsigned int value = lround((values[i] - minimum)*scale);
+        unsigned int square = value*value;
+        PACK_TYPE bit = (PACK_TYPE)1<<(i%PACK_SIZE);
+        PACK_TYPE * wordPlanes = planes_.data() + (i/PACK_SIZE)*TRAIT_PLANES;
+        wordPlanes[0] |= bit;
+        for(int k=0; k<TRAIT_BITS; ++k)
+            if((value>>k) & 1)
+                wordPlanes[1 + k] |= bit;
+        for(int k=0; k<SQUARE_BITS; ++k)
+            if((square>>k) & 1)
+                wordPlanes[1 + TRAIT_BITS + k] |= bit;
+        numberKnown_++;
+        sum += value;
+    }
+    mean_ = numberKnown_ > 0 ? sum/numberKnown_ : 0.0;
+}
+
+int QuantitativeTrait::getSampleNo()const
+{
+    return numberSamples_;
+}
+
+int QuantitativeTrait::getKnownNo()const
+{
+    return numberKnown_;
+}
+
+const vector<PACK_TYPE> & QuantitativeTrait::getPlanes()const
+{
+    return planes_;
+}
+
+//Adds the popcounts of x under the known mask and the first planes of the trait, all of them or the value planes
+template<int Planes>
+static inline __attribute__((always_inline)) void countPlanes(PACK_TYPE x, const PACK_TYPE * wordPlanes, int * planeCounts)
+{
+    x &= wordPlanes[0];
+    if(x == 0)
+        return;
+    planeCounts[0] += POPCOUNT_FUNCTION(x);
+    for(int k=1; k<Planes; ++k)
+        planeCounts[k] += POPCOUNT_FUNCTION(x & wordPlanes[k]);
+}
+
+#define VALUE_PLANES (1 + TRAIT_BITS)
+
+static inline __attribute__((always_inline)) void genotypeMomentsHelper(const PACK_TYPE * planes, int words, const PACK_TYPE * traitPlanes, int * planeCounts)
+{
+    fill(planeCounts, planeCounts + GENOTYPE_LEVELS*TRAIT_PLANES, 0);
+    for(int l=0; l<GENOTYPE_LEVELS; ++l)
+        for(int w=0; w<words; ++w)
+            countPlanes<TRAIT_PLANES>(planes[l*words + w], traitPlanes + w*TRAIT_PLANES, planeCounts + l*TRAIT_PLANES);
+}
+
+/*
+ * Plane counts of the pair cells of genotypes 1 and 2 of both SNPs, and of what the known samples one
+ * SNP misses take off the other's moments: its genotypes 1 and 2, and all its known genotypes with
+ * the squares as well. The missing words are mostly zero and skipped.
+ */
+static inline __attribute__((always_inline)) void cellMomentsHelper(const PACK_TYPE * pa, const PACK_TYPE * pb, int words, const PACK_TYPE * traitPlanes,
+                                                                     int * minorCounts, int * missingCounts, int * knownMissingCounts)
+{
+    fill(minorCounts, minorCounts + 4*VALUE_PLANES, 0);
+    fill(missingCounts, missingCounts + 4*VALUE_PLANES, 0);
+    fill(knownMissingCounts, knownMissingCounts + TRAIT_PLANES, 0);
+    for(int w=0; w<words; ++w)
+    {
+        const PACK_TYPE * wordPlanes = traitPlanes + w*TRAIT_PLANES;
+        PACK_TYPE a1 = pa[w+words];
+        PACK_TYPE a2 = pa[w+2*words];
+        PACK_TYPE b1 = pb[w+words];
+        PACK_TYPE b2 = pb[w+2*words];
+        countPlanes<VALUE_PLANES>(a1 & b1, wordPlanes, minorCounts);
+        countPlanes<VALUE_PLANES>(a2 & b1, wordPlanes, minorCounts + VALUE_PLANES);
+        countPlanes<VALUE_PLANES>(a1 & b2, wordPlanes, minorCounts + 2*VALUE_PLANES);
+        countPlanes<VALUE_PLANES>(a2 & b2, wordPlanes, minorCounts + 3*VALUE_PLANES);
+
+        PACK_TYPE knownA = pa[w] | a1 | a2;
+        PACK_TYPE knownB = pb[w] | b1 | b2;
+        PACK_TYPE missingA = wordPlanes[0] & ~knownA;
+        PACK_TYPE missingB = wordPlanes[0] & ~knownB;
+        if(missingB != 0)
+        {
+            countPlanes<VALUE_PLANES>(a1 & missingB, wordPlanes, missingCounts);
+            countPlanes<VALUE_PLANES>(a2 & missingB, wordPlanes, missingCounts + VALUE_PLANES);
+            countPlanes<TRAIT_PLANES>(knownA & missingB, wordPlanes, knownMissingCounts);
+        }
+        if(missingA != 0)
+        {
+            countPlanes<VALUE_PLANES>(b1 & missingA, wordPlanes, missingCounts + 2*VALUE_PLANES);
+            countPlanes<VALUE_PLANES>(b2 & missingA, wordPlanes, missingCounts + 3*VALUE_PLANES);
+        }
+    }
+}
+
+static inline __attribute__((always_inline)) void traitCoversHelper(const Snp * a, int na, const Snp * b, int nb, int words, const PACK_TYPE * traitPlanes,
+                                                                     double mean, int * covers)
+{
+    for(int i=0; i<na; ++i)
+    {
+        const PACK_TYPE * pa = a[i].allSamples_ + words;
+        for(int j=0; j<nb; ++j)
+        {
+            const PACK_TYPE * pb = b[j].allSamples_ + words;
+            int planeCounts[VALUE_PLANES] = {0};
+            for(int w=0; w<words; ++w)
+            {
+                PACK_TYPE matches = BitGemm::minorMatches(pa, pb, w, words);
+                if(matches != 0)
+                    countPlanes<VALUE_PLANES>(matches, traitPlanes + w*TRAIT_PLANES, planeCounts);
+            }
+            PlaneMoments moments = PlaneMoments::of<VALUE_PLANES>(planeCounts);
+            covers[i*nb + j] = lround(fabs(moments.sum_ - mean*moments.count_));
+        }
+    }
+}
+
+BITGEMM_POPCNT_KERNELS(genotypeMoments, (const PACK_TYPE * planes, int words, const PACK_TYPE * traitPlanes, int * planeCounts),
+                       (planes, words, traitPlanes, planeCounts))
+BITGEMM_POPCNT_KERNELS(cellMoments, (const PACK_TYPE * pa, const PACK_TYPE * pb, int words, const PACK_TYPE * traitPlanes,
+                                     int * minorCounts, int * missingCounts, int * knownMissingCounts),
+                       (pa, pb, words, traitPlanes, minorCounts, missingCounts, knownMissingCounts))
+BITGEMM_POPCNT_KERNELS(traitCovers, (const Snp * a, int na, const Snp * b, int nb, int words, const PACK_TYPE * traitPlanes, double mean, int * covers),
+                       (a, na, b, nb, words, traitPlanes, mean, covers))
+
+//Moments of the three genotypes of a SNP over the known trait, then of all its known genotypes
+static void levelMoments(const Snp & snp, int words, const PACK_TYPE * traitPlanes, SnpMoments & levels)
+{
+    int planeCounts[GENOTYPE_LEVELS*TRAIT_PLANES];
+    BITGEMM_POPCNT_CALL(genotypeMoments, (snp.allSamples_, words, traitPlanes, planeCounts));
+    for(int l=0; l<GENOTYPE_LEVELS; ++l)
+        levels[l] = PlaneMoments::of<TRAIT_PLANES>(planeCounts + l*TRAIT_PLANES);
+    levels[GENOTYPE_LEVELS] = levels[0] + levels[1] + levels[2];
+}
+
+void QuantitativeTrait::summarize(const vector<Snp> & snps, int maxThreadUsage)
+{
+    int size = 0;
+    for(int k=0; k<snps.size(); ++k)
+        size = max(size, snps[k].getIndex() + 1);
+    snpMoments_.resize(size);
+    #pragma omp parallel for num_threads(maxThreadUsage) schedule(dynamic, 64)
+    for(int k=0; k<snps.size(); ++k)
+        levelMoments(snps[k], words_, planes_.data(), snpMoments_[snps[k].getIndex()]);
+}
+
+void QuantitativeTrait::genotypeMoments(const Snp & snp, TraitMoments & moments)const
+{
+    SnpMoments levels;
+    levelMoments(snp, words_, planes_.data(), levels);
+    moments.squares_ = 0.0;
+    for(int c=0; c<GENOTYPE_PAIRINGS; ++c)
+    {
+        moments.counts_[c] = c < GENOTYPE_LEVELS ? levels[c].count_ : 0;
+        moments.sums_[c] = c < GENOTYPE_LEVELS ? levels[c].sum_ : 0.0;
+        moments.squares_ += c < GENOTYPE_LEVELS ? levels[c].squares_ : 0.0;
+    }
+}
+
+void QuantitativeTrait::cellMoments(const Snp * a, int na, const Snp * b, int nb, TraitMoments * moments)const
+{
+    //Genotype moments of every SNP once for all its pairs, unless summarize cached them
+    static thread_local vector<SnpMoments> counted;
+    if(snpMoments_.empty())
+    {
+        counted.resize(na+nb);
+        for(int k=0; k<na+nb; ++k)
+            levelMoments(k < na ? a[k] : b[k-na], words_, planes_.data(), counted[k]);
+    }
+
+    for(int i=0; i<na; ++i)
+        for(int j=0; j<nb; ++j)
+        {
+            const SnpMoments & levelsA = snpMoments_.empty() ? counted[i] : snpMoments_[a[i].getIndex()];
+            const SnpMoments & levelsB = snpMoments_.empty() ? counted[na+j] : snpMoments_[b[j].getIndex()];
+            int minorCounts[4*VALUE_PLANES];
+            int missingCounts[4*VALUE_PLANES];
+            int knownMissingCounts[TRAIT_PLANES];
+            BITGEMM_POPCNT_CALL(cellMoments, (a[i].allSamples_, b[j].allSamples_, words_, planes_.data(), minorCounts, missingCounts, knownMissingCounts));
+
+            //Cell i + 3*j of the pair, the missing of the other SNP taken off the rows, columns and total
+            PlaneMoments cells[GENOTYPE_PAIRINGS];
+            for(int k=0; k<4; ++k)
+                cells[(1 + k%2) + GENOTYPE_LEVELS*(1 + k/2)] = PlaneMoments::of<VALUE_PLANES>(minorCounts + k*VALUE_PLANES);
+            PlaneMoments total = levelsA[GENOTYPE_LEVELS] - PlaneMoments::of<TRAIT_PLANES>(knownMissingCounts);
+            cells[0] = total;
+            for(int l=1; l<GENOTYPE_LEVELS; ++l)
+            {
+                PlaneMoments row = levelsA[l] - PlaneMoments::of<VALUE_PLANES>(missingCounts + (l-1)*VALUE_PLANES);
+                PlaneMoments column = levelsB[l] - PlaneMoments::of<VALUE_PLANES>(missingCounts + (l+1)*VALUE_PLANES);
+                cells[l] = row - cells[l + GENOTYPE_LEVELS] - cells[l + 2*GENOTYPE_LEVELS];
+                cells[GENOTYPE_LEVELS*l] = column - cells[1 + GENOTYPE_LEVELS*l] - cells[2 + GENOTYPE_LEVELS*l];
+            }
+            for(int c=1; c<GENOTYPE_PAIRINGS; ++c)
+                cells[0] = cells[0] - cells[c];
+
+            TraitMoments & pairMoments = moments[i*nb + j];
+            for(int c=0; c<GENOTYPE_PAIRINGS; ++c)
+            {
+                pairMoments.counts_[c] = cells[c].count_;
+                pairMoments.sums_[c] = cells[c].sum_;
+            }
+            pairMoments.squares_ = total.squares_;
+        }
+}
+
+void QuantitativeTrait::traitCovers(const Snp * a, int na, const Snp * b, int nb, int * covers)const
+{
+    BITGEMM_POPCNT_CALL(traitCovers, (a, na, b, nb, words_, planes_.data(), mean_, covers));
+}
+
+/*
+ * Sums over the nonempty cells of the samples, the trait and the squared sum over the count of every
+ * cell, whose excess over sum^2/samples is the sum of squares the cell means explain.
+ */
+static int cellSums(const TraitMoments & moments, int cells, double & samples, double & sum, double & explained)
+{
+    int retVal = 0;
+    samples = sum = explained = 0.0;
+    for(int c=0; c<cells; ++c)
+    {
+        if(moments.counts_[c] == 0)
+            continue;
+        samples += moments.counts_[c];
+        sum += moments.sums_[c];
+        explained += moments.sums_[c]*moments.sums_[c]/moments.counts_[c];
+        retVal++;
+    }
+    return retVal;
+}
+
+float QuantitativeTrait::marginalScore(const TraitMoments & moments)
+{
+    double samples, sum, explained;
+    int filled = cellSums(moments, GENOTYPE_LEVELS, samples, sum, explained);
+    double within = moments.squares_ - explained;
+    if(filled < 2 || samples <= filled || within <= 0.0)
+        return 0.0;
+    return (explained - sum*sum/samples)/(within/(samples - filled));
+}
+
+float QuantitativeTrait::interactionScore(const TraitMoments & moments)
+{
+    double samples, sum, explained;
+    int filled = cellSums(moments, GENOTYPE_PAIRINGS, samples, sum, explained);
+    double within = moments.squares_ - explained;
+    if(samples <= filled || within <= 0.0)
+        return 0.0;
+
+    //Normal equations of the intercept and the indicators of genotypes 1 and 2 of either SNP
+    const int parameters = 1 + 2*(GENOTYPE_LEVELS-1);
+    double normal[parameters][parameters+1] = {{0.0}};
+    for(int j=0; j<GENOTYPE_LEVELS; ++j)
+        for(int i=0; i<GENOTYPE_LEVELS; ++i)
+        {
+            int cell = i + GENOTYPE_LEVELS*j;
+            double x[parameters] = {1.0, (double)(i == 1), (double)(i == 2), (double)(j == 1), (double)(j == 2)};
+            for(int p=0; p<parameters; ++p)
+            {
+                for(int q=0; q<parameters; ++q)
+                    normal[p][q] += moments.counts_[cell]*x[p]*x[q];
+                normal[p][parameters] += moments.sums_[cell]*x[p];
+            }
+        }
+
+    /*
+     * Gaussian elimination, the indicators of a missing genotype have no pivot left and drop out. The
+     * sum of squares of the fit is y'X(X'X)^-1X'y, the sum of every eliminated right-hand side squared
+     * over its pivot, so the coefficients themselves are never solved for.
+     */
+    int rank = 0;
+    double fitted = 0.0;
+    for(int p=0; p<parameters; ++p)
+    {
+        if(normal[p][p] <= 1e-9*samples)
+            continue;
+        rank++;
+        fitted += normal[p][parameters]*normal[p][parameters]/normal[p][p];
+        for(int r=p+1; r<parameters; ++r)
+        {
+            double factor = normal[r][p]/normal[p][p];
+            for(int q=p; q<=parameters; ++q)
+                normal[r][q] -= factor*normal[p][q];
+        }
+    }
+
+    int degreesFreedom = filled - rank;
+    if(degreesFreedom <= 0)
+        return 0.0;
+    return max(0.0, explained - fitted)/(within/(samples - filled));
+}
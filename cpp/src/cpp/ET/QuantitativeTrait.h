@@ -0,0 +1,123 @@
+/**
+ * Continuous phenotype tested for interaction across the 9 genotype cells of a SNP pair. The trait
+ * is rounded to TRAIT_BITS bit fixed-point values over its range and stored bit-sliced over the
+ * samples packed in place, one plane per bit of the value and one per bit of its square, so the sum
+ * of the trait over the samples of a genotype cell is sum(2^k * popcount(cell & plane k)). Every
+ * cell count and sum of a pair, and the sum of squares, come from AND-popcounts of the genotype
+ * planes, with no pass over the samples themselves.
+ */
+
+#ifndef QUANTITATIVE_TRAIT_H
+#define QUANTITATIVE_TRAIT_H
+
+#include "Snp.h"
+#include "BitGemm.h"
+
+#include <vector>
+#include <array>
+#include <cmath>
+#include <omp.h>
+
+#define TRAIT_BITS 8
+#define SQUARE_BITS (2*TRAIT_BITS)
+//The samples with a known trait, then the value and square bits
+#define TRAIT_PLANES (1 + TRAIT_BITS + SQUARE_BITS)
+
+using namespace std;
+
+//Samples and fixed-point trait sum of every genotype cell, cell i + 3*j of a pair
+struct TraitMoments
+{
+    int counts_[GENOTYPE_PAIRINGS];
+    double sums_[GENOTYPE_PAIRINGS];
+    //Over all the cells, the within-cell sum of squares only needs the pooled one
+    double squares_;
+};
+
+//Count, fixed-point sum and sum of squares of a set of samples, from its popcounts under the first Planes trait planes
+struct PlaneMoments
+{
+    double count_;
+    double sum_;
+    double squares_;
+
+    template<int Planes>
+    static PlaneMoments of(const int * planeCounts)
+    {
+        PlaneMoments retVal = {(double)planeCounts[0], 0.0, 0.0};
+        for(int k=0; k<TRAIT_BITS && 1+k<Planes; ++k)
+            retVal.sum_ += ldexp((double)planeCounts[1 + k], k);
+        for(int k=0; k<SQUARE_BITS && 1+TRAIT_BITS+k<Planes; ++k)
+            retVal.squares_ += ldexp((double)planeCounts[1 + TRAIT_BITS + k], k);
+        return retVal;
+    }
+
+    PlaneMoments operator+(const PlaneMoments & other)const
+    {
+        PlaneMoments retVal = {count_ + other.count_, sum_ + other.sum_, squares_ + other.squares_};
+        return retVal;
+    }
+
+    PlaneMoments operator-(const PlaneMoments & other)const
+    {
+        PlaneMoments retVal = {count_ - other.count_, sum_ - other.sum_, squares_ - other.squares_};
+        return retVal;
+    }
+};
+
+//Moments of the three genotypes of a SNP, then of all its known genotypes
+typedef array<PlaneMoments, GENOTYPE_LEVELS+1> SnpMoments;
+
+class QuantitativeTrait
+{
+    public:
+        //One value per sample, NaN for an unknown trait
+        QuantitativeTrait(const vector<double> & values);
+
+        int getSampleNo()const;
+        int getKnownNo()const;
+        //Word major, the TRAIT_PLANES planes of every sample word
+        const vector<PACK_TYPE> & getPlanes()const;
+
+        //Caches the genotype moments of the Snps by index for cellMoments, which otherwise counts them for every call
+        void summarize(const vector<Snp> & snps, int maxThreadUsage);
+
+        //Moments of the three genotype cells of snp, in the first three cells
+        void genotypeMoments(const Snp & snp, TraitMoments & moments)const;
+        //Moments of every pair of a[0..na) x b[0..nb), pair (i,j) at i*nb+j
+        void cellMoments(const Snp * a, int na, const Snp * b, int nb, TraitMoments * moments)const;
+
+        /** @brief Trait covers of every pair of a[0..na) x b[0..nb), the popcover of a continuous trait
+         *
+         *  The absolute sum of the centered fixed-point trait over the samples matching on the
+         *  heterozygous or homozygous minor genotype, laid out as BitGemm::popCovers
+         */
+        void traitCovers(const Snp * a, int na, const Snp * b, int nb, int * covers)const;
+
+        /*
+         * One-way analysis of variance of the trait over the first cells of the moments, the
+         * between-cell sum of squares over the within-cell mean square, chi-square distributed with
+         * one degree of freedom less than the nonempty cells. The marginal filter of a SNP.
+         */
+        static float marginalScore(const TraitMoments & moments);
+        /*
+         * Interaction of a pair. The additive model of the two SNPs' main effects is fitted by least
+         * squares from the cell counts and sums, and the sum of squares the 9 cell means explain beyond
+         * it is scored over the within-cell mean square, chi-square distributed with the degrees of
+         * freedom of the interaction, 4 when every cell is filled.
+         */
+        static float interactionScore(const TraitMoments & moments);
+
+    private:
+        int numberSamples_;
+        int numberKnown_;
+        int words_;
+        //Fixed-point mean of the known samples, centering the trait covers
+        double mean_;
+        //Word major, the TRAIT_PLANES planes of every sample word
+        vector<PACK_TYPE> planes_;
+        //Indexed by Snp index, empty until summarize
+        vector<SnpMoments> snpMoments_;
+};
+
+#endif //QUANTITATIVE_TRAIT_H
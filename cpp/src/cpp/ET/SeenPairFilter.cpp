@@ -0,0 +1,58 @@
+#include "SeenPairFilter.h"
+
+#include <iostream>
+
+//Power of two words, so the word of a pair is the low bits of its hash
+SeenPairFilter::SeenPairFilter(long long int expectedPairs)
+    : seenPairs_(0)
+{
+    long long int words = 1;
+    while(words < SEEN_PAIR_MAX_WORDS && words*64 < expectedPairs*SEEN_PAIR_BITS_PER_PAIR)
+        words *= 2;
+    words_ = vector<atomic<uint64_t> >(words);
+    for(long long int w=0; w<words; ++w)
+        words_[w].store(0, memory_order_relaxed);
+    wordMask_ = words-1;
+    if(words*64 < expectedPairs*SEEN_PAIR_BITS_PER_PAIR)
+        cout<<"\tWarning: the seen pair filter has "<<(double)words*64/expectedPairs<<" bits for each of "<<expectedPairs
+            <<" pairs, more pairs never scored will be skipped"<<endl;
+}
+
+atomic<uint64_t> & SeenPairFilter::pairWord(int snpIndex1, int snpIndex2, uint64_t & bits)
+{
+    uint64_t key = snpIndex1 < snpIndex2 ? ((uint64_t)snpIndex1<<32) | (uint32_t)snpIndex2 : ((uint64_t)snpIndex2<<32) | (uint32_t)snpIndex1;
+    //splitmix64 finalizer
+    key += 0x9E3779B97F4A7C15ULL;
+    key = (key ^ (key>>30))*0xBF58476D1CE4E5B9ULL;
+    key = (key ^ (key>>27))*0x94D049BB133111EBULL;
+    key ^= key>>31;
+
+    //The word from the low bits, the bits within it from 6 bit fields of the high ones
+    bits = 0;
+    for(int h=0; h<SEEN_PAIR_HASHES; ++h)
+        bits |= (uint64_t)1<<((key>>(40 + 6*h)) & 63);
+    return words_[key & wordMask_];
+}
+
+bool SeenPairFilter::testAndSet(int snpIndex1, int snpIndex2)
+{
+    uint64_t bits;
+    atomic<uint64_t> & word = pairWord(snpIndex1, snpIndex2, bits);
+    bool retVal = (word.load(memory_order_relaxed) & bits) == bits || (word.fetch_or(bits, memory_order_relaxed) & bits) == bits;
+    if(retVal)
+        seenPairs_.fetch_add(1, memory_order_relaxed);
+    return retVal;
+}
+
+void SeenPairFilter::set(int snpIndex1, int snpIndex2)
+{
+    uint64_t bits;
+    atomic<uint64_t> & word = pairWord(snpIndex1, snpIndex2, bits);
+    if((word.load(memory_order_relaxed) & bits) != bits)
+        word.fetch_or(bits, memory_order_relaxed);
+}
+
+long long int SeenPairFilter::getSeenPairs()const
+{
+    return seenPairs_;
+}
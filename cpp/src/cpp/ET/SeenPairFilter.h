@@ -0,0 +1,45 @@
+/**
+ * Concurrent record of the SNP pairs already scored, so a pair met again in another grouping of the
+ * same SNPs is skipped. It is a blocked Bloom filter: a pair hashes to one 64 bit word and sets
+ * SEEN_PAIR_HASHES bits of it with a single fetch_or, and it was seen when they were all set before.
+ * With at least SEEN_PAIR_BITS_PER_PAIR bits per expected pair under 0.5% of the pairs never scored
+ * are taken as seen, while no pair is ever scored twice. The first grouping only marks its pairs, so
+ * those false positives never drop a pair a single grouping would score. Past SEEN_PAIR_MAX_WORDS the
+ * filter warns that it has fewer bits per pair.
+ */
+
+#ifndef SEEN_PAIR_FILTER_H
+#define SEEN_PAIR_FILTER_H
+
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+
+#define SEEN_PAIR_BITS_PER_PAIR 16
+#define SEEN_PAIR_HASHES 4
+//128MB, beyond it the false positives grow instead
+#define SEEN_PAIR_MAX_WORDS (1<<24)
+
+using namespace std;
+
+class SeenPairFilter
+{
+    public:
+        SeenPairFilter(long long int expectedPairs);
+
+        //Marks the pair in either order, true when it was already marked
+        bool testAndSet(int snpIndex1, int snpIndex2);
+        //Marks the pair in either order without testing it
+        void set(int snpIndex1, int snpIndex2);
+        long long int getSeenPairs()const;
+
+    private:
+        //Word of the pair and the bits it sets in it
+        atomic<uint64_t> & pairWord(int snpIndex1, int snpIndex2, uint64_t & bits);
+
+        vector<atomic<uint64_t> > words_;
+        uint64_t wordMask_;
+        atomic<long long int> seenPairs_;
+};
+
+#endif //SEEN_PAIR_FILTER_H
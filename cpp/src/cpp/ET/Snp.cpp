@@ -1,4 +1,5 @@
 #include "Snp.h"
+#include "GenotypePacker.h"
 
 //Define static members, will be set correctly in the Snp constructors
 int Snp::numControls_;
@@ -9,23 +10,34 @@ int Snp::CASS_;
 
 Snp::Snp(int index, const vector<char> & controls, const vector<char> & cases, int weight)
 {
-    packGenotypes(allSamples_, controls, cases);
+    arena_ = make_shared<GenotypeArena>(1, controls.size(), cases.size());
+    allSamples_ = arena_->getPlanes(0);
+    setLayout(*arena_);
     
     index_ = index;
     weight_ = weight;
     
-    numControls_ = controls.size();
-    numCases_ = cases.size();
-    CONR_ = ceil(numControls_/(double)PACK_SIZE);
-    CASR_ = ceil(numCases_/(double)PACK_SIZE);
-    CASS_ = (GENOTYPE_LEVELS*CONR_) ;//+ 1;
+    GenotypePacker::packBytes((const uint8_t*)controls.data(), controls.size(), '0', allSamples_, CONR_);
+    GenotypePacker::packBytes((const uint8_t*)cases.data(), cases.size(), '0', allSamples_ + CASS_, CASR_);
 }
 
-Snp::Snp(const Snp & cpy)
+Snp::Snp(int index, const shared_ptr<GenotypeArena> & arena, int slot, int weight)
 {
-    index_ = cpy.index_;
-    weight_ = cpy.weight_;
-    allSamples_ = cpy.allSamples_;
+    arena_ = arena;
+    allSamples_ = arena_->getPlanes(slot);
+    setLayout(*arena_);
+    
+    index_ = index;
+    weight_ = weight;
+}
+
+void Snp::setLayout(const GenotypeArena & arena)
+{
+    numControls_ = arena.getControlNo();
+    numCases_ = arena.getCaseNo();
+    CONR_ = arena.getControlWords();
+    CASR_ = arena.getCaseWords();
+    CASS_ = arena.getCaseStart();
 }
 
 int Snp::getIndex()const
@@ -43,6 +55,26 @@ int Snp::getWeight()const
     return weight_;
 }
 
+int Snp::getControlNo()const
+{
+    return numControls_;
+}
+
+const shared_ptr<GenotypeArena> & Snp::getArena()const
+{
+    return arena_;
+}
+
+int Snp::getSlot()const
+{
+    return arena_->getSlot(allSamples_);
+}
+
+const SparseSegment * Snp::getSparseSegments()const
+{
+    return arena_->getSegments(getSlot());
+}
+
 int Snp::computePopCoverAnd(const Snp & other)const
 {
     int hetero = popCountAnd(allSamples_, other.allSamples_, CASS_+CASR_, CASR_)- popCountAnd(allSamples_, other.allSamples_, CONR_, CONR_) ; 
@@ -62,19 +94,18 @@ float Snp::computeMinorAlleleFrequency()const
 
 int Snp::computeDifferences(const Snp & other)const
 {
-    return ((numControls_ + numCases_)- popCountAnd(allSamples_, other.allSamples_, 0, allSamples_.size()));
+    return ((numControls_ + numCases_)- popCountAnd(allSamples_, other.allSamples_, 0, getPlaneWords()));
 }
 
 float Snp::computeUnknownRatio()const
 {
-    int numberKnown = popCount(allSamples_, 0, allSamples_.size());
+    int numberKnown = popCount(allSamples_, 0, getPlaneWords());
 
     return ( numberKnown/(float)(numControls_ + numCases_) );
 }
 
-float Snp::marginalTest()const
+SmallContingencyTable Snp::computeGenotypeCounts()const
 {
-    float retVal=0.0;
     SmallContingencyTable t;
     t.M_.fill(0);
     for(int i=0; i<GENOTYPE_LEVELS; ++i)
@@ -82,39 +113,21 @@ float Snp::marginalTest()const
         t.M_[i] = popCount(allSamples_, i*CONR_, CONR_);
         t.M_[i+GENOTYPE_LEVELS] = popCount(allSamples_, CASS_ + (i*CASR_), CASR_);
     }
-       
-    t.addOne(); //For correction    
-    t.calculateTotals();
-        
-		
-    int factors = GENOTYPE_LEVELS;
-    int levels = 2;
-    
-    for(int y=0; y< factors; ++y)
-    {
-
-        for(int x=0; x< levels; ++x)
-        {            
-            //Use margin values
-            float c1 = (float)t.RT_[y];
-            float c2 = (float)t.CT_[x];
-            float c3 = (float)(t.CT_[0] + t.CT_[1]);          
-            
-            float c4 = (float)t.a(y,x);
-
-            float expected  = ( c1 * c2 ) / c3 ;
-
-            retVal = retVal +  (pow(c4-expected,2)/expected);
+    return t;
+}
 
-        }
-    }
-    return retVal;
+template<class Statistic>
+float Snp::marginalTest()const
+{
+    SmallContingencyTable t = computeGenotypeCounts();
+    t.addOne(); //For correction
+    
+    return t.score<Statistic>();
 }
 
+template<class Statistic>
 float Snp::epistasisTest(const Snp & other)const
 {
-    float retVal=0.0;
-
     ContingencyTable t;
     t.M_.fill(0);
     
@@ -134,84 +147,30 @@ float Snp::epistasisTest(const Snp & other)const
         }
     }   
     
-    t.calculateTotals();
-
-    //18 and 27 offset for row and column totals respectively
-    for(int y=0; y< GENOTYPE_PAIRINGS; ++y)
-    {
-
-        for(int x=0; x< CONTINGENCY_COLUMNS; ++x)
-        {            
-            //Use margin values
-            int c1 = t.M_[y+GENOTYPE_LEVELS*GENOTYPE_LEVELS*2];
-            int c2 = t.M_[x+GENOTYPE_LEVELS*GENOTYPE_LEVELS*3];
-            float c3 = (t.M_[GENOTYPE_LEVELS*GENOTYPE_LEVELS*3] + t.M_[GENOTYPE_LEVELS*GENOTYPE_LEVELS*3+1]);
-
-
-            float c4 = t.M_[y+(GENOTYPE_LEVELS*GENOTYPE_LEVELS*x)];
-
-            float expected  = ( c1 * c2 ) / c3 ;
+    return t.score<Statistic>();
+}
 
-            retVal = retVal +  (pow(c4-expected,2)/expected);
-           
-        }
-    }
+#define INSTANTIATE_SNP_TESTS(Statistic) \
+    template float Snp::marginalTest<Statistic>()const; \
+    template float Snp::epistasisTest<Statistic>(const Snp & other)const;
+FOR_EACH_STATISTIC(INSTANTIATE_SNP_TESTS)
 
-    return retVal;
+int Snp::getControlWords()
+{
+    return CONR_;
 }
 
-array<vector<PACK_TYPE>, GENOTYPE_LEVELS> Snp::packGenotypesHelper(const vector<char> & genotypes)
+int Snp::getCaseWords()
 {
-    array<vector<PACK_TYPE>, GENOTYPE_LEVELS> packedGenotypes;
-
-    array<PACK_TYPE,GENOTYPE_LEVELS> sectionCode;
-    sectionCode.fill(0);
-    for(int i=0; i<genotypes.size(); ++i)
-    {
-  
-        PACK_TYPE mask = (PACK_TYPE)1<<(PACK_SIZE-(i+1)%PACK_SIZE);
-        
-        //Also convert from ascii value to numerical
-        switch(genotypes[i])
-        {
-            case '0':
-                sectionCode[0] = sectionCode[0] | mask;
-                break;
-            case '1':
-                sectionCode[1] = sectionCode[1] | mask;
-                break;
-            case '2':
-                sectionCode[2] = sectionCode[2] | mask;
-                break;
-        }
-        
-        //When a section is full, push them back and reset the sections to empty;
-        if( ((i+1) % PACK_SIZE == 0) || ( (i+1) == genotypes.size()) )
-        {
-            for(int l = 0; l < GENOTYPE_LEVELS; l++)
-                packedGenotypes[l].push_back(sectionCode[l]);
-            sectionCode.fill(0);
-        }
-    }
-
-    return packedGenotypes;
+    return CASR_;
 }
 
-void Snp::packGenotypes(vector<PACK_TYPE> & allPackedGenotypes, const vector<char> & controlGenotypes, const vector<char> & caseGenotypes)
+int Snp::getCaseStart()
 {
-    array<vector<PACK_TYPE>, GENOTYPE_LEVELS> packedControls = packGenotypesHelper(controlGenotypes);
-    array<vector<PACK_TYPE>, GENOTYPE_LEVELS> packedCases = packGenotypesHelper(caseGenotypes);
-
-    for(int coding=0; coding<GENOTYPE_LEVELS; ++coding)
-        for(int i=0; i< packedControls[0].size(); ++i)
-        {
-            allPackedGenotypes.push_back(packedControls[coding][i]);
-        }
-
-    for(int coding=0; coding<GENOTYPE_LEVELS; ++coding)
-        for(int i=0; i< packedCases[0].size(); ++i)
-        {
-            allPackedGenotypes.push_back(packedCases[coding][i]);
-        }
+    return CASS_;
 }
 
+int Snp::getPlaneWords()
+{
+    return GENOTYPE_LEVELS*(CONR_ + CASR_);
+}
@@ -3,27 +3,29 @@
  * Stores the case and control information for a single SNP, also stores the orginal index in the full dataset.
  * Constructed from plaintext reperesentations of each genotype, i,e. a one byte 0,1,2 per genotype. During
  * construction the genotypes are compressed using an implementation of the BOOST approach from Wan et al.
+ * The packed planes live in a slot of a GenotypeArena, a Snp only views them.
  */
 #ifndef SNP_H
 #define SNP_H
 
+#include "GenotypeArena.h"
+#include "Statistics.h"
+
 #include <iostream>
 
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <memory>
 #include <stdint.h>
 #include <cmath>
 
-#define GENOTYPE_LEVELS 3
 #define GENOTYPE_PAIRINGS 9
 #define CONTINGENCY_COLUMNS 2
 
-#define PACK_SIZE 64
-#define PACK_TYPE uint64_t
-#define POPCOUNT_FUNCTION __builtin_popcountll
 using namespace std;
 
-static int popCount(const vector<PACK_TYPE> & v, int begin, int distance)
+static int popCount(const PACK_TYPE * v, int begin, int distance)
 {
     int retVal = 0;
     for(int i=begin; i<begin+distance; ++i)
@@ -43,28 +45,22 @@ static vector<PACK_TYPE> bitMerge(const vector<PACK_TYPE> & v1, const vector<PAC
     return retVal;
 }
 
-static int popCountAnd(const vector<PACK_TYPE> & v1, const vector<PACK_TYPE> & v2, int begin, int distance)
+static int popCountAnd(const PACK_TYPE * v1, const PACK_TYPE * v2, int begin, int distance)
 {
     int retVal = 0;
 
     for(int i=begin; i<begin+distance; ++i)
-    {
-        if(v1[begin] | v2[begin] !=0)
         retVal += POPCOUNT_FUNCTION(v1[i] & v2[i]);
-    }
     return retVal;
 }
 
-static int popCountAnd(const vector<PACK_TYPE> & v1, const vector<PACK_TYPE> & v2, int begin1, int begin2, int distance)
+static int popCountAnd(const PACK_TYPE * v1, const PACK_TYPE * v2, int begin1, int begin2, int distance)
 {
     int retVal = 0;
     //#pragma acc parallel reduction(+:retVal)
+    //The long runs of zero words of rare genotypes are skipped by the sparse segments of the arena, see BitGemm
     for(int i=0; i<distance; ++i)
-    {
-        //There are many instnaces of long strings of zeroes, primarily due to homozygous minor this saves popcount operations
-        if(v1[begin1+i] | v2[begin2+i] !=0)
-            retVal += POPCOUNT_FUNCTION(v1[begin1 +i] & v2[begin2 +i]);
-    }
+        retVal += POPCOUNT_FUNCTION(v1[begin1 +i] & v2[begin2 +i]);
     return retVal;
 }
 
@@ -98,6 +94,60 @@ struct SmallContingencyTable
         }
     }
     
+    //Pearson chi-square of the 3x2 table, expects the counts to already include the plus one correction
+    float chiSquare()
+    {
+        float retVal=0.0;
+        calculateTotals();
+        
+        for(int y=0; y< GENOTYPE_LEVELS; ++y)
+        {
+            for(int x=0; x< CONTINGENCY_COLUMNS; ++x)
+            {
+                //Use margin values
+                float c1 = (float)RT_[y];
+                float c2 = (float)CT_[x];
+                float c3 = (float)(CT_[0] + CT_[1]);
+                
+                float c4 = (float)a(y,x);
+                
+                float expected  = ( c1 * c2 ) / c3 ;
+                
+                retVal = retVal +  (pow(c4-expected,2)/expected);
+            }
+        }
+        return retVal;
+    }
+    
+    //Any statistic of Statistics.h on the corrected counts
+    template<class Statistic>
+    float score()const
+    {
+        return Statistic::template score<GENOTYPE_LEVELS, 1>(M_.data());
+    }
+    
+    //Frequency of the minor allele whichever homozygote is rarer, from uncorrected counts
+    float minorAlleleFrequency()const
+    {
+        int homoMajor = M_[0] + M_[GENOTYPE_LEVELS];
+        int hetero = M_[1] + M_[1+GENOTYPE_LEVELS];
+        int homoMinor = M_[2] + M_[2+GENOTYPE_LEVELS];
+        int alleles = 2*(homoMajor + hetero + homoMinor);
+        if(alleles == 0)
+            return 0.0;
+        
+        float frequency = (2*homoMinor+hetero)/(float)alleles;
+        return min(frequency, 1-frequency);
+    }
+    
+    int knownCount()const
+    {
+        int retVal = 0;
+        for(int i=0; i<M_.size(); ++i)
+            retVal += M_[i];
+        return retVal;
+    }
+    
 };
 
 struct ContingencyTable
@@ -137,37 +187,91 @@ struct ContingencyTable
         }
         
     }
+    
+    //Pearson chi-square of the 9x2 table, expects the counts to already include the plus one correction
+    float chiSquare()
+    {
+        float retVal=0.0;
+        calculateTotals();
+
+        //18 and 27 offset for row and column totals respectively
+        for(int y=0; y< GENOTYPE_PAIRINGS; ++y)
+        {
+            for(int x=0; x< CONTINGENCY_COLUMNS; ++x)
+            {
+                //Use margin values
+                int c1 = M_[y+GENOTYPE_LEVELS*GENOTYPE_LEVELS*2];
+                int c2 = M_[x+GENOTYPE_LEVELS*GENOTYPE_LEVELS*3];
+                float c3 = (M_[GENOTYPE_LEVELS*GENOTYPE_LEVELS*3] + M_[GENOTYPE_LEVELS*GENOTYPE_LEVELS*3+1]);
+
+                float c4 = M_[y+(GENOTYPE_LEVELS*GENOTYPE_LEVELS*x)];
+
+                float expected  = ( c1 * c2 ) / c3 ;
+
+                retVal = retVal +  (pow(c4-expected,2)/expected);
+            }
+        }
+        return retVal;
+    }
+    
+    //Any statistic of Statistics.h on the corrected counts, the totals are not needed
+    template<class Statistic>
+    float score()const
+    {
+        return Statistic::template score<GENOTYPE_LEVELS, 2>(M_.data());
+    }
 };
 
 class Snp
 {
     public:
         Snp(int index, const vector<char> & controls, const vector<char> & cases, int weight);
-        Snp(const Snp & cpy);
+        //View of a slot of the arena, filled in place by GenotypePacker
+        Snp(int index, const shared_ptr<GenotypeArena> & arena, int slot, int weight);
+        Snp(const Snp & cpy) = default;
+        Snp(Snp && other) = default;
+        Snp & operator=(const Snp & cpy) = default;
+        Snp & operator=(Snp && other) = default;
         
         //Getters
         int getIndex()const;
         int getWeight()const;
         int getCaseNo()const;
+        int getControlNo()const;
+        const shared_ptr<GenotypeArena> & getArena()const;
+        int getSlot()const;
+        //Controls then cases segment of the slot, NULL when the arena is not indexed
+        const SparseSegment * getSparseSegments()const;
         
         //Calculations
         float computeMinorAlleleFrequency()const;
+        //Controls 0 , 1 , 2 then cases 0 , 1 , 2, without correction
+        SmallContingencyTable computeGenotypeCounts()const;
         int computePopCoverAnd(const Snp & other)const;
         //Comparisons
         int computeDifferences(const Snp & other)const;
         float computeUnknownRatio()const;
         
+        //Instantiated for every statistic of Statistics.h
+        template<class Statistic = PearsonChiSquare>
         float marginalTest()const;
+        template<class Statistic = PearsonChiSquare>
         float epistasisTest(const Snp & other)const;
         
+        //Packed layout, shared by every Snp
+        static int getControlWords();
+        static int getCaseWords();
+        static int getCaseStart();
+        static int getPlaneWords();
+        
         friend ostream& operator<< (ostream &out, const Snp & snp);
         //Will consist of controls 0 , 1 , 2 then cases 0 , 1 , 2
-        vector<PACK_TYPE> allSamples_;
+        PACK_TYPE * allSamples_;
     private:
         
-        array<vector<PACK_TYPE>, GENOTYPE_LEVELS> packGenotypesHelper(const vector<char> & genotypes); 
-        void packGenotypes(vector<PACK_TYPE> & allPackedGenotypes, const vector<char> & controlGenotypes, const vector<char> & caseGenotypes);
+        void setLayout(const GenotypeArena & arena);
 
+        shared_ptr<GenotypeArena> arena_;
         int index_;
         int weight_;
 
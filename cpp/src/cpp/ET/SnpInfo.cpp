@@ -0,0 +1,98 @@
+#include "SnpInfo.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <stdexcept>
+
+//Numeric codes are never negative and interned names stop short of MIXED_CHROMOSOMES
+static_assert(-CHROMOSOME_MAX_NAMES > MIXED_CHROMOSOMES, "MIXED_CHROMOSOMES must stay out of the codes parseChromosome returns");
+
+SnpInfo::SnpInfo()
+{
+}
+
+void SnpInfo::reserve(int numberSnps, size_t idCharacters)
+{
+    idPool_.reserve(idCharacters + numberSnps);
+    idOffsets_.reserve(numberSnps);
+    chromosomes_.reserve(numberSnps);
+    basePairs_.reserve(numberSnps);
+}
+
+void SnpInfo::addSnp(const char * id, int8_t chromosome, int32_t basePair)
+{
+    idOffsets_.push_back(idPool_.size());
+    idPool_.append(id);
+    idPool_.push_back('\0');
+    chromosomes_.push_back(chromosome);
+    basePairs_.push_back(basePair);
+}
+
+int SnpInfo::size()const
+{
+    return chromosomes_.size();
+}
+
+const char * SnpInfo::getId(int snp)const
+{
+    return idPool_.data() + idOffsets_[snp];
+}
+
+int8_t SnpInfo::getChromosome(int snp)const
+{
+    return chromosomes_[snp];
+}
+
+int32_t SnpInfo::getBasePair(int snp)const
+{
+    return basePairs_[snp];
+}
+
+string SnpInfo::getChromosomeName(int snp)const
+{
+    int8_t chromosome = chromosomes_[snp];
+    if(chromosome < 0)
+        return chromosomeNames_[-1-chromosome];
+    return to_string(chromosome);
+}
+
+GenomeLocation SnpInfo::getGenomeLocation(int snp)const
+{
+    return GenomeLocation(chromosomes_[snp], basePairs_[snp]);
+}
+
+int8_t SnpInfo::parseChromosome(const char * chromosome)
+{
+    const char * name = chromosome;
+    if(strncasecmp(chromosome, "chr", 3) == 0)
+        chromosome += 3;
+    
+    char * end;
+    long value = strtol(chromosome, &end, 10);
+    if(end != chromosome && *end == '\0' && value >= 0 && value <= INT8_MAX)
+        return value;
+    
+    if(strcasecmp(chromosome, "X") == 0)
+        return CHROMOSOME_X;
+    if(strcasecmp(chromosome, "Y") == 0)
+        return CHROMOSOME_Y;
+    if(strcasecmp(chromosome, "XY") == 0)
+        return CHROMOSOME_XY;
+    if(strcasecmp(chromosome, "MT") == 0 || strcasecmp(chromosome, "M") == 0)
+        return CHROMOSOME_MT;
+    
+    //Few distinct names, a linear search over them is enough
+    for(int n=0; n<chromosomeNames_.size(); ++n)
+        if(chromosomeNames_[n] == name)
+            return -1-n;
+    if(chromosomeNames_.size() == CHROMOSOME_MAX_NAMES)
+        throw length_error("Too many chromosome names");
+    chromosomeNames_.push_back(name);
+    return -(int)chromosomeNames_.size();
+}
+
+int32_t SnpInfo::parseBasePair(const char * basePair)
+{
+    return strtol(basePair, NULL, 10);
+}
@@ -0,0 +1,56 @@
+/**
+ * Column store for the SNP information given alongside the genotypes. Chromosome and base pair are
+ * parsed once into packed numeric columns and every SNP id is interned into a single string pool, so
+ * building GenomeLocations and writing results needs no per SNP string handling. Chromosome names
+ * without a code of their own, such as contigs, are interned into negative codes so each stays apart.
+ */
+
+#ifndef SNP_INFO_H
+#define SNP_INFO_H
+
+#include "LDGroup.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+//Codes of the non-numeric chromosome names, as used by PLINK, 0 when unknown
+#define CHROMOSOME_X 23
+#define CHROMOSOME_Y 24
+#define CHROMOSOME_XY 25
+#define CHROMOSOME_MT 26
+//Other names get the codes -1 down to -CHROMOSOME_MAX_NAMES in the order they are first seen, INT8_MIN is MIXED_CHROMOSOMES
+#define CHROMOSOME_MAX_NAMES 127
+
+using namespace std;
+
+class SnpInfo
+{
+    public:
+        SnpInfo();
+        
+        void reserve(int numberSnps, size_t idCharacters);
+        void addSnp(const char * id, int8_t chromosome, int32_t basePair);
+        
+        int size()const;
+        const char * getId(int snp)const;
+        int8_t getChromosome(int snp)const;
+        //The interned name of a negative code, the code itself otherwise
+        string getChromosomeName(int snp)const;
+        int32_t getBasePair(int snp)const;
+        GenomeLocation getGenomeLocation(int snp)const;
+        
+        int8_t parseChromosome(const char * chromosome);
+        static int32_t parseBasePair(const char * basePair);
+        
+    private:
+        //Ids back to back, each terminated by a null character
+        string idPool_;
+        vector<size_t> idOffsets_;
+        vector<int8_t> chromosomes_;
+        //Name of code -1-n at n
+        vector<string> chromosomeNames_;
+        vector<int32_t> basePairs_;
+};
+
+#endif //SNP_INFO_H
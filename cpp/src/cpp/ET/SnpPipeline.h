@@ -0,0 +1,213 @@
+/**
+ * Parallel front end turning the genotype buffer into the Snps handed to the LDForest. One pass over
+ * blocks of SNPs packs each block into its arena slots, counts the genotypes once per SNP and applies
+ * the marginal significance, minor allele frequency and unknown fraction filters. The survivors are
+ * then compacted to the front of the arena so the planes tested later are contiguous, and the segments
+ * of the rare variants among them are listed sparse. With several phenotypes the samples are packed
+ * in place and every SNP is filtered against each phenotype's split, and so they are for a
+ * quantitative trait.
+ */
+
+#ifndef SNP_PIPELINE_H
+#define SNP_PIPELINE_H
+
+#include "CommonStructs.h"
+#include "Snp.h"
+#include "GeneticModel.h"
+#include "GenotypeArena.h"
+#include "GenotypePacker.h"
+#include "PhenotypeSet.h"
+#include "QuantitativeTrait.h"
+
+#include <vector>
+#include <memory>
+#include <omp.h>
+
+using namespace std;
+
+namespace SnpPipeline
+{
+    enum FilterResult { KEEP_SNP, MARGINAL_SIGNIFICANCE, MINOR_ALLELE_FREQUENCY, UNKNOWN_FRACTION };
+
+    //The marginal chi-square under the model tested, the full genotypes for the all models mode
+    inline float marginalChiSquare(const SmallContingencyTable & counts, int model)
+    {
+        switch(model)
+        {
+            case DOMINANT_MODEL: return ::marginalChiSquare<DominantModel>(counts);
+            case RECESSIVE_MODEL: return ::marginalChiSquare<RecessiveModel>(counts);
+            case ADDITIVE_MODEL: return ::marginalChiSquare<AdditiveModel>(counts);
+            default: return ::marginalChiSquare<GenotypicModel>(counts);
+        }
+    }
+
+    //A filter set to zero is disabled, except the marginal significance which always applies
+    inline FilterResult filter(const SmallContingencyTable & counts, int samples, float marginalScore, float maxMarginalChiSquare, const ParameterInfo & parameterInfo)
+    {
+        if(parameterInfo.maxUnknownFraction_ > 0 && 1 - counts.knownCount()/(float)samples > parameterInfo.maxUnknownFraction_)
+            return UNKNOWN_FRACTION;
+        if(parameterInfo.minimumMinorAlleleFrequency_ > 0 && counts.minorAlleleFrequency() < parameterInfo.minimumMinorAlleleFrequency_)
+            return MINOR_ALLELE_FREQUENCY;
+
+        if(marginalScore > maxMarginalChiSquare)
+            return MARGINAL_SIGNIFICANCE;
+        return KEEP_SNP;
+    }
+
+    inline FilterResult filter(const SmallContingencyTable & counts, int samples, float maxMarginalChiSquare, const ParameterInfo & parameterInfo)
+    {
+        return filter(counts, samples, marginalChiSquare(counts, parameterInfo.model_), maxMarginalChiSquare, parameterInfo);
+    }
+
+    inline FilterResult filter(const Snp & snp, float maxMarginalChiSquare, const ParameterInfo & parameterInfo)
+    {
+        return filter(snp.computeGenotypeCounts(), snp.getControlNo() + snp.getCaseNo(), maxMarginalChiSquare, parameterInfo);
+    }
+
+    inline void countResults(const char * results, int numberSnps, int stride, DatasetSizeInfo & datasetSizeInfo)
+    {
+        for(int i=0; i<numberSnps; ++i)
+        {
+            datasetSizeInfo.marginalSignificanceRemoved_ += results[i*stride] == MARGINAL_SIGNIFICANCE;
+            datasetSizeInfo.mafRemoved_ += results[i*stride] == MINOR_ALLELE_FREQUENCY;
+            datasetSizeInfo.unknownRemoved_ += results[i*stride] == UNKNOWN_FRACTION;
+        }
+    }
+
+    /** @brief Packs the SNPs [snpBegin, snpEnd) block by block in parallel, and keeps those keep(i, snp) accepts
+     *
+     *  keep is called once per SNP from the thread that packed it, i counting from snpBegin
+     *  @return The kept Snps in index order, viewing the front slots of one compacted arena with its
+     *  sparse segments indexed
+     */
+    template<class T, class Keep>
+    vector<Snp> packAndFilter(const T * genotypes, const GenotypeLayout & layout, const vector<int> & controlSamples,
+                              const vector<int> & caseSamples, int snpBegin, int snpEnd, const vector<double> & weights,
+                              int maxThreadUsage, Keep keep)
+    {
+        int numberSnps = max(0, snpEnd - snpBegin);
+        shared_ptr<GenotypeArena> arena = make_shared<GenotypeArena>(numberSnps, controlSamples.size(), caseSamples.size());
+
+        vector<Snp> snps;
+        snps.reserve(numberSnps);
+        for(int i=0; i<numberSnps; ++i)
+            snps.push_back(Snp(snpBegin + i, arena, i, weights[snpBegin + i]));
+
+        vector<PACK_TYPE> caseMask = GenotypePacker::createCaseMask(caseSamples, controlSamples.size() + caseSamples.size());
+        vector<char> kept(numberSnps);
+        int numberBlocks = (numberSnps + PACK_SNP_BLOCK - 1)/PACK_SNP_BLOCK;
+
+        #pragma omp parallel for num_threads(maxThreadUsage) schedule(dynamic)
+        for(int b=0; b<numberBlocks; ++b)
+        {
+            int begin = b*PACK_SNP_BLOCK;
+            int count = min(PACK_SNP_BLOCK, numberSnps - begin);
+            GenotypePacker::packSnpBlock(genotypes, layout, controlSamples, caseSamples, caseMask, &snps[begin], count);
+
+            for(int i=begin; i<begin+count; ++i)
+                kept[i] = keep(i, snps[i]);
+        }
+
+        vector<int> keptSlots;
+        for(int i=0; i<numberSnps; ++i)
+            if(kept[i])
+                keptSlots.push_back(i);
+        arena->compact(keptSlots);
+        arena->indexSparseSegments(maxThreadUsage);
+
+        vector<Snp> retVal;
+        retVal.reserve(keptSlots.size());
+        for(int k=0; k<keptSlots.size(); ++k)
+            retVal.push_back(Snp(snps[keptSlots[k]].getIndex(), arena, k, snps[keptSlots[k]].getWeight()));
+        return retVal;
+    }
+
+    /** @brief Packs and filters the SNPs [snpBegin, snpEnd) of the described panel
+     *
+     *  @param weights Weight of every SNP of the panel, indexed like the SNP info
+     *  @return The surviving Snps in index order, viewing the front slots of one compacted arena
+     */
+    template<class T>
+    vector<Snp> build(const T * genotypes, const GenotypeLayout & layout, const vector<int> & controlSamples,
+                      const vector<int> & caseSamples, int snpBegin, int snpEnd, const vector<double> & weights,
+                      float maxMarginalChiSquare, const ParameterInfo & parameterInfo, DatasetSizeInfo & datasetSizeInfo)
+    {
+        vector<char> results(max(0, snpEnd - snpBegin));
+        vector<Snp> retVal = packAndFilter(genotypes, layout, controlSamples, caseSamples, snpBegin, snpEnd, weights, parameterInfo.maxThreadUsage_,
+            [&](int i, const Snp & snp)
+            {
+                results[i] = filter(snp, maxMarginalChiSquare, parameterInfo);
+                return results[i] == KEEP_SNP;
+            });
+        countResults(results.data(), results.size(), 1, datasetSizeInfo);
+        return retVal;
+    }
+
+    /** @brief Packs every sample in its own position and filters each SNP once per phenotype
+     *
+     *  A SNP is kept when it passes the filters for any phenotype.
+     *  @param activePhenotypes Set to the bit set of phenotypes each returned Snp passed for
+     *  @param datasetSizeInfos One per phenotype, the filter counts are added to them
+     */
+    template<class T>
+    vector<Snp> build(const T * genotypes, const GenotypeLayout & layout, const PhenotypeSet & phenotypes, int snpBegin, int snpEnd, const vector<double> & weights, float maxMarginalChiSquare,
+                      const ParameterInfo & parameterInfo, vector<DatasetSizeInfo> & datasetSizeInfos, vector<uint64_t> & activePhenotypes)
+    {
+        int numberSamples = phenotypes.getSampleNo();
+        vector<int> samples(numberSamples);
+        for(int i=0; i<numberSamples; ++i)
+            samples[i] = i;
+
+        int numberPhenotypes = phenotypes.size();
+        vector<char> results(max(0, snpEnd - snpBegin)*numberPhenotypes);
+        vector<uint64_t> passed(max(0, snpEnd - snpBegin), 0);
+        vector<Snp> retVal = packAndFilter(genotypes, layout, samples, vector<int>(), snpBegin, snpEnd, weights, parameterInfo.maxThreadUsage_,
+            [&](int i, const Snp & snp)
+            {
+                SmallContingencyTable tables[MAX_PHENOTYPES];
+                phenotypes.genotypeCounts(snp, tables);
+                for(int p=0; p<numberPhenotypes; ++p)
+                {
+                    results[i*numberPhenotypes + p] = filter(tables[p], numberSamples, maxMarginalChiSquare, parameterInfo);
+                    if(results[i*numberPhenotypes + p] == KEEP_SNP)
+                        passed[i] |= (uint64_t)1<<p;
+                }
+                return passed[i] != 0;
+            });
+
+        for(int p=0; p<numberPhenotypes; ++p)
+            countResults(results.data() + p, passed.size(), numberPhenotypes, datasetSizeInfos[p]);
+        activePhenotypes.clear();
+        for(int k=0; k<retVal.size(); ++k)
+            activePhenotypes.push_back(passed[retVal[k].getIndex() - snpBegin]);
+        return retVal;
+    }
+
+    /** @brief Packs every sample in its own position and filters each SNP on the analysis of variance of the trait
+     *
+     *  The minor allele frequency and unknown fraction filters count every sample, known trait or not.
+     */
+    template<class T>
+    vector<Snp> build(const T * genotypes, const GenotypeLayout & layout, const QuantitativeTrait & trait, int snpBegin, int snpEnd, const vector<double> & weights,
+                      float maxMarginalChiSquare, const ParameterInfo & parameterInfo, DatasetSizeInfo & datasetSizeInfo)
+    {
+        int numberSamples = trait.getSampleNo();
+        vector<int> samples(numberSamples);
+        for(int i=0; i<numberSamples; ++i)
+            samples[i] = i;
+
+        vector<char> results(max(0, snpEnd - snpBegin));
+        vector<Snp> retVal = packAndFilter(genotypes, layout, samples, vector<int>(), snpBegin, snpEnd, weights, parameterInfo.maxThreadUsage_,
+            [&](int i, const Snp & snp)
+            {
+                TraitMoments moments;
+                trait.genotypeMoments(snp, moments);
+                results[i] = filter(snp.computeGenotypeCounts(), numberSamples, QuantitativeTrait::marginalScore(moments), maxMarginalChiSquare, parameterInfo);
+                return results[i] == KEEP_SNP;
+            });
+        countResults(results.data(), results.size(), 1, datasetSizeInfo);
+        return retVal;
+    }
+}
+
+#endif //SNP_PIPELINE_H
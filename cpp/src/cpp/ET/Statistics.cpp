@@ -0,0 +1,27 @@
+#include "Statistics.h"
+
+int CountTable::size_ = 0;
+vector<double> CountTable::xLogX_;
+vector<double> CountTable::logarithm_;
+vector<double> CountTable::inverse_;
+
+void CountTable::reserve(int maxCount)
+{
+    if(maxCount < size_)
+        return;
+
+    xLogX_.resize(maxCount+1);
+    logarithm_.resize(maxCount+1);
+    inverse_.resize(maxCount+1);
+    //Zero counts only arise without the plus one correction, 0*ln(0) is taken as 0
+    xLogX_[0] = 0.0;
+    logarithm_[0] = 0.0;
+    inverse_[0] = 0.0;
+    for(int n=1; n<=maxCount; ++n)
+    {
+        logarithm_[n] = log((double)n);
+        xLogX_[n] = n*logarithm_[n];
+        inverse_[n] = 1.0/n;
+    }
+    size_ = maxCount+1;
+}
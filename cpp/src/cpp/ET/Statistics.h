@@ -0,0 +1,216 @@
+/**
+ * Association statistics of a genotype by case/control table, written as policies the test loops
+ * are instantiated with. The statistic is fixed when a loop is compiled, so scoring a table is a
+ * direct inlined call, and a run picks its statistic once by calling the matching instantiation.
+ * Every policy scores the table of Snps SNPs coded into Levels levels each, Levels^Snps rows with
+ * the level of the first SNP varying fastest, 9 rows for a pair under the full genotype coding. The
+ * rows are laid out controls then cases with the plus one correction already added, so every cell is
+ * at least one. The logarithms and reciprocals of the integer counts come from CountTable.
+ */
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <vector>
+#include <cmath>
+
+using namespace std;
+
+enum StatisticType { PEARSON_CHI_SQUARE, G_TEST, MUTUAL_INFORMATION, INTERACTION_CONTRAST };
+
+//Calls X with every policy, to instantiate a loop for each of them
+#define FOR_EACH_STATISTIC(X) X(PearsonChiSquare) X(GTest) X(MutualInformation) X(InteractionContrast)
+
+//n*ln(n), ln(n) and 1/n of the counts up to the reserved one, computed past it
+class CountTable
+{
+    public:
+        //Fills the tables for counts up to maxCount, call outside parallel regions
+        static void reserve(int maxCount);
+
+        static double xLogX(int n)
+        {
+            return n < size_ ? xLogX_[n] : n*log((double)n);
+        }
+
+        static double logarithm(int n)
+        {
+            return n < size_ ? logarithm_[n] : log((double)n);
+        }
+
+        static double inverse(int n)
+        {
+            return n < size_ ? inverse_[n] : 1.0/n;
+        }
+
+    private:
+        static int size_;
+        static vector<double> xLogX_;
+        static vector<double> logarithm_;
+        static vector<double> inverse_;
+};
+
+constexpr int power(int base, int exponent)
+{
+    return exponent == 0 ? 1 : base*power(base, exponent-1);
+}
+
+//Pearson chi-square, the arithmetic of ContingencyTable::chiSquare so the scores are unchanged
+struct PearsonChiSquare
+{
+    //LDGroup::epistasisBound holds for this statistic
+    static const bool boundedByChiSquare = true;
+
+    template<int Levels, int Snps>
+    static float score(const int * M)
+    {
+        const int rows = power(Levels, Snps);
+        int rowTotals[rows];
+        int columnTotals[2] = {0, 0};
+        for(int y=0; y<rows; ++y)
+        {
+            rowTotals[y] = M[y] + M[y+rows];
+            columnTotals[0] += M[y];
+            columnTotals[1] += M[y+rows];
+        }
+        float total = columnTotals[0] + columnTotals[1];
+
+        float retVal = 0.0;
+        for(int y=0; y<rows; ++y)
+        {
+            for(int x=0; x<2; ++x)
+            {
+                float expected = ((float)rowTotals[y] * (float)columnTotals[x]) / total;
+                float observed = M[y+rows*x];
+                retVal = retVal + (pow(observed-expected,2)/expected);
+            }
+        }
+        return retVal;
+    }
+};
+
+//Log-likelihood ratio G = 2*sum(O*ln(O/E)), chi-square distributed like Pearson's with the same degrees of freedom
+struct GTest
+{
+    static const bool boundedByChiSquare = false;
+
+    template<int Levels, int Snps>
+    static double logLikelihoodRatio(const int * M, int & total)
+    {
+        const int rows = power(Levels, Snps);
+        double sum = 0.0;
+        int controls = 0;
+        int cases = 0;
+        for(int y=0; y<rows; ++y)
+        {
+            sum += CountTable::xLogX(M[y]) + CountTable::xLogX(M[y+rows]) - CountTable::xLogX(M[y]+M[y+rows]);
+            controls += M[y];
+            cases += M[y+rows];
+        }
+        total = controls + cases;
+        sum += CountTable::xLogX(total) - CountTable::xLogX(controls) - CountTable::xLogX(cases);
+        return 2.0*sum;
+    }
+
+    template<int Levels, int Snps>
+    static float score(const int * M)
+    {
+        int total;
+        return logLikelihoodRatio<Levels, Snps>(M, total);
+    }
+};
+
+/*
+ * Mutual information between the genotypes and the case status, G/(2N) in nats. It is reported in
+ * thousandths of a bit so the scores spread over the integer bins of the TopSnpList cutoff.
+ */
+struct MutualInformation
+{
+    static const bool boundedByChiSquare = false;
+
+    template<int Levels, int Snps>
+    static float score(const int * M)
+    {
+        int total;
+        double g = GTest::logLikelihoodRatio<Levels, Snps>(M, total);
+        return 1000.0*g/(2.0*total*log(2.0));
+    }
+};
+
+/*
+ * One degree of freedom test of interaction on the carrier coding. Every SNP is collapsed to
+ * carrier or not, carrying any level above the first, and the contrast is the log of the case odds ratio over the control odds ratio of
+ * the collapsed table, the ratio of odds ratios for a pair, with the Wald variance sum(1/n). For a
+ * single SNP it is the log odds ratio of carrying the minor allele. Scores contrast^2/variance.
+ */
+struct InteractionContrast
+{
+    static const bool boundedByChiSquare = false;
+
+    template<int Levels, int Snps>
+    static float score(const int * M)
+    {
+        const int rows = power(Levels, Snps);
+        const int patterns = 1<<Snps;
+        //Bit s of a pattern is set when SNP s carries the minor allele
+        int collapsed[2*patterns];
+        for(int p=0; p<2*patterns; ++p)
+            collapsed[p] = 0;
+        for(int y=0; y<rows; ++y)
+        {
+            int pattern = 0;
+            for(int s=0, r=y; s<Snps; ++s, r/=Levels)
+                pattern |= (r%Levels != 0)<<s;
+            collapsed[pattern] += M[y];
+            collapsed[pattern+patterns] += M[y+rows];
+        }
+
+        double contrast = 0.0;
+        double variance = 0.0;
+        for(int p=0; p<patterns; ++p)
+        {
+            //Minus for every SNP not carrying
+            double sign = (Snps - __builtin_popcount(p)) % 2 == 0 ? 1.0 : -1.0;
+            contrast += sign*(CountTable::logarithm(collapsed[p+patterns]) - CountTable::logarithm(collapsed[p]));
+            variance += CountTable::inverse(collapsed[p+patterns]) + CountTable::inverse(collapsed[p]);
+        }
+        return contrast*contrast/variance;
+    }
+};
+
+/*
+ * Case-only interaction test. When two SNPs are independent in the population their genotypes stay
+ * independent among the cases unless they interact, so the Pearson chi-square of independence of
+ * the Levels x Levels table of cases, cell i + Levels*j, has (Levels-1)^2 degrees of freedom.
+ */
+template<int Levels>
+float independenceChiSquare(const int * M)
+{
+    int rowTotals[Levels];
+    int columnTotals[Levels];
+    int total = 0;
+    for(int k=0; k<Levels; ++k)
+    {
+        rowTotals[k] = 0;
+        columnTotals[k] = 0;
+    }
+    for(int j=0; j<Levels; ++j)
+        for(int i=0; i<Levels; ++i)
+        {
+            rowTotals[i] += M[i+Levels*j];
+            columnTotals[j] += M[i+Levels*j];
+            total += M[i+Levels*j];
+        }
+
+    float retVal = 0.0;
+    for(int j=0; j<Levels; ++j)
+        for(int i=0; i<Levels; ++i)
+        {
+            float expected = ((float)rowTotals[i] * (float)columnTotals[j]) / total;
+            float observed = M[i+Levels*j];
+            retVal = retVal + (pow(observed-expected,2)/expected);
+        }
+    return retVal;
+}
+
+#endif //STATISTICS_H
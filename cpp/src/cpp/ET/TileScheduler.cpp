@@ -0,0 +1,117 @@
+#include "TileScheduler.h"
+
+TileScheduler::TileScheduler(const vector<PairTile> & tiles, int numberThreads)
+    : tiles_(tiles), ranges_(numberThreads), numberThreads_(numberThreads), wallTime_(0.0)
+{
+    double totalCost = 0.0;
+    for(int i=0; i<tiles_.size(); ++i)
+        totalCost += tiles_[i].cost_;
+
+    //Contiguous blocks of equal estimated cost, tile i goes to the thread its starting cost falls in
+    int tile = 0;
+    double costSoFar = 0.0;
+    for(int t=0; t<numberThreads_; ++t)
+    {
+        int head = tile;
+        double blockEnd = totalCost*(t+1)/numberThreads_;
+        while(tile < tiles_.size() && (costSoFar < blockEnd || t == numberThreads_-1))
+        {
+            costSoFar += tiles_[tile].cost_;
+            tile++;
+        }
+        ranges_[t].range_ = packRange(head, tile);
+    }
+}
+
+const vector<ThreadTiming> & TileScheduler::getTimings()const
+{
+    return timings_;
+}
+
+void TileScheduler::printTimings(ostream & out)const
+{
+    double busiest = 0.0;
+    double totalBusy = 0.0;
+    for(int t=0; t<timings_.size(); ++t)
+    {
+        busiest = max(busiest, timings_[t].busy_);
+        totalBusy += timings_[t].busy_;
+    }
+
+    out<<"\tScheduler: "<<tiles_.size()<<" tiles, "<<wallTime_<<"s wall, load balance "
+       <<(busiest > 0.0 ? totalBusy/(busiest*timings_.size()) : 1.0)<<endl;
+    for(int t=0; t<timings_.size(); ++t)
+        out<<"\t\tThread "<<t<<": busy "<<timings_[t].busy_<<"s idle "<<timings_[t].idle_<<"s tiles "
+           <<timings_[t].tilesRun_<<" ("<<timings_[t].tilesStolen_<<" stolen)"<<endl;
+}
+
+bool TileScheduler::nextTile(int thread, int & tile)
+{
+    if(takeFront(thread, tile))
+        return true;
+
+    //Steal from whichever thread has the most tiles left until none are left anywhere
+    while(true)
+    {
+        int victim = -1;
+        uint32_t mostLeft = 0;
+        for(int t=0; t<numberThreads_; ++t)
+        {
+            uint64_t range = ranges_[t].range_.load(memory_order_relaxed);
+            uint32_t head = (uint32_t)range;
+            uint32_t tail = range >> 32;
+            if(tail > head && tail-head > mostLeft)
+            {
+                mostLeft = tail-head;
+                victim = t;
+            }
+        }
+
+        if(victim == -1)
+            return false;
+        if(takeBack(victim, tile))
+        {
+            timings_[thread].tilesStolen_++;
+            return true;
+        }
+    }
+}
+
+bool TileScheduler::takeFront(int thread, int & tile)
+{
+    uint64_t range = ranges_[thread].range_.load(memory_order_relaxed);
+    while(true)
+    {
+        uint32_t head = (uint32_t)range;
+        uint32_t tail = range >> 32;
+        if(head >= tail)
+            return false;
+        if(ranges_[thread].range_.compare_exchange_weak(range, packRange(head+1, tail)))
+        {
+            tile = head;
+            return true;
+        }
+    }
+}
+
+bool TileScheduler::takeBack(int victim, int & tile)
+{
+    uint64_t range = ranges_[victim].range_.load(memory_order_relaxed);
+    while(true)
+    {
+        uint32_t head = (uint32_t)range;
+        uint32_t tail = range >> 32;
+        if(head >= tail)
+            return false;
+        if(ranges_[victim].range_.compare_exchange_weak(range, packRange(head, tail-1)))
+        {
+            tile = tail-1;
+            return true;
+        }
+    }
+}
+
+uint64_t TileScheduler::packRange(uint32_t head, uint32_t tail)
+{
+    return ((uint64_t)tail << 32) | head;
+}
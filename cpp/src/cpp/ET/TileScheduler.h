@@ -0,0 +1,98 @@
+/**
+ * Work-stealing execution of the tiles of the triangular group-pair space. Each thread starts
+ * with a contiguous block of tiles carrying an equal share of the estimated cost and takes tiles
+ * from the front of its own block; once it runs dry it steals single tiles from the back of the
+ * block with the most tiles left. Per-thread busy and idle time is recorded so the balance of a
+ * run can be checked.
+ */
+
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <vector>
+#include <atomic>
+#include <iostream>
+#include <stdint.h>
+#include <omp.h>
+
+using namespace std;
+
+//Group pairs (row, col), col > row, from (rowBegin_, colBegin_) up to but excluding (rowEnd_, colEnd_) in row-major order
+struct PairTile
+{
+    int rowBegin_;
+    int colBegin_;
+    int rowEnd_;
+    int colEnd_;
+    long long int pairs_;
+    double cost_;
+    //0 for the groups of the forest, k for its k-th randomized grouping
+    int grouping_;
+};
+
+struct ThreadTiming
+{
+    double busy_;
+    double idle_;
+    int tilesRun_;
+    int tilesStolen_;
+};
+
+class TileScheduler
+{
+    public:
+        TileScheduler(const vector<PairTile> & tiles, int numberThreads);
+
+        //Calls work(tile) once for every tile, spread over the threads
+        template<class Work>
+        void run(Work work);
+
+        const vector<ThreadTiming> & getTimings()const;
+        void printTimings(ostream & out)const;
+
+    private:
+        bool nextTile(int thread, int & tile);
+        bool takeFront(int thread, int & tile);
+        bool takeBack(int victim, int & tile);
+
+        static uint64_t packRange(uint32_t head, uint32_t tail);
+
+        //Tiles [head, tail) still owned by a thread, head in the low and tail in the high 32 bits
+        struct TileRange
+        {
+            atomic<uint64_t> range_;
+            char padding_[56];
+        };
+
+        vector<PairTile> tiles_;
+        vector<TileRange> ranges_;
+        vector<ThreadTiming> timings_;
+        int numberThreads_;
+        double wallTime_;
+};
+
+template<class Work>
+void TileScheduler::run(Work work)
+{
+    timings_.assign(numberThreads_, ThreadTiming{0.0, 0.0, 0, 0});
+    double start = omp_get_wtime();
+
+    #pragma omp parallel num_threads(numberThreads_)
+    {
+        int thread = omp_get_thread_num();
+        int tile;
+        while(nextTile(thread, tile))
+        {
+            double tileStart = omp_get_wtime();
+            work(tiles_[tile]);
+            timings_[thread].busy_ += omp_get_wtime() - tileStart;
+            timings_[thread].tilesRun_++;
+        }
+    }
+
+    wallTime_ = omp_get_wtime() - start;
+    for(int t=0; t<numberThreads_; ++t)
+        timings_[t].idle_ = wallTime_ - timings_[t].busy_;
+}
+
+#endif //TILE_SCHEDULER_H
@@ -2,22 +2,23 @@
 
 TopSnpList::TopSnpList()
 {
+    topK_ = 0;
+    cutoff_ = 0;
+    internalTestsCounter_ = 0;
+    leafTestsCounter_ = 0;
+    groupPairsCounter_ = 0;
+    prunedGroupPairsCounter_ = 0;
     
+    for(int i=0; i<=MAX_CUTOFF; ++i)
+    {
+        pairwiseSignificanceCounts_[i] = 0;
+        pairwiseSignificanceCountsPrefixSum_[i] = 0;
+    }
 }
 
 TopSnpList::TopSnpList(const TopSnpList & cpy)
 {
-    topK_ = cpy.topK_;
-    cutoff_ = cpy.cutoff_;
-    
-    topScores_ = cpy.topScores_;
-    topPartners_ = cpy.topPartners_;
-    internalTestsCounter_ = cpy.internalTestsCounter_;
-    leafTestsCounter_ = cpy.leafTestsCounter_;
-    
-    pairwiseSignificanceCounts_ = cpy.pairwiseSignificanceCounts_;
-    pairwiseSignificanceCountsPrefixSum_ = cpy.pairwiseSignificanceCountsPrefixSum_;
-    prefixSumTimer_ = cpy.prefixSumTimer_;
+    *this = cpy;
 }
 
 TopSnpList::TopSnpList(int topK, int numberSnps, float cutoff)
@@ -25,80 +26,209 @@ TopSnpList::TopSnpList(int topK, int numberSnps, float cutoff)
     topK_ = topK;
     cutoff_ = cutoff;
     
-    topScores_ = vector<float>(numberSnps, 0.0);
-    topPartners_ = vector<int>(numberSnps, -1);
+    topPairs_ = vector<atomic<uint64_t> >(numberSnps);
+    for(int i=0; i<numberSnps; ++i)
+        topPairs_[i] = packPair(0.0, -1);
     internalTestsCounter_ = 0;
     leafTestsCounter_ = 0;
+    groupPairsCounter_ = 0;
+    prunedGroupPairsCounter_ = 0;
     
-    pairwiseSignificanceCounts_.fill(0);
-    pairwiseSignificanceCountsPrefixSum_.fill(0);
-    prefixSumTimer_ = 0;
+    for(int i=0; i<=MAX_CUTOFF; ++i)
+    {
+        pairwiseSignificanceCounts_[i] = 0;
+        pairwiseSignificanceCountsPrefixSum_[i] = 0;
+    }
+    reserveThreads(omp_get_max_threads());
+}
+
+TopSnpList & TopSnpList::operator=(const TopSnpList & cpy)
+{
+    if(this == &cpy)
+        return *this;
+    
+    topK_ = cpy.topK_;
+    cutoff_ = cpy.getCutoff();
+    
+    topPairs_ = vector<atomic<uint64_t> >(cpy.topPairs_.size());
+    for(int i=0; i<topPairs_.size(); ++i)
+        topPairs_[i] = cpy.topPairs_[i].load();
+    internalTestsCounter_ = cpy.internalTestsCounter_.load();
+    leafTestsCounter_ = cpy.leafTestsCounter_.load();
+    groupPairsCounter_ = cpy.groupPairsCounter_.load();
+    prunedGroupPairsCounter_ = cpy.prunedGroupPairsCounter_.load();
+    
+    for(int i=0; i<=MAX_CUTOFF; ++i)
+    {
+        pairwiseSignificanceCounts_[i] = cpy.pairwiseSignificanceCounts_[i].load();
+        pairwiseSignificanceCountsPrefixSum_[i] = cpy.pairwiseSignificanceCountsPrefixSum_[i].load();
+    }
+    shards_ = cpy.shards_;
+    
+    reciprocalPairs_.clear();
+    cutoffPairs_.clear();
+    return *this;
 }
 
 bool TopSnpList::attemptInsert(int snpIndex1, int snpIndex2, float score)
 { 
-    bool retVal = false;
-
-    #pragma omp critical
+    int thread = omp_get_thread_num();
+    float cutoff = getCutoff();
+    
+    if(thread < shards_.size())
     {
-
-        if( prefixSumTimer_ >= PREFIX_SUM_ROLLOVER )
+        HistogramShard & shard = shards_[thread];
+        if( shard.insertsSinceMerge_ >= PREFIX_SUM_ROLLOVER )
         {
-            
-            pairwiseSignificanceCountsPrefixSum_ = pairwiseSignificanceCounts_;
-            for(int i=MAX_CUTOFF; i>getCutoff(); --i)
-            {
-                pairwiseSignificanceCountsPrefixSum_[i-1] = pairwiseSignificanceCountsPrefixSum_[i-1]+pairwiseSignificanceCounts_[i];
-            }
-            
-            prefixSumTimer_ = 0;
+            mergeShard(shard);
+            cutoff = getCutoff();
         }
         
-        if(score > getCutoff())
+        if(score > cutoff)
         {
             int index = min((int)score, MAX_CUTOFF);
-            pairwiseSignificanceCounts_[index]++;
-            
-            
+            shard.counts_[index]++;
             
-            if(pairwiseSignificanceCounts_[index] >= topK_ || pairwiseSignificanceCountsPrefixSum_[index] >= topK_)
-                cutoff_ = index;
-        } 
-        
-        if(score > topScores_[snpIndex1])
-        {
-            topScores_[snpIndex1] = score;
-            topPartners_[snpIndex1] = snpIndex2;
-            retVal = true;
+            if(pairwiseSignificanceCounts_[index].load(memory_order_relaxed) + shard.counts_[index] >= topK_ 
+                || pairwiseSignificanceCountsPrefixSum_[index].load(memory_order_relaxed) >= topK_)
+                raiseCutoff(index);
         }
+        shard.insertsSinceMerge_++;
+    }
+    //Threads beyond the reserved shards count straight into the shared histogram
+    else if(score > cutoff)
+    {
+        int index = min((int)score, MAX_CUTOFF);
+        int count = pairwiseSignificanceCounts_[index].fetch_add(1, memory_order_relaxed) + 1;
         
-        if(score > topScores_[snpIndex2])
+        if(count >= topK_ || pairwiseSignificanceCountsPrefixSum_[index].load(memory_order_relaxed) >= topK_)
+            raiseCutoff(index);
+    }
+    
+    bool retVal = updateTopPair(snpIndex1, snpIndex2, score);
+    if(updateTopPair(snpIndex2, snpIndex1, score))
+        retVal = true;
+
+    return retVal;
+}
+
+void TopSnpList::reserveThreads(int numberThreads)
+{
+    HistogramShard empty;
+    empty.counts_.fill(0);
+    empty.insertsSinceMerge_ = 0;
+    
+    if(shards_.size() < numberThreads)
+        shards_.resize(numberThreads, empty);
+}
+
+void TopSnpList::mergeShards()
+{
+    for(int i=0; i<shards_.size(); ++i)
+        mergeShard(shards_[i]);
+}
+
+void TopSnpList::mergeShard(HistogramShard & shard)
+{
+    #pragma omp critical(topSnpListMerge)
+    {
+        for(int i=0; i<=MAX_CUTOFF; ++i)
+            pairwiseSignificanceCounts_[i].fetch_add(shard.counts_[i], memory_order_relaxed);
+        
+        //Only the bins above the cutoff can still move it
+        int cutoff = getCutoff();
+        for(int i=0; i<=MAX_CUTOFF; ++i)
+            pairwiseSignificanceCountsPrefixSum_[i].store(pairwiseSignificanceCounts_[i].load(memory_order_relaxed), memory_order_relaxed);
+        for(int i=MAX_CUTOFF; i>cutoff; --i)
+            pairwiseSignificanceCountsPrefixSum_[i-1].store(pairwiseSignificanceCountsPrefixSum_[i-1].load(memory_order_relaxed)
+                                                           +pairwiseSignificanceCounts_[i].load(memory_order_relaxed), memory_order_relaxed);
+    }
+    shard.counts_.fill(0);
+    shard.insertsSinceMerge_ = 0;
+}
+
+/*
+ * Inserts only raise the cutoff from prefix sums refreshed every PREFIX_SUM_ROLLOVER inserts, so it
+ * can end a bin behind the final histogram depending on the order of the inserts. Settling it on the
+ * merged histogram makes the cutoff the same however the pairs were split over threads or shards.
+ */
+void TopSnpList::settleCutoff()
+{
+    long long int suffixSum = 0;
+    for(int i=MAX_CUTOFF; i>getCutoff(); --i)
+    {
+        suffixSum += pairwiseSignificanceCounts_[i];
+        if(suffixSum >= topK_)
         {
-            topScores_[snpIndex2] = score;
-            topPartners_[snpIndex2] = snpIndex1;
-            retVal = true;
+            raiseCutoff(i);
+            break;
         }
-        prefixSumTimer_++;
     }
+}
 
-    return retVal;
+void TopSnpList::raiseCutoff(float cutoff)
+{
+    float current = cutoff_.load(memory_order_relaxed);
+    while(cutoff > current && !cutoff_.compare_exchange_weak(current, cutoff, memory_order_relaxed))
+        ;
+}
+
+bool TopSnpList::updateTopPair(int snpIndex, int partnerIndex, float score)
+{
+    uint64_t current = topPairs_[snpIndex].load(memory_order_relaxed);
+    uint64_t replacement = packPair(score, partnerIndex);
+    
+    while(score > unpackScore(current))
+    {
+        if(topPairs_[snpIndex].compare_exchange_weak(current, replacement, memory_order_relaxed))
+            return true;
+    }
+    return false;
+}
+
+uint64_t TopSnpList::packPair(float score, int partner)
+{
+    uint32_t scoreBits;
+    memcpy(&scoreBits, &score, sizeof(scoreBits));
+    return ((uint64_t)scoreBits << 32) | (uint32_t)partner;
+}
+
+float TopSnpList::unpackScore(uint64_t packed)
+{
+    uint32_t scoreBits = packed >> 32;
+    float score;
+    memcpy(&score, &scoreBits, sizeof(score));
+    return score;
+}
+
+int TopSnpList::unpackPartner(uint64_t packed)
+{
+    return (int)(uint32_t)packed;
 }
 
 float TopSnpList::getCutoff()const
 {
-    return cutoff_;
+    return cutoff_.load(memory_order_relaxed);
+}
+
+float TopSnpList::getTopScore(int snpIndex)const
+{
+    return unpackScore(topPairs_[snpIndex].load(memory_order_relaxed));
+}
+
+int TopSnpList::getTopPartner(int snpIndex)const
+{
+    return unpackPartner(topPairs_[snpIndex].load(memory_order_relaxed));
 }
 
 void TopSnpList::incrementInternalTestsCounter(long long int testsDone)
 {
-    #pragma omp critical
-    internalTestsCounter_ += testsDone;
+    internalTestsCounter_.fetch_add(testsDone, memory_order_relaxed);
 }
 
 void TopSnpList::incrementLeafTestsCounter(long long int testsDone)
 {
-    #pragma omp critical
-    leafTestsCounter_ += testsDone;
+    leafTestsCounter_.fetch_add(testsDone, memory_order_relaxed);
 }
 
 long long int TopSnpList::getInternalTests()const
@@ -111,12 +241,35 @@ long long int TopSnpList::getLeafTests()const
     return leafTestsCounter_;
 }
 
+void TopSnpList::incrementGroupPairsCounter(long long int groupPairs)
+{
+    groupPairsCounter_.fetch_add(groupPairs, memory_order_relaxed);
+}
+
+void TopSnpList::incrementPrunedGroupPairsCounter(long long int groupPairs)
+{
+    prunedGroupPairsCounter_.fetch_add(groupPairs, memory_order_relaxed);
+}
+
+long long int TopSnpList::getGroupPairs()const
+{
+    return groupPairsCounter_;
+}
+
+long long int TopSnpList::getPrunedGroupPairs()const
+{
+    return prunedGroupPairsCounter_;
+}
+
 void TopSnpList::calculateFormattedResults()
 {
     
-    for(int i=0; i< topPartners_.size(); ++i)
-        if(topScores_[i] >= getCutoff()-1 && topScores_[i] >0)
-            cutoffPairs_.push_back(  TopPairing(i, topPartners_[i], topScores_[i] )       );
+    mergeShards();
+    settleCutoff();
+    
+    for(int i=0; i< topPairs_.size(); ++i)
+        if(getTopScore(i) >= getCutoff()-1 && getTopScore(i) >0)
+            cutoffPairs_.push_back(  TopPairing(i, getTopPartner(i), getTopScore(i) )       );
 
     
     calculateReciprocalPairs();
@@ -272,18 +425,93 @@ int TopSnpList::getNumberOfReciprocalPairs()const
     return reciprocalPairs_.size();
 }
 
+void TopSnpList::writeBinary(ofstream & ofs)
+{
+    mergeShards();
+    
+    int32_t header[2] = {topK_, (int32_t)topPairs_.size()};
+    float cutoff = getCutoff();
+    int64_t counters[4] = {internalTestsCounter_, leafTestsCounter_, groupPairsCounter_, prunedGroupPairsCounter_};
+    array<int32_t, MAX_CUTOFF+1> counts;
+    for(int i=0; i<=MAX_CUTOFF; ++i)
+        counts[i] = pairwiseSignificanceCounts_[i];
+    ofs.write((const char*)header, sizeof(header));
+    ofs.write((const char*)&cutoff, sizeof(cutoff));
+    ofs.write((const char*)counters, sizeof(counters));
+    ofs.write((const char*)counts.data(), sizeof(int32_t)*counts.size());
+    
+    //Only the SNPs that were paired at all
+    int32_t numberPaired = 0;
+    for(int i=0; i<topPairs_.size(); ++i)
+        numberPaired += getTopPartner(i) != -1;
+    ofs.write((const char*)&numberPaired, sizeof(numberPaired));
+    for(int32_t i=0; i<topPairs_.size(); ++i)
+    {
+        if(getTopPartner(i) == -1)
+            continue;
+        uint64_t packed = topPairs_[i].load();
+        ofs.write((const char*)&i, sizeof(i));
+        ofs.write((const char*)&packed, sizeof(packed));
+    }
+}
+
+bool TopSnpList::mergeBinary(ifstream & ifs)
+{
+    int32_t header[2];
+    float cutoff;
+    int64_t counters[4];
+    array<int32_t, MAX_CUTOFF+1> counts;
+    ifs.read((char*)header, sizeof(header));
+    ifs.read((char*)&cutoff, sizeof(cutoff));
+    ifs.read((char*)counters, sizeof(counters));
+    ifs.read((char*)counts.data(), sizeof(int32_t)*counts.size());
+    if(!ifs || header[0] != topK_ || header[1] != topPairs_.size())
+        return false;
+    
+    int32_t numberPaired;
+    ifs.read((char*)&numberPaired, sizeof(numberPaired));
+    for(int k=0; k<numberPaired && ifs; ++k)
+    {
+        int32_t index;
+        uint64_t packed;
+        ifs.read((char*)&index, sizeof(index));
+        ifs.read((char*)&packed, sizeof(packed));
+        if(!ifs || index < 0 || index >= topPairs_.size())
+            return false;
+        //Ties go to the lower partner so the merge does not depend on the shard order
+        uint64_t current = topPairs_[index].load();
+        if(unpackScore(packed) > unpackScore(current) || (unpackScore(packed) == unpackScore(current)
+            && unpackPartner(current) != -1 && unpackPartner(packed) < unpackPartner(current)))
+            topPairs_[index] = packed;
+    }
+    if(!ifs)
+        return false;
+    
+    internalTestsCounter_ += counters[0];
+    leafTestsCounter_ += counters[1];
+    groupPairsCounter_ += counters[2];
+    prunedGroupPairsCounter_ += counters[3];
+    
+    for(int i=0; i<=MAX_CUTOFF; ++i)
+        pairwiseSignificanceCounts_[i] += counts[i];
+    raiseCutoff(cutoff);
+    settleCutoff();
+    
+    return true;
+}
+
 ostream& operator<< (ostream &out, const TopSnpList & topSnpList)
 {
     vector< pair<float, pair<int,int> > > passingPairs;
     
     
-    for(int i=0; i< topSnpList.topPartners_.size(); ++i)
+    for(int i=0; i< topSnpList.topPairs_.size(); ++i)
     {
         
-        if(topSnpList.topScores_[i] >= topSnpList.getCutoff()-1)
+        if(topSnpList.getTopScore(i) >= topSnpList.getCutoff()-1)
         {
-            //cout<< topSnpList.topScores_[i]<<endl;
-            passingPairs.push_back(   make_pair( topSnpList.topScores_[i], make_pair(i, topSnpList.topPartners_[i])       )       );
+            //cout<< topSnpList.getTopScore(i)<<endl;
+            passingPairs.push_back(   make_pair( topSnpList.getTopScore(i), make_pair(i, topSnpList.getTopPartner(i))       )       );
         }
 
 
@@ -331,6 +559,8 @@ ostream& operator<< (ostream &out, const TopSnpList & topSnpList)
     
     out<<"INTERNAL TESTS:   "<<topSnpList.internalTestsCounter_<<endl;
     out<<"LEAF TESTS:       "<<topSnpList.leafTestsCounter_<<endl;
+    out<<"GROUP PAIRS:      "<<topSnpList.groupPairsCounter_<<endl;
+    out<<"PRUNED PAIRS:     "<<topSnpList.prunedGroupPairsCounter_<<endl;
     out<<"PASSING:          "<<passingPairs.size()<<endl;
     out<<"RECIPROCALS:      "<<recips<<endl;
     
@@ -340,11 +570,11 @@ ostream& operator<< (ostream &out, const TopSnpList & topSnpList)
 void TopSnpList::calculateReciprocalPairs()
 {
     map<TopPairing, int> reciprocalCheck;
-    for(int i=0; i< topPartners_.size(); ++i)
+    for(int i=0; i< topPairs_.size(); ++i)
     {
-        if(topScores_[i] >= getCutoff()-1)
+        if(getTopScore(i) >= getCutoff()-1)
         {
-            TopPairing tempPair(i, topPartners_[i], topScores_[i]);
+            TopPairing tempPair(i, getTopPartner(i), getTopScore(i));
             
             if(reciprocalCheck.count(tempPair)>0)
                 reciprocalCheck[tempPair]++;
@@ -12,6 +12,11 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <stdint.h>
+#include <omp.h>
 
 #define MAX_CUTOFF 100
 #define PREFIX_SUM_ROLLOVER 1000
@@ -57,22 +62,51 @@ struct TopPairing
     pair<int, int> indexes_;
 };
 
+//Significance histogram counts of one thread that have not been merged into the shared histogram yet
+struct HistogramShard
+{
+    array<int, MAX_CUTOFF+1> counts_;
+    int insertsSinceMerge_;
+    //Keep neighbouring shards off the same cache line
+    char padding_[64];
+};
+
+/*
+ * Insertion is lock free on the hot path: each SNP's best (score, partner) is one packed 64 bit word
+ * updated by compare-and-swap, the cutoff is an atomic that only ever rises, and the significance
+ * histogram is counted in per-thread shards that are merged into the shared one every
+ * PREFIX_SUM_ROLLOVER inserts of that thread, when the prefix sums are also refreshed.
+ */
 class TopSnpList
 {
     public:
         TopSnpList();
         TopSnpList(const TopSnpList & cpy);
         TopSnpList(int topK, int numberSnps, float cutoff);
+        TopSnpList & operator=(const TopSnpList & cpy);
         
+        //Thread safe
         bool attemptInsert(int snpIndex1, int snpIndex2, float score);
+        //Makes sure each of numberThreads OpenMP threads has its own histogram shard, call outside parallel regions
+        void reserveThreads(int numberThreads);
+        //Merges every shard into the shared histogram, call outside parallel regions
+        void mergeShards();
         
         float getCutoff()const;
+        float getTopScore(int snpIndex)const;
+        int getTopPartner(int snpIndex)const;
         
         void incrementInternalTestsCounter(long long int testsDone);
         void incrementLeafTestsCounter(long long int testsDone);
         
         long long int getInternalTests()const;
         long long int getLeafTests()const;
+        
+        //Group pairs reached by the testing loop and those skipped by their score bound
+        void incrementGroupPairsCounter(long long int groupPairs);
+        void incrementPrunedGroupPairsCounter(long long int groupPairs);
+        long long int getGroupPairs()const;
+        long long int getPrunedGroupPairs()const;
         vector<TopPairing> getReciprocalPairs()const;
         
         void calculateFormattedResults();
@@ -88,22 +122,44 @@ class TopSnpList
         
         int getNumberOfReciprocalPairs()const;
         
+        /*
+         * Partial results of one shard of the pair space: counters, histogram, cutoff and the SNPs
+         * that have a top pair. Merging keeps the best pair of every SNP, sums the counters and
+         * histogram and raises the cutoff to what the summed histogram supports, so merging every
+         * shard gives the lists a single run would. Call outside parallel regions.
+         */
+        void writeBinary(ofstream & ofs);
+        //False when the stream does not hold a list over the same SNPs
+        bool mergeBinary(ifstream & ifs);
+        
         friend ostream& operator<< (ostream &out, const TopSnpList & topSnpList);
         
     private:
         void calculateReciprocalPairs();
         
-        vector<float> topScores_;
-        vector<int> topPartners_;
-        long long int internalTestsCounter_;
-        long long int leafTestsCounter_;
+        void mergeShard(HistogramShard & shard);
+        void raiseCutoff(float cutoff);
+        //Raises the cutoff to the highest bin the merged histogram above it supports
+        void settleCutoff();
+        bool updateTopPair(int snpIndex, int partnerIndex, float score);
+        
+        static uint64_t packPair(float score, int partner);
+        static float unpackScore(uint64_t packed);
+        static int unpackPartner(uint64_t packed);
+        
+        //Score in the high and partner in the low 32 bits
+        vector<atomic<uint64_t> > topPairs_;
+        atomic<long long int> internalTestsCounter_;
+        atomic<long long int> leafTestsCounter_;
+        atomic<long long int> groupPairsCounter_;
+        atomic<long long int> prunedGroupPairsCounter_;
         
-        float cutoff_;
+        atomic<float> cutoff_;
         int topK_;
 
-        array<int, MAX_CUTOFF+1> pairwiseSignificanceCounts_;
-        array<int, MAX_CUTOFF+1> pairwiseSignificanceCountsPrefixSum_;
-        int prefixSumTimer_;
+        array<atomic<int>, MAX_CUTOFF+1> pairwiseSignificanceCounts_;
+        array<atomic<int>, MAX_CUTOFF+1> pairwiseSignificanceCountsPrefixSum_;
+        vector<HistogramShard> shards_;
     
         //Formatted results
         vector<TopPairing> reciprocalPairs_;
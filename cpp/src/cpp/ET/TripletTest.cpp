@@ -0,0 +1,117 @@
+#include "TripletTest.h"
+
+#include <omp.h>
+
+TopTripletList::TopTripletList(int topK)
+{
+    topK_ = topK;
+    cutoff_ = 0.0;
+    testsCounter_ = 0;
+}
+
+bool TopTripletList::attemptInsert(int snpIndex1, int snpIndex2, int snpIndex3, float score)
+{
+    if(score <= cutoff_.load(memory_order_relaxed))
+        return false;
+
+    TopTriplet triplet{{snpIndex1, snpIndex2, snpIndex3}, score};
+    sort(triplet.indexes_.begin(), triplet.indexes_.end());
+
+    bool retVal = false;
+    #pragma omp critical(topTripletList)
+    {
+        if((heap_.size() < topK_ || score > heap_.front().score_) && kept_.count(triplet.indexes_) == 0)
+        {
+            if(heap_.size() == topK_)
+            {
+                kept_.erase(heap_.front().indexes_);
+                pop_heap(heap_.begin(), heap_.end(), TopTriplet::orderByScore);
+                heap_.pop_back();
+            }
+            heap_.push_back(triplet);
+            push_heap(heap_.begin(), heap_.end(), TopTriplet::orderByScore);
+            kept_.insert(triplet.indexes_);
+            if(heap_.size() == topK_)
+                cutoff_.store(heap_.front().score_, memory_order_relaxed);
+            retVal = true;
+        }
+    }
+    return retVal;
+}
+
+void TopTripletList::incrementTestsCounter(long long int testsDone)
+{
+    testsCounter_.fetch_add(testsDone, memory_order_relaxed);
+}
+
+long long int TopTripletList::getTests()const
+{
+    return testsCounter_;
+}
+
+vector<TopTriplet> TopTripletList::getTriplets()const
+{
+    vector<TopTriplet> retVal(heap_);
+    sort(retVal.begin(), retVal.end(), TopTriplet::orderByScore);
+    return retVal;
+}
+
+/*
+ * The nine pair ANDs of a sample segment are built once in a thread local buffer, then every third
+ * SNP adds its 27 cells of the segment chunk by chunk, so the chunk of the pair buffer stays in L1
+ * while all third SNPs pass over it. Instantiated for the default target and with the hardware
+ * popcount instruction like BitGemm.
+ */
+static inline __attribute__((always_inline)) void countSegment(const PACK_TYPE * pa, const PACK_TYPE * pb, const Snp * c, int nc,
+                                                                int start, int words, int cellOffset, int * counts)
+{
+    static thread_local vector<PACK_TYPE> pairPlanes;
+    if(pairPlanes.size() < GENOTYPE_PAIRINGS*words)
+        pairPlanes.resize(GENOTYPE_PAIRINGS*words);
+    for(int j=0; j<GENOTYPE_LEVELS; ++j)
+        for(int i=0; i<GENOTYPE_LEVELS; ++i)
+            for(int w=0; w<words; ++w)
+                pairPlanes[(i+GENOTYPE_LEVELS*j)*words + w] = pa[i*words + w] & pb[j*words + w];
+
+    for(int w0=0; w0<words; w0+=BITGEMM_CHUNK_WORDS)
+    {
+        int chunk = min(BITGEMM_CHUNK_WORDS, words-w0);
+        for(int k=0; k<nc; ++k)
+        {
+            const PACK_TYPE * pc = c[k].allSamples_ + start + w0;
+            int * t = counts + k*TRIPLET_CELLS + cellOffset;
+            for(int cell=0; cell<GENOTYPE_PAIRINGS; ++cell)
+            {
+                const PACK_TYPE * ab = pairPlanes.data() + cell*words + w0;
+                int c0 = 0; int c1 = 0; int c2 = 0;
+                for(int w=0; w<chunk; ++w)
+                {
+                    //Samples missing from either SNP of the pair drop out of all three
+                    if(ab[w] == 0)
+                        continue;
+                    c0 += POPCOUNT_FUNCTION(ab[w] & pc[w]);
+                    c1 += POPCOUNT_FUNCTION(ab[w] & pc[w+words]);
+                    c2 += POPCOUNT_FUNCTION(ab[w] & pc[w+2*words]);
+                }
+                t[cell] += c0;
+                t[cell + GENOTYPE_PAIRINGS] += c1;
+                t[cell + 2*GENOTYPE_PAIRINGS] += c2;
+            }
+        }
+    }
+}
+
+static inline __attribute__((always_inline)) void countTablesHelper(const Snp & a, const Snp & b, const Snp * c, int nc, int * counts)
+{
+    fill(counts, counts + nc*TRIPLET_CELLS, 0);
+    countSegment(a.allSamples_, b.allSamples_, c, nc, 0, Snp::getControlWords(), 0, counts);
+    countSegment(a.allSamples_ + Snp::getCaseStart(), b.allSamples_ + Snp::getCaseStart(), c, nc, Snp::getCaseStart(),
+                 Snp::getCaseWords(), GENOTYPE_TRIPLES, counts);
+}
+
+BITGEMM_POPCNT_KERNELS(countTables, (const Snp & a, const Snp & b, const Snp * c, int nc, int * counts), (a, b, c, nc, counts))
+
+void TripletTest::countTables(const Snp & a, const Snp & b, const Snp * c, int nc, int * counts)
+{
+    BITGEMM_POPCNT_CALL(countTables, (a, b, c, nc, counts));
+}
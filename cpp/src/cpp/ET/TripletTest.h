@@ -0,0 +1,89 @@
+/**
+ * Three-SNP interaction screening on the packed planes. Every cell of the 27x2 table of a triple is
+ * the popcount of one plane of each SNP ANDed together, so for a pair (a, b) the nine pairwise plane
+ * ANDs are formed once and then ANDed with the planes of every third SNP tested against the pair.
+ * Triples are only formed around seed pairs, the top pairs of the pairwise search, with the members
+ * of the LD groups those pairs come from as third SNPs, instead of all n^3 triples.
+ */
+
+#ifndef TRIPLET_TEST_H
+#define TRIPLET_TEST_H
+
+#include "Snp.h"
+#include "BitGemm.h"
+
+#include <vector>
+#include <array>
+#include <set>
+#include <atomic>
+#include <algorithm>
+
+#define GENOTYPE_TRIPLES (GENOTYPE_LEVELS*GENOTYPE_PAIRINGS)
+#define TRIPLET_CELLS (GENOTYPE_TRIPLES*CONTINGENCY_COLUMNS)
+//Triples kept by the top list
+#define TRIPLET_TOP_K 1000
+
+using namespace std;
+
+struct TripletContingencyTable
+{
+    //Controls then cases, cell i + 3*j + 9*k for genotypes i, j and k of the three SNPs
+    array<int, TRIPLET_CELLS> M_;
+
+    //Any statistic of Statistics.h, expects the counts to already include the plus one correction
+    template<class Statistic>
+    float score()const
+    {
+        return Statistic::template score<GENOTYPE_LEVELS, 3>(M_.data());
+    }
+};
+
+struct TopTriplet
+{
+    //Ascending SNP indexes
+    array<int, 3> indexes_;
+    float score_;
+
+    static bool orderByScore(const TopTriplet & a, const TopTriplet & b)
+    {
+        return a.score_ > b.score_;
+    }
+};
+
+/*
+ * Highest scoring distinct triples, a triple reached from several seed pairs is kept once. Inserts
+ * below the lowest kept score of a full list are turned away without taking the lock.
+ */
+class TopTripletList
+{
+    public:
+        TopTripletList(int topK);
+
+        //Thread safe
+        bool attemptInsert(int snpIndex1, int snpIndex2, int snpIndex3, float score);
+        void incrementTestsCounter(long long int testsDone);
+
+        long long int getTests()const;
+        //Highest score first
+        vector<TopTriplet> getTriplets()const;
+
+    private:
+        int topK_;
+        //Min-heap on the score
+        vector<TopTriplet> heap_;
+        set<array<int, 3> > kept_;
+        atomic<float> cutoff_;
+        atomic<long long int> testsCounter_;
+};
+
+namespace TripletTest
+{
+    /** @brief Raw cell counts of the pair (a, b) with every third SNP c[0..nc)
+     *
+     *  @param counts nc*TRIPLET_CELLS ints, triple k starts at k*TRIPLET_CELLS and is laid out as
+     *  TripletContingencyTable::M_ without the plus one correction
+     */
+    void countTables(const Snp & a, const Snp & b, const Snp * c, int nc, int * counts);
+}
+
+#endif //TRIPLET_TEST_H
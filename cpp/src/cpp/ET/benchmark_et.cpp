@@ -0,0 +1,736 @@
+/**
+ * Standalone throughput benchmarks for the epistasis test kernels on synthetic genotypes.
+ *
+ * Usage: benchmark_et [snps] [samples]
+ */
+
+#include "Snp.h"
+#include "BitGemm.h"
+#include "TopSnpList.h"
+#include "GenotypePacker.h"
+#include "TripletTest.h"
+#include "QuantitativeTrait.h"
+#include "LDClustering.h"
+#include "SeenPairFilter.h"
+#include "LDForest.h"
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <omp.h>
+
+//Repeats of the timings that vary with the load of the machine, the fastest is reported
+#define BENCHMARK_REPEATS 3
+
+using namespace std;
+
+static vector<char> randomGenotypes(mt19937 & generator, int samples)
+{
+    uniform_real_distribution<float> uniform(0.0, 1.0);
+    float maf = 0.05 + 0.45*uniform(generator);
+
+    vector<char> genotypes(samples);
+    for(int i=0; i<samples; ++i)
+    {
+        float r = uniform(generator);
+        genotypes[i] = r < maf*maf ? '2' : (r < maf*maf + 2*maf*(1-maf) ? '1' : '0');
+    }
+    return genotypes;
+}
+
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+//Per-pair Snp::epistasisTest loop against the blocked bit-GEMM kernel on the same A x B block
+static void benchmarkBitGemm(const vector<Snp> & snps)
+{
+    int half = snps.size()/2;
+    const Snp * a = snps.data();
+    const Snp * b = snps.data() + half;
+    long long int pairs = (long long int)half*half;
+
+    vector<float> perPairScores(pairs);
+    auto start = chrono::steady_clock::now();
+    for(int i=0; i<half; ++i)
+        for(int j=0; j<half; ++j)
+            perPairScores[i*half+j] = a[i].epistasisTest(b[j]);
+    double perPairTime = secondsSince(start);
+
+    vector<float> kernelScores(pairs);
+    vector<ContingencyTable> tables(pairs);
+    start = chrono::steady_clock::now();
+    BitGemm::contingencyTables(a, half, b, half, tables.data());
+    for(long long int p=0; p<pairs; ++p)
+        kernelScores[p] = tables[p].chiSquare();
+    double kernelTime = secondsSince(start);
+
+    int mismatches = 0;
+    for(long long int p=0; p<pairs; ++p)
+        if(perPairScores[p] != kernelScores[p])
+            mismatches++;
+
+    cout<<"bitgemm\t"<<half<<"x"<<half<<" pairs"<<endl;
+    cout<<"\tper-pair loop: "<<pairs/perPairTime<<" pair tests/s"<<endl;
+    cout<<"\tbit-GEMM:      "<<pairs/kernelTime<<" pair tests/s ("<<perPairTime/kernelTime<<"x)"<<endl;
+    cout<<"\tmismatched scores: "<<mismatches<<endl;
+}
+
+struct ScoredPair
+{
+    int snpIndex1;
+    int snpIndex2;
+    float score;
+};
+
+static double insertAll(TopSnpList & topSnpList, const vector<ScoredPair> & pairs, int threads, bool locked)
+{
+    topSnpList.reserveThreads(threads);
+    auto start = chrono::steady_clock::now();
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for(int p=0; p<pairs.size(); ++p)
+    {
+        if(locked)
+        {
+            #pragma omp critical
+            topSnpList.attemptInsert(pairs[p].snpIndex1, pairs[p].snpIndex2, pairs[p].score);
+        }
+        else
+            topSnpList.attemptInsert(pairs[p].snpIndex1, pairs[p].snpIndex2, pairs[p].score);
+    }
+    return secondsSince(start);
+}
+
+//Insert throughput of TopSnpList from 1 to 64 threads, against every insert serialized by a critical section
+static void benchmarkTopSnpList(int numberSnps)
+{
+    const int inserts = 1<<22;
+    mt19937 generator(7);
+    uniform_int_distribution<int> snp(0, numberSnps-1);
+    chi_squared_distribution<float> score(8);
+
+    vector<ScoredPair> pairs(inserts);
+    for(int p=0; p<inserts; ++p)
+        pairs[p] = ScoredPair{snp(generator), snp(generator), score(generator)};
+
+    cout<<"topsnplist\t"<<inserts<<" inserts"<<endl;
+    for(int threads=1; threads<=64; threads*=2)
+    {
+        TopSnpList lockFree(numberSnps, numberSnps, 0);
+        TopSnpList locked(numberSnps, numberSnps, 0);
+        double lockFreeTime = insertAll(lockFree, pairs, threads, false);
+        double lockedTime = insertAll(locked, pairs, threads, true);
+
+        cout<<"\t"<<threads<<" threads: "<<inserts/lockFreeTime<<" inserts/s lock free, "
+            <<inserts/lockedTime<<" inserts/s critical section, cutoff "<<lockFree.getCutoff()<<endl;
+    }
+}
+
+//Byte path against the blocked scalar path on a samples x SNPs int8 matrix split by a label vector
+static void benchmarkPacking(int numberSnps, int numberSamples)
+{
+    mt19937 generator(3);
+    vector<int8_t> genotypes((size_t)numberSnps*numberSamples);
+    for(int i=0; i<numberSnps; ++i)
+    {
+        vector<char> column = randomGenotypes(generator, numberSamples);
+        for(int j=0; j<numberSamples; ++j)
+            genotypes[(size_t)i*numberSamples + j] = column[j] - '0';
+    }
+    
+    vector<int> labels(numberSamples);
+    for(int j=0; j<numberSamples; ++j)
+        labels[j] = generator() % 2;
+    vector<int> controlSamples;
+    vector<int> caseSamples;
+    GenotypePacker::splitSamples(labels.data(), numberSamples, controlSamples, caseSamples);
+    
+    vector<int> snpRows(numberSnps);
+    for(int i=0; i<numberSnps; ++i)
+        snpRows[i] = i;
+    GenotypeLayout layout = {(size_t)numberSamples, 1, snpRows.data()};
+    
+    shared_ptr<GenotypeArena> bytePath = make_shared<GenotypeArena>(numberSnps, controlSamples.size(), caseSamples.size());
+    shared_ptr<GenotypeArena> blockPath = make_shared<GenotypeArena>(numberSnps, controlSamples.size(), caseSamples.size());
+    vector<Snp> byteSnps;
+    vector<Snp> blockSnps;
+    for(int i=0; i<numberSnps; ++i)
+    {
+        byteSnps.push_back(Snp(i, bytePath, i, 0));
+        blockSnps.push_back(Snp(i, blockPath, i, 0));
+    }
+    
+    auto start = chrono::steady_clock::now();
+    #pragma omp parallel for schedule(dynamic)
+    for(int b=0; b<numberSnps; b+=PACK_SNP_BLOCK)
+    {
+        int count = min(PACK_SNP_BLOCK, numberSnps-b);
+        GenotypePacker::packBlock(genotypes.data(), layout, controlSamples, &blockSnps[b], count, 0, Snp::getControlWords());
+        GenotypePacker::packBlock(genotypes.data(), layout, caseSamples, &blockSnps[b], count, Snp::getCaseStart(), Snp::getCaseWords());
+    }
+    double blockTime = secondsSince(start);
+    
+    start = chrono::steady_clock::now();
+    GenotypePacker::packSnps(genotypes.data(), layout, controlSamples, caseSamples, byteSnps, omp_get_max_threads());
+    double byteTime = secondsSince(start);
+    
+    int mismatches = 0;
+    for(int i=0; i<numberSnps; ++i)
+        if(!equal(byteSnps[i].allSamples_, byteSnps[i].allSamples_ + Snp::getPlaneWords(), blockSnps[i].allSamples_))
+            mismatches++;
+    
+    cout<<"packing\t"<<numberSnps<<" SNPs, "<<omp_get_max_threads()<<" threads"<<endl;
+    cout<<"\tblocked scalar: "<<numberSnps/blockTime<<" SNPs/s"<<endl;
+    cout<<"\tbyte path:      "<<numberSnps/byteTime<<" SNPs/s ("<<blockTime/byteTime<<"x), "
+        <<173000*byteTime/numberSnps<<"s for 173k SNPs"<<endl;
+    cout<<"\tmismatched SNPs: "<<mismatches<<endl;
+}
+
+//Cells of one triple from three-way ANDs of the planes, the plain loop the kernel replaces
+static void naiveTripletCounts(const Snp & a, const Snp & b, const Snp & c, int * counts)
+{
+    int segmentStarts[CONTINGENCY_COLUMNS] = {0, Snp::getCaseStart()};
+    int segmentWords[CONTINGENCY_COLUMNS] = {Snp::getControlWords(), Snp::getCaseWords()};
+    for(int s=0; s<CONTINGENCY_COLUMNS; ++s)
+    {
+        int words = segmentWords[s];
+        const PACK_TYPE * pa = a.allSamples_ + segmentStarts[s];
+        const PACK_TYPE * pb = b.allSamples_ + segmentStarts[s];
+        const PACK_TYPE * pc = c.allSamples_ + segmentStarts[s];
+        for(int k=0; k<GENOTYPE_LEVELS; ++k)
+            for(int j=0; j<GENOTYPE_LEVELS; ++j)
+                for(int i=0; i<GENOTYPE_LEVELS; ++i)
+                {
+                    int count = 0;
+                    for(int w=0; w<words; ++w)
+                        count += POPCOUNT_FUNCTION(pa[i*words+w] & pb[j*words+w] & pc[k*words+w]);
+                    counts[s*GENOTYPE_TRIPLES + i + GENOTYPE_LEVELS*j + GENOTYPE_PAIRINGS*k] = count;
+                }
+    }
+}
+
+//Triple tests per second of the pair-AND reuse kernel against three-way ANDs per triple, seed pairs x third SNPs
+static void benchmarkTriplets(const vector<Snp> & snps)
+{
+    int seeds = min(16, (int)snps.size()/2);
+    int thirds = snps.size() - 2*seeds;
+    long long int triples = (long long int)seeds*thirds;
+    
+    vector<int> naiveCounts(triples*TRIPLET_CELLS);
+    auto start = chrono::steady_clock::now();
+    for(int s=0; s<seeds; ++s)
+        for(int k=0; k<thirds; ++k)
+            naiveTripletCounts(snps[2*s], snps[2*s+1], snps[2*seeds+k], naiveCounts.data() + ((long long int)s*thirds+k)*TRIPLET_CELLS);
+    double naiveTime = secondsSince(start);
+    
+    vector<int> kernelCounts(triples*TRIPLET_CELLS);
+    start = chrono::steady_clock::now();
+    for(int s=0; s<seeds; ++s)
+        TripletTest::countTables(snps[2*s], snps[2*s+1], &snps[2*seeds], thirds, kernelCounts.data() + (long long int)s*thirds*TRIPLET_CELLS);
+    double kernelTime = secondsSince(start);
+    
+    long long int mismatches = 0;
+    for(long long int t=0; t<triples; ++t)
+        if(!equal(naiveCounts.begin() + t*TRIPLET_CELLS, naiveCounts.begin() + (t+1)*TRIPLET_CELLS, kernelCounts.begin() + t*TRIPLET_CELLS))
+            mismatches++;
+    
+    cout<<"triplets\t"<<seeds<<" seed pairs x "<<thirds<<" third SNPs"<<endl;
+    cout<<"\tthree-way ANDs:  "<<triples/naiveTime<<" triple tests/s"<<endl;
+    cout<<"\tpair AND reuse:  "<<triples/kernelTime<<" triple tests/s ("<<naiveTime/kernelTime<<"x)"<<endl;
+    cout<<"\tmismatched tables: "<<mismatches<<endl;
+}
+
+template<class Statistic>
+static double scoreAll(const vector<ContingencyTable> & tables, vector<float> & scores)
+{
+    auto start = chrono::steady_clock::now();
+    for(long long int p=0; p<tables.size(); ++p)
+        scores[p] = tables[p].score<Statistic>();
+    return secondsSince(start);
+}
+
+//Scores per second of every statistic policy on the same corrected pair tables
+static void benchmarkStatistics(const vector<Snp> & snps)
+{
+    int half = snps.size()/2;
+    long long int pairs = (long long int)half*half;
+    vector<ContingencyTable> tables(pairs);
+    BitGemm::contingencyTables(snps.data(), half, snps.data() + half, half, tables.data());
+    
+    vector<float> chiSquares(pairs);
+    for(long long int p=0; p<pairs; ++p)
+        chiSquares[p] = tables[p].chiSquare();
+    vector<float> scores(pairs);
+    
+    cout<<"statistics\t"<<pairs<<" pair tables"<<endl;
+    double time = scoreAll<PearsonChiSquare>(tables, scores);
+    int mismatches = 0;
+    for(long long int p=0; p<pairs; ++p)
+        if(scores[p] != chiSquares[p])
+            mismatches++;
+    cout<<"\tchi-square:           "<<pairs/time<<" tables/s, "<<mismatches<<" mismatched scores"<<endl;
+    time = scoreAll<GTest>(tables, scores);
+    cout<<"\tG-test:               "<<pairs/time<<" tables/s"<<endl;
+    time = scoreAll<MutualInformation>(tables, scores);
+    cout<<"\tmutual information:   "<<pairs/time<<" tables/s"<<endl;
+    time = scoreAll<InteractionContrast>(tables, scores);
+    cout<<"\tinteraction contrast: "<<pairs/time<<" tables/s"<<endl;
+}
+
+//Collapsed model tables from the ORed planes against the genotype tables summed into the model's levels
+template<class Model>
+static void benchmarkModel(const vector<Snp> & snps, const char * name)
+{
+    int half = snps.size()/2;
+    long long int pairs = (long long int)half*half;
+    const int cells = Model::levels*Model::levels*CONTINGENCY_COLUMNS;
+    
+    vector<int> genotypeCounts(pairs*TABLE_CELLS);
+    vector<int> collapsedCounts(pairs*cells);
+    auto start = chrono::steady_clock::now();
+    BitGemm::countTables(snps.data(), half, snps.data() + half, half, genotypeCounts.data());
+    for(long long int p=0; p<pairs; ++p)
+        collapseCounts<Model, 2>(genotypeCounts.data() + p*TABLE_CELLS, collapsedCounts.data() + p*cells);
+    double collapseTime = secondsSince(start);
+    
+    vector<int> kernelCounts(pairs*cells);
+    start = chrono::steady_clock::now();
+    BitGemm::countModelTables<Model>(snps.data(), half, snps.data() + half, half, kernelCounts.data());
+    double kernelTime = secondsSince(start);
+    
+    long long int mismatches = 0;
+    for(long long int p=0; p<pairs; ++p)
+        if(!equal(collapsedCounts.begin() + p*cells, collapsedCounts.begin() + (p+1)*cells, kernelCounts.begin() + p*cells))
+            mismatches++;
+    
+    cout<<"\t"<<name<<": genotype tables summed "<<pairs/collapseTime<<" tables/s, ORed planes "<<pairs/kernelTime
+        <<" tables/s ("<<collapseTime/kernelTime<<"x), "<<mismatches<<" mismatched tables"<<endl;
+}
+
+static void benchmarkModels(const vector<Snp> & snps)
+{
+    cout<<"models\t"<<snps.size()/2<<"x"<<snps.size()/2<<" pairs"<<endl;
+    benchmarkModel<DominantModel>(snps, "dominant");
+    benchmarkModel<RecessiveModel>(snps, "recessive");
+}
+
+//Case-only tables from the case segment against the case cells of the full case/control tables
+static void benchmarkCaseOnly(const vector<Snp> & snps)
+{
+    int half = snps.size()/2;
+    long long int pairs = (long long int)half*half;
+    
+    vector<int> fullCounts(pairs*TABLE_CELLS);
+    auto start = chrono::steady_clock::now();
+    BitGemm::countTables(snps.data(), half, snps.data() + half, half, fullCounts.data());
+    double fullTime = secondsSince(start);
+    
+    vector<int> caseCounts(pairs*GENOTYPE_PAIRINGS);
+    start = chrono::steady_clock::now();
+    BitGemm::countCaseTables(snps.data(), half, snps.data() + half, half, caseCounts.data());
+    double caseTime = secondsSince(start);
+    
+    long long int mismatches = 0;
+    for(long long int p=0; p<pairs; ++p)
+        if(!equal(caseCounts.begin() + p*GENOTYPE_PAIRINGS, caseCounts.begin() + (p+1)*GENOTYPE_PAIRINGS,
+                  fullCounts.begin() + p*TABLE_CELLS + GENOTYPE_PAIRINGS))
+            mismatches++;
+    
+    cout<<"case-only\t"<<half<<"x"<<half<<" pairs, "<<Snp::getCaseWords()<<" of "<<Snp::getControlWords() + Snp::getCaseWords()<<" words"<<endl;
+    cout<<"\tcase/control tables: "<<pairs/fullTime<<" tables/s"<<endl;
+    cout<<"\tcase-only tables:    "<<pairs/caseTime<<" tables/s ("<<fullTime/caseTime<<"x)"<<endl;
+    cout<<"\tmismatched tables: "<<mismatches<<endl;
+}
+
+/*
+ * Tables and popcovers of rare variants from the sparse segments of an indexed arena against the same
+ * planes read dense. Half the SNPs have a minor allele frequency under 0.5% and the rest are common,
+ * with one genotype in 500 unknown.
+ */
+static void benchmarkSparse(int numberSnps, int numberSamples)
+{
+    mt19937 generator(11);
+    uniform_real_distribution<float> uniform(0.0, 1.0);
+    int half = numberSnps/2;
+    vector<int8_t> genotypes((size_t)numberSnps*numberSamples);
+    for(int i=0; i<numberSnps; ++i)
+    {
+        float maf = i < half ? 0.0005 + 0.0045*uniform(generator) : 0.05 + 0.45*uniform(generator);
+        for(int j=0; j<numberSamples; ++j)
+        {
+            float r = uniform(generator);
+            int8_t genotype = r < maf*maf ? 2 : (r < maf*maf + 2*maf*(1-maf) ? 1 : 0);
+            genotypes[(size_t)i*numberSamples + j] = uniform(generator) < 0.002 ? -1 : genotype;
+        }
+    }
+
+    //The same split as the other benchmarks so the shared layout is unchanged
+    vector<int> controlSamples;
+    vector<int> caseSamples;
+    for(int j=0; j<numberSamples; ++j)
+        (j < numberSamples/2 ? controlSamples : caseSamples).push_back(j);
+    vector<int> snpRows(numberSnps);
+    for(int i=0; i<numberSnps; ++i)
+        snpRows[i] = i;
+    GenotypeLayout layout = {(size_t)numberSamples, 1, snpRows.data()};
+
+    shared_ptr<GenotypeArena> denseArena = make_shared<GenotypeArena>(numberSnps, controlSamples.size(), caseSamples.size());
+    vector<Snp> dense;
+    for(int i=0; i<numberSnps; ++i)
+        dense.push_back(Snp(i, denseArena, i, 0));
+    GenotypePacker::packSnps(genotypes.data(), layout, controlSamples, caseSamples, dense, omp_get_max_threads());
+
+    vector<int> slots(numberSnps);
+    for(int i=0; i<numberSnps; ++i)
+        slots[i] = i;
+    shared_ptr<GenotypeArena> indexedArena = denseArena->gather(slots);
+    auto start = chrono::steady_clock::now();
+    indexedArena->indexSparseSegments(omp_get_max_threads());
+    double indexTime = secondsSince(start);
+    vector<Snp> indexed;
+    int sparseSegments = 0;
+    for(int i=0; i<numberSnps; ++i)
+    {
+        indexed.push_back(Snp(i, indexedArena, i, 0));
+        sparseSegments += indexed[i].getSparseSegments()[0].sparse_ + indexed[i].getSparseSegments()[1].sparse_;
+    }
+
+    cout<<"sparse	"<<half<<" rare and "<<numberSnps-half<<" common SNPs, "<<sparseSegments<<" of "<<2*numberSnps
+        <<" segments sparse, indexed in "<<indexTime<<"s"<<endl;
+
+    const char * names[2] = {"rare x rare", "rare x common"};
+    for(int block=0; block<2; ++block)
+    {
+        const Snp * b = block == 0 ? &dense[0] : &dense[half];
+        const Snp * sparseB = block == 0 ? &indexed[0] : &indexed[half];
+        int nb = block == 0 ? half : numberSnps - half;
+        long long int pairs = (long long int)half*nb;
+
+        vector<int> denseCounts(pairs*TABLE_CELLS);
+        vector<int> sparseCounts(pairs*TABLE_CELLS);
+        start = chrono::steady_clock::now();
+        BitGemm::countTables(dense.data(), half, b, nb, denseCounts.data());
+        double denseTime = secondsSince(start);
+        start = chrono::steady_clock::now();
+        BitGemm::countTables(indexed.data(), half, sparseB, nb, sparseCounts.data());
+        double sparseTime = secondsSince(start);
+
+        vector<int> densePopCovers(pairs);
+        vector<int> sparsePopCovers(pairs);
+        start = chrono::steady_clock::now();
+        BitGemm::popCovers(dense.data(), half, b, nb, densePopCovers.data());
+        double densePopCoverTime = secondsSince(start);
+        start = chrono::steady_clock::now();
+        BitGemm::popCovers(indexed.data(), half, sparseB, nb, sparsePopCovers.data());
+        double sparsePopCoverTime = secondsSince(start);
+
+        long long int mismatches = 0;
+        for(long long int p=0; p<pairs; ++p)
+            if(!equal(denseCounts.begin() + p*TABLE_CELLS, denseCounts.begin() + (p+1)*TABLE_CELLS, sparseCounts.begin() + p*TABLE_CELLS)
+               || densePopCovers[p] != sparsePopCovers[p])
+                mismatches++;
+
+        cout<<"	"<<names[block]<<": dense "<<pairs/denseTime<<" tables/s, sparse "<<pairs/sparseTime<<" tables/s ("
+            <<denseTime/sparseTime<<"x), popcovers "<<densePopCoverTime/sparsePopCoverTime<<"x, "<<mismatches<<" mismatched pairs"<<endl;
+    }
+}
+
+//Pairs of SNPs sharing a cluster
+static long long int clusteredPairs(const vector<vector<int>> & clusters)
+{
+    long long int retVal = 0;
+    for(int c=0; c<clusters.size(); ++c)
+        retVal += (long long int)clusters[c].size()*(clusters[c].size()-1)/2;
+    return retVal;
+}
+
+/*
+ * Hashed LD clustering against comparing every pair in LD range, on blocks of 1 to 8 copies of a
+ * founder SNP with 1% of the genotypes redrawn, 1kb apart on one chromosome. Recall is the share of
+ * the pairs clustered together by the reference that the hashed clustering also puts together.
+ */
+static void benchmarkLDClustering(int numberSnps, int numberSamples)
+{
+    mt19937 generator(13);
+    uniform_real_distribution<float> uniform(0.0, 1.0);
+    uniform_int_distribution<int> blockSize(1, 8);
+    vector<Snp> snps;
+    vector<GenomeLocation> locations;
+    while(snps.size() < numberSnps)
+    {
+        vector<char> founder = randomGenotypes(generator, numberSamples);
+        vector<char> redrawn = randomGenotypes(generator, numberSamples);
+        for(int copies=blockSize(generator); copies>0 && snps.size()<numberSnps; --copies)
+        {
+            vector<char> genotypes = founder;
+            for(int j=0; j<numberSamples; ++j)
+                if(uniform(generator) < 0.01)
+                    genotypes[j] = redrawn[j];
+            vector<char> controls(genotypes.begin(), genotypes.begin() + numberSamples/2);
+            vector<char> cases(genotypes.begin() + numberSamples/2, genotypes.end());
+            locations.push_back(GenomeLocation('1', 1000*snps.size()));
+            snps.push_back(Snp(snps.size(), controls, cases, 0));
+        }
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<vector<int>> hashed = LDClustering::cluster(snps, locations, 0.1, omp_get_max_threads());
+    double hashedTime = secondsSince(start);
+    start = chrono::steady_clock::now();
+    vector<vector<int>> allPairs = LDClustering::clusterAllPairs(snps, locations, 0.1, omp_get_max_threads());
+    double allPairsTime = secondsSince(start);
+
+    //Every hashed cluster lies within a reference one, so the shared pairs are those of the hashed clusters
+    vector<int> referenceCluster(numberSnps);
+    for(int c=0; c<allPairs.size(); ++c)
+        for(int k=0; k<allPairs[c].size(); ++k)
+            referenceCluster[allPairs[c][k]] = c;
+    long long int outside = 0;
+    for(int c=0; c<hashed.size(); ++c)
+        for(int k=1; k<hashed[c].size(); ++k)
+            outside += referenceCluster[hashed[c][k]] != referenceCluster[hashed[c][0]];
+
+    cout<<"ld clustering	"<<numberSnps<<" SNPs: hashed "<<hashed.size()<<" groups in "<<hashedTime<<"s, all pairs "<<allPairs.size()
+        <<" groups in "<<allPairsTime<<"s ("<<allPairsTime/hashedTime<<"x), pair recall "
+        <<(double)clusteredPairs(hashed)/clusteredPairs(allPairs)<<", "<<outside<<" SNPs outside their reference group"<<endl;
+}
+
+//Distinct pairs marked from every thread, then marked again: the first pass gives the false positive rate, the second must see them all
+static void benchmarkSeenPairFilter(int numberSnps)
+{
+    long long int pairs = (long long int)numberSnps*(numberSnps-1)/2;
+    SeenPairFilter filter(pairs);
+    long long int seen[2] = {0, 0};
+    double seconds[2];
+    for(int pass=0; pass<2; ++pass)
+    {
+        long long int passSeen = 0;
+        auto start = chrono::steady_clock::now();
+        #pragma omp parallel for schedule(dynamic, 64) reduction(+:passSeen)
+        for(int i=0; i<numberSnps; ++i)
+            for(int j=i+1; j<numberSnps; ++j)
+                passSeen += filter.testAndSet(i, j);
+        seconds[pass] = secondsSince(start);
+        seen[pass] = passSeen;
+    }
+
+    cout<<"seen pairs	"<<pairs<<" pairs: "<<pairs/seconds[0]<<" marks/s, false positive rate "<<(double)seen[0]/pairs
+        <<", "<<pairs-seen[1]<<" marked pairs missed"<<endl;
+}
+
+/*
+ * Cell moments of a quantitative trait from the bit-sliced trait planes against a scalar loop over the
+ * samples of every pair. The trait is drawn as integers spanning 0 to 255 so its fixed-point values
+ * are the integers themselves. Its Snps hold every sample in place, so it runs after the others.
+ */
+static void benchmarkQuantitative(int numberSnps, int numberSamples)
+{
+    mt19937 generator(7);
+    int half = min(256, numberSnps/2);
+    long long int pairs = (long long int)half*half;
+    vector<vector<char> > genotypes;
+    vector<Snp> snps;
+    for(int i=0; i<2*half; ++i)
+    {
+        genotypes.push_back(randomGenotypes(generator, numberSamples));
+        snps.push_back(Snp(i, genotypes.back(), vector<char>(), 0));
+    }
+    vector<double> values(numberSamples);
+    for(int j=0; j<numberSamples; ++j)
+        values[j] = j < 2 ? 255*j : generator() % 256;
+    QuantitativeTrait trait(values);
+    
+    vector<TraitMoments> scalarMoments(pairs);
+    auto start = chrono::steady_clock::now();
+    for(int i=0; i<half; ++i)
+        for(int j=0; j<half; ++j)
+        {
+            TraitMoments & moments = scalarMoments[i*half+j];
+            long long int sums[GENOTYPE_PAIRINGS] = {0};
+            long long int squares = 0;
+            fill(moments.counts_, moments.counts_ + GENOTYPE_PAIRINGS, 0);
+            const char * ga = genotypes[i].data();
+            const char * gb = genotypes[half+j].data();
+            for(int s=0; s<numberSamples; ++s)
+            {
+                int cell = (ga[s]-'0') + GENOTYPE_LEVELS*(gb[s]-'0');
+                int value = values[s];
+                moments.counts_[cell]++;
+                sums[cell] += value;
+                squares += value*value;
+            }
+            for(int c=0; c<GENOTYPE_PAIRINGS; ++c)
+                moments.sums_[c] = sums[c];
+            moments.squares_ = squares;
+        }
+    double scalarTime = secondsSince(start);
+    
+    vector<TraitMoments> kernelMoments(pairs);
+    start = chrono::steady_clock::now();
+    trait.cellMoments(snps.data(), half, snps.data() + half, half, kernelMoments.data());
+    double kernelTime = secondsSince(start);
+    
+    long long int mismatches = 0;
+    for(long long int p=0; p<pairs; ++p)
+        if(!equal(scalarMoments[p].counts_, scalarMoments[p].counts_ + GENOTYPE_PAIRINGS, kernelMoments[p].counts_) ||
+           !equal(scalarMoments[p].sums_, scalarMoments[p].sums_ + GENOTYPE_PAIRINGS, kernelMoments[p].sums_) ||
+           scalarMoments[p].squares_ != kernelMoments[p].squares_)
+            mismatches++;
+    
+    start = chrono::steady_clock::now();
+    float best = 0.0;
+    for(long long int p=0; p<pairs; ++p)
+        best = max(best, QuantitativeTrait::interactionScore(kernelMoments[p]));
+    double scoreTime = secondsSince(start);
+    
+    cout<<"quantitative	"<<half<<"x"<<half<<" pairs, "<<TRAIT_BITS<<" bit trait"<<endl;
+    cout<<"	scalar loop:    "<<pairs/scalarTime<<" pairs/s"<<endl;
+    cout<<"	bit-sliced:     "<<pairs/kernelTime<<" pairs/s ("<<scalarTime/kernelTime<<"x)"<<endl;
+    cout<<"	interaction:    "<<pairs/scoreTime<<" scores/s, largest "<<best<<endl;
+    cout<<"	mismatched moments: "<<mismatches<<endl;
+}
+
+//Snps of numberSamples samples packed into one arena, the second half of the samples are the cases
+static vector<Snp> packCohort(int numberSnps, int numberSamples, mt19937 & generator)
+{
+    vector<int8_t> genotypes((size_t)numberSnps*numberSamples);
+    for(int i=0; i<numberSnps; ++i)
+    {
+        vector<char> column = randomGenotypes(generator, numberSamples);
+        for(int j=0; j<numberSamples; ++j)
+            genotypes[(size_t)i*numberSamples + j] = column[j] - '0';
+    }
+
+    vector<int> controlSamples;
+    vector<int> caseSamples;
+    for(int j=0; j<numberSamples; ++j)
+        (j < numberSamples/2 ? controlSamples : caseSamples).push_back(j);
+    vector<int> snpRows(numberSnps);
+    for(int i=0; i<numberSnps; ++i)
+        snpRows[i] = i;
+    GenotypeLayout layout = {(size_t)numberSamples, 1, snpRows.data()};
+
+    shared_ptr<GenotypeArena> arena = make_shared<GenotypeArena>(numberSnps, controlSamples.size(), caseSamples.size());
+    vector<Snp> retVal;
+    for(int i=0; i<numberSnps; ++i)
+        retVal.push_back(Snp(i, arena, i, 0));
+    GenotypePacker::packSnps(genotypes.data(), layout, controlSamples, caseSamples, retVal, omp_get_max_threads());
+    return retVal;
+}
+
+/*
+ * LDForest::testGroups over groups of BITGEMM_TILE SNPs at cohort sizes where a SNP's planes outgrow
+ * the caches, up to biobank scale, against the same group pairs tested in a plain loop, so the tiles
+ * and scheduler show next to the blocked kernels. Mutual information has no pruning bound, so both
+ * test every group pair. The forest's own progress output is dropped. Each cohort has its own layout,
+ * so it runs last.
+ */
+static void benchmarkTestGroups()
+{
+    const int numberSnps = 1024;
+    const int groupSize = BITGEMM_TILE;
+    const int numberGroups = numberSnps/groupSize;
+    const int cohorts[3] = {10000, 100000, 500000};
+    long long int groupPairs = (long long int)numberGroups*(numberGroups-1)/2;
+    int threads = omp_get_max_threads();
+
+    cout<<"test groups\t"<<numberGroups<<" groups of "<<groupSize<<" SNPs, "<<threads<<" threads"<<endl;
+    for(int c=0; c<3; ++c)
+    {
+        int numberSamples = cohorts[c];
+        mt19937 generator(5);
+        vector<Snp> snps = packCohort(numberSnps, numberSamples, generator);
+        //Every SNP out of LD range of the others
+        vector<GenomeLocation> locations;
+        for(int i=0; i<numberSnps; ++i)
+            locations.push_back(GenomeLocation(1 + i/512, (i%512)*2*ESTIMATED_LD_RANGE));
+        vector<vector<int>> clusters(numberGroups);
+        for(int i=0; i<numberSnps; ++i)
+            clusters[i/groupSize].push_back(i);
+
+        vector<LDGroup> groups;
+        for(int g=0; g<numberGroups; ++g)
+        {
+            groups.push_back(LDGroup(&snps[g*groupSize], &locations[g*groupSize], groupSize));
+            groups.back().summarize();
+        }
+        ParameterInfo parameterInfo = ParameterInfo();
+        parameterInfo.maxThreadUsage_ = threads;
+        parameterInfo.statistic_ = MUTUAL_INFORMATION;
+        parameterInfo.model_ = GENOTYPIC_MODEL;
+        parameterInfo.noTrees_ = 1;
+        parameterInfo.numberShards_ = 1;
+
+        //The fastest of alternating repeats, each into fresh lists
+        double forestTime = 0.0;
+        double pairTime = 0.0;
+        long long int mismatches = 0;
+        for(int repeat=0; repeat<BENCHMARK_REPEATS; ++repeat)
+        {
+            streambuf * coutBuffer = cout.rdbuf(NULL);
+            LDForest forest(numberSnps, snps[0].getControlNo(), snps[0].getCaseNo(), numberSnps);
+            for(int i=0; i<numberSnps; ++i)
+                forest.insert(snps[i], locations[i]);
+            forest.createGroups(clusters);
+            auto start = chrono::steady_clock::now();
+            forest.testGroups(threads, parameterInfo);
+            double seconds = secondsSince(start);
+            cout.rdbuf(coutBuffer);
+            forestTime = repeat == 0 ? seconds : min(forestTime, seconds);
+
+            TopSnpList reference(numberSnps, numberSnps, 0);
+            reference.reserveThreads(threads);
+            start = chrono::steady_clock::now();
+            #pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+            for(int i=0; i<numberGroups; ++i)
+                for(int j=i+1; j<numberGroups; ++j)
+                    groups[i].epistasisTest<MutualInformation, GenotypicModel>(groups[j], reference);
+            seconds = secondsSince(start);
+            pairTime = repeat == 0 ? seconds : min(pairTime, seconds);
+
+            const TopSnpList & tested = forest.getTopSnpList();
+            mismatches += tested.getLeafTests() != reference.getLeafTests();
+            for(int i=0; i<numberSnps; ++i)
+                mismatches += tested.getTopScore(i) != reference.getTopScore(i) || tested.getTopPartner(i) != reference.getTopPartner(i);
+        }
+        cout<<"\t"<<numberSamples<<" samples: pair at a time "<<groupPairs/pairTime<<" group pairs/s, testGroups "<<groupPairs/forestTime
+            <<" group pairs/s ("<<pairTime/forestTime<<"x), "<<mismatches<<" mismatched SNPs"<<endl;
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    int numberSnps = argc > 1 ? atoi(argv[1]) : 1024;
+    int numberSamples = argc > 2 ? atoi(argv[2]) : 2000;
+
+    mt19937 generator(42);
+    CountTable::reserve(numberSamples + TRIPLET_CELLS);
+    vector<Snp> snps;
+    snps.reserve(numberSnps);
+    for(int i=0; i<numberSnps; ++i)
+    {
+        vector<char> genotypes = randomGenotypes(generator, numberSamples);
+        vector<char> controls(genotypes.begin(), genotypes.begin() + numberSamples/2);
+        vector<char> cases(genotypes.begin() + numberSamples/2, genotypes.end());
+        snps.push_back(Snp(i, controls, cases, 0));
+    }
+
+    cout<<"---Benchmark "<<numberSnps<<" SNPs, "<<numberSamples<<" samples"<<endl;
+    benchmarkBitGemm(snps);
+    benchmarkTopSnpList(numberSnps);
+    benchmarkPacking(numberSnps, numberSamples);
+    benchmarkTriplets(snps);
+    benchmarkStatistics(snps);
+    benchmarkModels(snps);
+    benchmarkCaseOnly(snps);
+    benchmarkSparse(numberSnps, numberSamples);
+    benchmarkLDClustering(8*numberSnps, numberSamples);
+    benchmarkSeenPairFilter(4*numberSnps);
+    benchmarkQuantitative(numberSnps, numberSamples);
+    benchmarkTestGroups();
+
+    return 0;
+}
@@ -19,12 +19,16 @@
 #include "mex.h"
 #include "matrix.h"
 #include "CommonStructs.h"
-#include "Matrix.h"
-#include "MatrixMath.h"
 #include "Snp.h"
+#include "GenotypePacker.h"
+#include "SnpPipeline.h"
+#include "PhenotypeSet.h"
+#include "PermutationTest.h"
+#include "QuantitativeTrait.h"
 #include "TopSnpList.h"
 #include "FilePath.h"
 #include "LDForest.h"
+#include "SnpInfo.h"
 
 #include <string>
 #include <vector>
@@ -39,31 +43,437 @@ const static array<float, 7> chi2DegreesFreedomTable{0, 2.71, 6.63, 10.82, 15.14
 /*
 	Input								Type						Size						
 	------------------------------		-------						-------------------
-	Case Features (X_1)					double						c x n matrix
-	Control Features (X_2)				double						m-c x n matrix
+	Features (X)						double/int8/uint8/logical	m x n or n x m matrix
+	Labels (Y)							logical/numeric				m vector, nonzero for cases, or m x p
+                                                                    matrix with one column per phenotype
 	SNP info (I)						string						n x 3 sparse matrix
 	Group ids (G) 						integer						vector
 	Weights (W)							logical						vector
     OutputFileName (filename)           string                      1
     MaxMarginalSignificance             float                       1
+    
+    The sample dimension of X is the one matching the length of Y, rows when both match. With several
+    phenotypes the genotypes are packed once and every phenotype writes its own output files, named
+    after fileName with the suffix .phenotype<column>.
+    
+    With 'Permutations' the pair search is repeated under shuffled labels of a single phenotype. The
+    largest score of each permutation is written to fileName.permutations, headed by the count and
+    the 0.05 genome-wide threshold, and the reported pairs get empirical p-values in
+    fileName.reciprocalPairs.pvalues.
+    
+    Optional name/value pairs
+    ------------------------------
+    'Exhaustive'                        logical                     1   test every pair across groups
+    'MaxUnknownFraction'                float                       1   drop SNPs missing more genotypes, 0 keeps all
+    'MinMinorAlleleFrequency'           float                       1   drop SNPs with a rarer minor allele, 0 keeps all
+    'SnpSubset'                         logical/numeric             vector over the SNPs of X, as a mask
+                                                                        or 1-based indices, selecting the n
+                                                                        SNPs described by I, G and W
+    'Permutations'                      integer                     1   label permutations of the null, 0 runs none
+    'SnpRange'                          integer                     2   first and last of the n SNPs to test
+    'Shards'                            integer                     1   number of slices of the group pairs
+    'Shard'                             integer                     1   slice tested by this call, 1 to Shards
+    'MergeShards'                       logical                     1   merge the partial results of every slice
+    'CheckpointInterval'                float                       1   seconds between checkpoints of the pair
+                                                                        testing, 0 writes none
+    'Resume'                            logical                     1   continue from the checkpoint of a stopped call
+    'Triplets'                          integer                     1   top pairs seeding the three-SNP test, 0 runs none
+    'Statistic'                         string                      1   'ChiSquare', 'GTest', 'MutualInformation'
+                                                                        or 'InteractionContrast', scoring every table
+    'Model'                             string                      1   'Genotypic', 'Dominant', 'Recessive', 'Additive'
+                                                                        or 'All', coding the genotypes
+    'CaseOnly'                          logical                     1   screen the pairs with the case-only test
+    'Quantitative'                      logical                     1   the labels are a continuous trait, NaN unknown
+    'LDDifference'                      float                       1   group the SNPs by their genotypes instead of G,
+                                                                        0 uses G
+    'Hierarchical'                      float                       1   test the members of two groups only when their
+                                                                        roots score this fraction of the cutoff, 0 always
+    'GroundTruth'                       string                      1   reciprocalPairs.gt of a reference run in the
+                                                                        output directory to print the recall against
+    'Trees'                             integer                     1   groupings tested together, the groups and
+                                                                        randomized regroupings of them
+    
+    With 'Shards' and 'Shard' only that slice of the group pairs is tested, the same slices for the same
+    inputs, and its partial results are written to output/fileName.shard<Shard>of<Shards>. A call with
+    the same inputs, 'Shards' and 'MergeShards' then writes the outputs of a single call from them.
+    
+    With 'Triplets' the best pairs are each tested with every member of the LD groups of all these pairs
+    as a third SNP, on 27x2 tables. The best TRIPLET_TOP_K triples are written to
+    output/fileName.triplets with their score, ids, chromosomes and base pairs.
+    
+    With 'CheckpointInterval' the finished group pairs and the results so far are saved to
+    output/fileName.checkpoint, or the shard file name with .checkpoint, which is removed once the
+    testing finishes. A call with the same inputs and 'Resume' skips the pairs it holds, on any number of
+    threads. A checkpoint of other inputs, groups or scoring settings is ignored and the testing starts over.
+    
+    'Statistic' replaces the Pearson chi-square of the pair and triple tables by the G-test, the mutual
+    information in thousandths of a bit, or the Wald test of the one degree of freedom interaction
+    contrast on the carrier coding. Only the chi-square is pruned by its score bound, the others test
+    every group pair outside LD. The marginal filter keeps the chi-square thresholds.
+    
+    'Model' codes the genotypes of the pair tests and the marginal filter. 'Dominant' and 'Recessive'
+    merge two genotypes into 2x2x2 pair tables, 'Additive' scores the allele dosage by the trend test
+    whatever the statistic. 'All' scores every picked pair under the four models from one genotype
+    table and writes the outputs of each model suffixed by .genotypic, .dominant, .recessive and
+    .additive, filtering on the full genotypes. Models other than 'Genotypic' need a single label
+    column, no permutations and no triplets.
+    
+    With 'CaseOnly' the pairs are ranked by the popcovers of the cases and scored by the chi-square of
+    independence of their 3x3 case table, reading only the case segment of the planes. The outputs
+    hold these scores, and output/fileName.reciprocalPairs.confirmed adds the full case/control score
+    of every reciprocal pair under 'Statistic'. It needs a single label column, the genotypic model,
+    no permutations and no triplets.
+    
+    With 'Quantitative' the single label column is the trait itself, rounded to 8 bit fixed-point over
+    its range. The pairs are ranked by how far the trait of the samples sharing their minor genotypes
+    strays from its mean, and scored by the sum of squares the 9 genotype cell means explain beyond
+    the additive effects of both SNPs, over the within-cell mean square, with 4 degrees of freedom. The
+    marginal filter is the analysis of variance of the trait over the 3 genotypes of a SNP. It
+    replaces 'Statistic', and needs the genotypic model, no permutations, no triplets and no
+    case-only screen.
+    
+    With 'LDDifference' the group ids G are replaced by groups found from the genotypes. SNPs within
+    the LD range of each other are joined when their genotypes differ on at most this fraction of the
+    samples off the homozygous major genotype in either, and the groups are the SNPs joined directly
+    or through others. Candidate pairs come from hashing the genotypes at sampled samples, so only
+    SNPs sharing a hash are compared.
+    
+    With 'Hierarchical' every group pair is first tested on its roots, the representatives of the two
+    groups, and its member pairs are only ranked and tested when the roots score at least this
+    fraction of the running cutoff. The root tests are the internal tests of the summary printout,
+    the member tests the leaf tests. 'GroundTruth' names the reciprocalPairs.gt written by a reference
+    run, such as an exhaustive one, copied under another name, and the recall of the reciprocal pairs
+    against it is printed. It needs a single label column, a single model, no permutations, no
+    case-only screen and no quantitative trait.
+    
+    With 'Trees' above 1 the groups are tested along with Trees-1 randomized regroupings of them, each
+    dealing the SNPs of 8 neighbouring groups out again at random, so the top popcovers pick other
+    member pairs. The groupings share the packed genotypes and run in one pass, into the same
+    results, and a pair scored in one grouping is skipped in the others. It needs a single label
+    column, a single model, no permutations, no case-only screen, no quantitative trait, no shards,
+    no checkpoints and no exhaustive testing, which already scores every pair.
 */
 
 
 void displayUsageMessage() {
 	mexPrintf("Usage: epistasis_test(\n \
-		CaseFeatures X_1<Vector, cxn> ,\n \
-		ControlFeatures X_2<Vector, (m-c)xn> ,\n \
+		Features X<Matrix, mxn or nxm> ,\n \
+		Labels Y<Vector, m or Matrix, mxp> ,\n \
 		SNPInfo I <Matrix, nx3>,\n \
 		Group ids G<vector>,\n \
 		Weights W<vector>) \n \
         OutputFileName fileName\n \
-        MaxMarginalSignificance maxMarginalSignificance \
+        MaxMarginalSignificance maxMarginalSignificance,\n \
+        [Name, Value] ...) \
 		\n");
 }
 
+//Reads the optional name/value pairs following the required inputs
+void parseOptionalParameters(int nrhs, const mxArray *prhs[], ParameterInfo & parameterInfo, const mxArray * & snpSubset)
+{
+    if((nrhs-7) % 2 != 0)
+        mexErrMsgTxt("Optional parameters must be given as name/value pairs.");
+
+    for(int i=7; i<nrhs; i+=2)
+    {
+        if(!mxIsChar(prhs[i]))
+            mexErrMsgTxt("Optional parameter names must be strings.");
+        char * name = mxArrayToString(prhs[i]);
+        string option(name);
+        mxFree(name);
+
+        if(option == "Exhaustive")
+            parameterInfo.exhaustiveTesting_ = mxGetScalar(prhs[i+1]) != 0;
+        else if(option == "MaxUnknownFraction")
+            parameterInfo.maxUnknownFraction_ = mxGetScalar(prhs[i+1]);
+        else if(option == "MinMinorAlleleFrequency")
+            parameterInfo.minimumMinorAlleleFrequency_ = mxGetScalar(prhs[i+1]);
+        else if(option == "SnpRange")
+        {
+            if(mxGetNumberOfElements(prhs[i+1]) != 2 || !mxIsDouble(prhs[i+1]))
+                mexErrMsgTxt("SnpRange must be the first and last SNP to test.");
+            parameterInfo.snpBeginIndex_ = (int)mxGetPr(prhs[i+1])[0] - 1;
+            parameterInfo.snpEndIndex_ = (int)mxGetPr(prhs[i+1])[1];
+        }
+        else if(option == "Shards")
+            parameterInfo.numberShards_ = (int)mxGetScalar(prhs[i+1]);
+        else if(option == "Shard")
+            parameterInfo.shard_ = (int)mxGetScalar(prhs[i+1]) - 1;
+        else if(option == "MergeShards")
+            parameterInfo.mergeShards_ = mxGetScalar(prhs[i+1]) != 0;
+        else if(option == "CheckpointInterval")
+            parameterInfo.checkpointInterval_ = mxGetScalar(prhs[i+1]);
+        else if(option == "Resume")
+            parameterInfo.resume_ = mxGetScalar(prhs[i+1]) != 0;
+        else if(option == "Triplets")
+            parameterInfo.tripletSeedPairs_ = (int)mxGetScalar(prhs[i+1]);
+        else if(option == "Statistic")
+        {
+            if(!mxIsChar(prhs[i+1]))
+                mexErrMsgTxt("Statistic must be a string.");
+            char * value = mxArrayToString(prhs[i+1]);
+            string statistic(value);
+            mxFree(value);
+            if(statistic == "ChiSquare")
+                parameterInfo.statistic_ = PEARSON_CHI_SQUARE;
+            else if(statistic == "GTest")
+                parameterInfo.statistic_ = G_TEST;
+            else if(statistic == "MutualInformation")
+                parameterInfo.statistic_ = MUTUAL_INFORMATION;
+            else if(statistic == "InteractionContrast")
+                parameterInfo.statistic_ = INTERACTION_CONTRAST;
+            else
+                mexErrMsgTxt(("Unknown statistic: " + statistic).c_str());
+        }
+        else if(option == "CaseOnly")
+            parameterInfo.caseOnly_ = mxGetScalar(prhs[i+1]) != 0;
+        else if(option == "Quantitative")
+            parameterInfo.quantitative_ = mxGetScalar(prhs[i+1]) != 0;
+        else if(option == "LDDifference")
+            parameterInfo.ldDifference_ = mxGetScalar(prhs[i+1]);
+        else if(option == "Trees")
+            parameterInfo.noTrees_ = (int)mxGetScalar(prhs[i+1]);
+        else if(option == "Hierarchical")
+            parameterInfo.hierarchicalThreshold_ = mxGetScalar(prhs[i+1]);
+        else if(option == "GroundTruth")
+        {
+            if(!mxIsChar(prhs[i+1]))
+                mexErrMsgTxt("GroundTruth must be a string.");
+            char * value = mxArrayToString(prhs[i+1]);
+            parameterInfo.groundTruthFileName_ = value;
+            mxFree(value);
+        }
+        else if(option == "Model")
+        {
+            if(!mxIsChar(prhs[i+1]))
+                mexErrMsgTxt("Model must be a string.");
+            char * value = mxArrayToString(prhs[i+1]);
+            string model(value);
+            mxFree(value);
+            if(model == "Genotypic")
+                parameterInfo.model_ = GENOTYPIC_MODEL;
+            else if(model == "Dominant")
+                parameterInfo.model_ = DOMINANT_MODEL;
+            else if(model == "Recessive")
+                parameterInfo.model_ = RECESSIVE_MODEL;
+            else if(model == "Additive")
+                parameterInfo.model_ = ADDITIVE_MODEL;
+            else if(model == "All")
+                parameterInfo.model_ = ALL_MODELS;
+            else
+                mexErrMsgTxt(("Unknown model: " + model).c_str());
+        }
+        else if(option == "Permutations")
+            parameterInfo.permuteSamples_ = (int)mxGetScalar(prhs[i+1]);
+        else if(option == "SnpSubset")
+            snpSubset = prhs[i+1];
+        else
+            mexErrMsgTxt(("Unknown optional parameter: " + option).c_str());
+    }
+}
+
+//Splits the samples by one label column, whatever its numeric class
+void readLabels(const mxArray * labels, int column, int numberSamples, vector<int> & controlSamples, vector<int> & caseSamples)
+{
+    size_t offset = (size_t)column*numberSamples;
+    switch(mxGetClassID(labels))
+    {
+        case mxLOGICAL_CLASS: GenotypePacker::splitSamples(mxGetLogicals(labels) + offset, numberSamples, controlSamples, caseSamples); break;
+        case mxDOUBLE_CLASS: GenotypePacker::splitSamples(mxGetPr(labels) + offset, numberSamples, controlSamples, caseSamples); break;
+        case mxSINGLE_CLASS: GenotypePacker::splitSamples((const float*)mxGetData(labels) + offset, numberSamples, controlSamples, caseSamples); break;
+        case mxINT8_CLASS: GenotypePacker::splitSamples((const int8_t*)mxGetData(labels) + offset, numberSamples, controlSamples, caseSamples); break;
+        case mxUINT8_CLASS: GenotypePacker::splitSamples((const uint8_t*)mxGetData(labels) + offset, numberSamples, controlSamples, caseSamples); break;
+        default: mexErrMsgTxt("Labels must be logical, double, single, int8 or uint8.");
+    }
+}
+
+//The values of the first label column as a continuous trait
+vector<double> readTrait(const mxArray * labels, int numberSamples)
+{
+    vector<double> retVal(numberSamples);
+    for(int i=0; i<numberSamples; ++i)
+    {
+        switch(mxGetClassID(labels))
+        {
+            case mxDOUBLE_CLASS: retVal[i] = mxGetPr(labels)[i]; break;
+            case mxSINGLE_CLASS: retVal[i] = ((const float*)mxGetData(labels))[i]; break;
+            case mxINT8_CLASS: retVal[i] = ((const int8_t*)mxGetData(labels))[i]; break;
+            case mxUINT8_CLASS: retVal[i] = ((const uint8_t*)mxGetData(labels))[i]; break;
+            default: mexErrMsgTxt("A quantitative trait must be double, single, int8 or uint8.");
+        }
+    }
+    return retVal;
+}
+
+//Buffer SNP of every described SNP, from a mask or 1-based indices over the SNP dimension of X
+vector<int> readSnpSubset(const mxArray * snpSubset, int numberGenotypeSnps)
+{
+    vector<int> retVal;
+    if(snpSubset == NULL)
+    {
+        for(int i=0; i<numberGenotypeSnps; ++i)
+            retVal.push_back(i);
+    }
+    else if(mxIsLogical(snpSubset))
+    {
+        if(mxGetNumberOfElements(snpSubset) != numberGenotypeSnps)
+            mexErrMsgTxt("A logical SnpSubset must have one entry per SNP of X.");
+        const mxLogical * mask = mxGetLogicals(snpSubset);
+        for(int i=0; i<numberGenotypeSnps; ++i)
+            if(mask[i])
+                retVal.push_back(i);
+    }
+    else if(mxIsDouble(snpSubset))
+    {
+        const double * indices = mxGetPr(snpSubset);
+        for(int i=0; i<mxGetNumberOfElements(snpSubset); ++i)
+        {
+            if(indices[i] < 1 || indices[i] > numberGenotypeSnps)
+                mexErrMsgTxt("SnpSubset indices must lie within the SNPs of X.");
+            retVal.push_back((int)indices[i]-1);
+        }
+    }
+    else
+        mexErrMsgTxt("SnpSubset must be a logical mask or double indices.");
+    return retVal;
+}
+
+//Text of one SNP info cell, numeric cells are written out as integers
+const char * readInfoCell(const mxArray * cell, vector<char> & buffer)
+{
+    if(cell == NULL)
+        return "";
+    if(!mxIsChar(cell))
+    {
+        snprintf(buffer.data(), buffer.size(), "%lld", (long long int)mxGetScalar(cell));
+        return buffer.data();
+    }
+    
+    size_t length = mxGetNumberOfElements(cell)*sizeof(mxChar)+1;
+    if(buffer.size() < length)
+        buffer.resize(length);
+    mxGetString(cell, buffer.data(), length);
+    return buffer.data();
+}
+
+//Parses the id, chromosome and base pair columns of the SNP info cell array once
+SnpInfo readSnpInfo(const mxArray * info)
+{
+    mwSize numberSnps = mxGetM(info);
+    if(!mxIsCell(info) || mxGetN(info) < 3)
+        mexErrMsgTxt("SNP info must be a cell array with id, chromosome and position columns.");
+    
+    SnpInfo retVal;
+    retVal.reserve(numberSnps, numberSnps*16);
+    vector<char> buffer(64);
+    for(mwSize row=0; row < numberSnps; row++)
+    {
+        int8_t chromosome = retVal.parseChromosome(readInfoCell(mxGetCell(info, row + numberSnps), buffer));
+        int32_t basePair = SnpInfo::parseBasePair(readInfoCell(mxGetCell(info, row + 2*numberSnps), buffer));
+        retVal.addSnp(readInfoCell(mxGetCell(info, row), buffer), chromosome, basePair);
+    }
+    return retVal;
+}
+
+//Packs and filters for the one phenotype split into controlSamples and caseSamples, or for every phenotype of the set
+//with the samples in place, which permutations of a single phenotype and a quantitative trait need as well
+template<class T>
+vector<Snp> buildSnps(const mxArray * genotypes, const GenotypeLayout & layout, const vector<int> & controlSamples,
+                      const vector<int> & caseSamples, const PhenotypeSet & phenotypes, const QuantitativeTrait & trait, int snpEnd,
+                      const vector<double> & weights, float maxMarginalChiSquare, const ParameterInfo & parameterInfo,
+                      vector<DatasetSizeInfo> & datasetSizeInfos, vector<uint64_t> & activePhenotypes)
+{
+    if(parameterInfo.quantitative_)
+        return SnpPipeline::build((const T*)mxGetData(genotypes), layout, trait, parameterInfo.snpBeginIndex_, snpEnd,
+                                  weights, maxMarginalChiSquare, parameterInfo, datasetSizeInfos[0]);
+    if(phenotypes.size() > 1 || parameterInfo.permuteSamples_ > 0)
+        return SnpPipeline::build((const T*)mxGetData(genotypes), layout, phenotypes, parameterInfo.snpBeginIndex_, snpEnd,
+                                  weights, maxMarginalChiSquare, parameterInfo, datasetSizeInfos, activePhenotypes);
+    return SnpPipeline::build((const T*)mxGetData(genotypes), layout, controlSamples, caseSamples, parameterInfo.snpBeginIndex_, snpEnd,
+                              weights, maxMarginalChiSquare, parameterInfo, datasetSizeInfos[0]);
+}
+
+//Reciprocal pairs of one phenotype with their SNP info
+void writeFormattedResults(TopSnpList & topSnpList, const SnpInfo & snpInfo, string fileName, int topK)
+{
+    topSnpList.calculateFormattedResults();
+    vector<TopPairing> topPairs = topSnpList.getReciprocalPairs();
+    
+    ofstream ofs("output/" + fileName + ".reciprocalPairs.formatted");
+   
+    for(int j=min((size_t)topK, topPairs.size() )-1; j>=0; --j )
+    {
+        int snp1 = topPairs[j].indexes_.first;
+        int snp2 = topPairs[j].indexes_.second;
+        ofs<<topPairs[j].score_<<"\t"<<snpInfo.getId(snp1)<<"\t"<<snpInfo.getId(snp2)<<"\t"
+                        <<snpInfo.getChromosomeName(snp1)<<"\t"<<snpInfo.getChromosomeName(snp2)<<"\t"
+                        <<snpInfo.getBasePair(snp1)<<"\t"<<snpInfo.getBasePair(snp2)<<"\t"<<endl;
+    }
+
+    ofs.close();
+}
+
+//Best triples with their SNP info
+void writeTriplets(const TopTripletList & topTriplets, const SnpInfo & snpInfo, string fileName)
+{
+    vector<TopTriplet> triplets = topTriplets.getTriplets();
+    ofstream ofs("output/" + fileName + ".triplets");
+    for(int j=0; j<triplets.size(); ++j)
+    {
+        const array<int, 3> & snps = triplets[j].indexes_;
+        ofs<<triplets[j].score_;
+        for(int k=0; k<3; ++k)
+            ofs<<"\t"<<snpInfo.getId(snps[k]);
+        for(int k=0; k<3; ++k)
+            ofs<<"\t"<<snpInfo.getChromosomeName(snps[k]);
+        for(int k=0; k<3; ++k)
+            ofs<<"\t"<<snpInfo.getBasePair(snps[k]);
+        ofs<<endl;
+    }
+    ofs.close();
+}
+
+//Maxima of the permutations and the empirical p-value of every reciprocal pair
+void writePermutationResults(const PermutationTest & permutations, TopSnpList & topSnpList, const SnpInfo & snpInfo, string fileName, int topK)
+{
+    ofstream ofs("output/" + fileName + ".permutations");
+    ofs<<permutations.size()<<"\t"<<PERMUTATION_ALPHA<<"\t"<<permutations.getThreshold(PERMUTATION_ALPHA)<<endl;
+    permutations.printMaxima(ofs);
+    ofs.close();
+    
+    vector<TopPairing> topPairs = topSnpList.getReciprocalPairs();
+    ofs.open("output/" + fileName + ".reciprocalPairs.pvalues");
+    for(int j=min((size_t)topK, topPairs.size() )-1; j>=0; --j )
+    {
+        ofs<<topPairs[j].score_<<"\t"<<snpInfo.getId(topPairs[j].indexes_.first)<<"\t"<<snpInfo.getId(topPairs[j].indexes_.second)<<"\t"
+           <<permutations.getEmpiricalPValue(topPairs[j].score_)<<endl;
+    }
+    ofs.close();
+}
+
+//Reciprocal pairs of a case-only screen with the full case/control score beside the case-only one
+void writeConfirmedPairs(const LDForest & ldforest, TopSnpList & topSnpList, const SnpInfo & snpInfo, string fileName, int topK, int statistic)
+{
+    vector<TopPairing> topPairs = topSnpList.getReciprocalPairs();
+    if(topPairs.size() > topK)
+        topPairs.erase(topPairs.begin() + topK, topPairs.end());
+    vector<float> confirmed = ldforest.confirmPairs(topPairs, statistic);
+    
+    ofstream ofs("output/" + fileName + ".reciprocalPairs.confirmed");
+    for(int j=topPairs.size()-1; j>=0; --j)
+        ofs<<topPairs[j].score_<<"\t"<<confirmed[j]<<"\t"<<snpInfo.getId(topPairs[j].indexes_.first)<<"\t"
+           <<snpInfo.getId(topPairs[j].indexes_.second)<<endl;
+    ofs.close();
+}
+
 void mexFunction(int nlhs, mxArray *plhs[],
 	int nrhs, const mxArray *prhs[])
 {
+	if (nrhs < 7) {
+		displayUsageMessage();
+		mexErrMsgTxt("Seven inputs are required.");
+	}
+
 	double* w_ = mxGetPr(prhs[4]);
 	double* g_ = mxGetPr(prhs[3]);
 	mwSize nRowWeights = mxGetM(prhs[4]);
@@ -76,72 +486,120 @@ void mexFunction(int nlhs, mxArray *plhs[],
 		regionIndices.push_back(g_[i]);
 	}
 
-	// Read in the data
-    Matrix<string> infoMatrix;
-	mwSize col_outputBuff     = mxGetN(prhs[2]);
-	mwSize row_outputBuff     = mxGetM(prhs[2]);
-
-    const mxArray *cell_element_ptr;
-    char* c_array;
-    mwSize buflen;
-    int status;
-    // Read in the data
-	for (mwSize row=0; row < row_outputBuff; row++) {
-		vector<string> parsedRow;
-		for (mwSize col=0; col < col_outputBuff; col++) {
-			cell_element_ptr = mxGetCell(prhs[2],row+col*row_outputBuff);
-			buflen = mxGetN(cell_element_ptr)*sizeof(mxChar)+1;
-		    c_array = (char*)mxMalloc(buflen);
-		    status = mxGetString(cell_element_ptr,c_array,buflen);
- 			parsedRow.push_back(std::string(c_array));
-    		mxFree(c_array);
-	  	}
-	  	infoMatrix.addRow(parsedRow);
-	}
-
-	Matrix<char> casesMatrix; 
-	Matrix<char> controlsMatrix;
-
-	double* caseBuff = mxGetPr(prhs[0]);
-	col_outputBuff     = mxGetN(prhs[0]);
-	row_outputBuff     = mxGetM(prhs[0]);
-	// Read in the data
-	for (mwSize row=0; row < row_outputBuff; row++) {
-		vector<char> parsedRow;
-		for (mwSize col=0; col < col_outputBuff; col++) {
-			parsedRow.push_back(((int)caseBuff[row+col*row_outputBuff])+'0');
-      }
-	  casesMatrix.addRow(parsedRow);
-	}
-
-	double* controlBuff = mxGetPr(prhs[1]);
-	col_outputBuff     = mxGetN(prhs[1]);
-	row_outputBuff     = mxGetM(prhs[1]);
-	// Read in the data
-	for (mwSize row=0; row < row_outputBuff; row++) {
-		vector<char> parsedRow;
-		for (mwSize col=0; col < col_outputBuff; col++) {
-			parsedRow.push_back(((int)controlBuff[row+col*row_outputBuff])+'0');
-	  	}
-	  controlsMatrix.addRow(parsedRow);
-	}
-
+	SnpInfo snpInfo = readSnpInfo(prhs[2]);
 
-    //If any of the files were read incorrectly exit
-    if(infoMatrix.size() == 0 || casesMatrix.size() == 0 || controlsMatrix.size() == 0)
-        exit(-1);
-    //Recored the initial size of the dataset read in
-    DatasetSizeInfo datasetSizeInfo;
-    datasetSizeInfo.snps_ = infoMatrix.dim(0);
-    datasetSizeInfo.cases_ = casesMatrix.dim(1);
-    datasetSizeInfo.controls_ = controlsMatrix.dim(1);
-    datasetSizeInfo.marginalSignificanceRemoved_ = 0;
-    datasetSizeInfo.filterFileRemoved_ = 0;
+	//Genotypes stay in the mxArray buffer and are packed straight into the Snps below
+	const mxArray * genotypes = prhs[0];
+	//One label column per phenotype
+	mwSize numberSamples = mxGetM(prhs[1]) > 1 ? mxGetM(prhs[1]) : mxGetNumberOfElements(prhs[1]);
+	int numberPhenotypes = numberSamples > 0 ? mxGetNumberOfElements(prhs[1])/numberSamples : 0;
+	if(numberPhenotypes > MAX_PHENOTYPES)
+		mexErrMsgTxt("At most 64 phenotypes can be tested at once.");
+	
     ParameterInfo parameterInfo;
     parameterInfo.snpBeginIndex_ = 0;
-    parameterInfo.snpEndIndex_ = infoMatrix.dim(0);
+    parameterInfo.snpEndIndex_ = snpInfo.size();
     parameterInfo.maxUnknownFraction_ = 0;
+    parameterInfo.minimumMinorAlleleFrequency_ = 0;
     parameterInfo.maxThreadUsage_ = 20;
+    parameterInfo.exhaustiveTesting_ = false;
+    parameterInfo.permuteSamples_ = 0;
+    parameterInfo.numberShards_ = 1;
+    parameterInfo.shard_ = 0;
+    parameterInfo.mergeShards_ = false;
+    parameterInfo.checkpointInterval_ = 0;
+    parameterInfo.resume_ = false;
+    parameterInfo.tripletSeedPairs_ = 0;
+    parameterInfo.statistic_ = PEARSON_CHI_SQUARE;
+    parameterInfo.model_ = GENOTYPIC_MODEL;
+    parameterInfo.caseOnly_ = false;
+    parameterInfo.quantitative_ = false;
+    parameterInfo.ldDifference_ = 0;
+    parameterInfo.hierarchicalThreshold_ = 0;
+    parameterInfo.noTrees_ = 1;
+    const mxArray * snpSubset = NULL;
+    parseOptionalParameters(nrhs, prhs, parameterInfo, snpSubset);
+	if(parameterInfo.quantitative_ && numberPhenotypes != 1)
+		mexErrMsgTxt("A quantitative trait must be a single label column.");
+	
+	vector<int> controlSamples;
+	vector<int> caseSamples;
+	PhenotypeSet phenotypes(numberSamples);
+	//Every sample is a control of the planes, the trait only holds the known ones
+	QuantitativeTrait trait(parameterInfo.quantitative_ ? readTrait(prhs[1], numberSamples) : vector<double>());
+	//Recored the initial size of the dataset read in, for every phenotype
+	vector<DatasetSizeInfo> datasetSizeInfos(numberPhenotypes);
+	for(int p=0; p<numberPhenotypes; ++p)
+	{
+		if(parameterInfo.quantitative_)
+		{
+			for(int i=0; i<numberSamples; ++i)
+				controlSamples.push_back(i);
+			if(snpInfo.size() == 0 || trait.getKnownNo() == 0)
+				exit(-1);
+		}
+		else
+		{
+			readLabels(prhs[1], p, numberSamples, controlSamples, caseSamples);
+			//If any of the files were read incorrectly exit
+			if(snpInfo.size() == 0 || caseSamples.empty() || controlSamples.empty())
+				exit(-1);
+			phenotypes.addPhenotype(caseSamples);
+		}
+		
+		datasetSizeInfos[p].snps_ = snpInfo.size();
+		datasetSizeInfos[p].cases_ = caseSamples.size();
+		datasetSizeInfos[p].controls_ = controlSamples.size();
+		datasetSizeInfos[p].marginalSignificanceRemoved_ = 0;
+		datasetSizeInfos[p].mafRemoved_ = 0;
+		datasetSizeInfos[p].unknownRemoved_ = 0;
+		datasetSizeInfos[p].filterFileRemoved_ = 0;
+	}
+	if(numberPhenotypes == 0)
+		exit(-1);
+	
+
+	bool samplesAsRows = mxGetM(genotypes) == numberSamples;
+	if(!samplesAsRows && mxGetN(genotypes) != numberSamples)
+		mexErrMsgTxt("One dimension of the features must match the length of the labels.");
+	int numberGenotypeSnps = samplesAsRows ? mxGetN(genotypes) : mxGetM(genotypes);
+	
+	GenotypeLayout layout;
+	layout.snpStride_ = samplesAsRows ? mxGetM(genotypes) : 1;
+	layout.sampleStride_ = samplesAsRows ? 1 : mxGetM(genotypes);
+	int numberCases = datasetSizeInfos[0].cases_;
+	int numberControls = datasetSizeInfos[0].controls_;
+
+    if(parameterInfo.numberShards_ < 1 || parameterInfo.shard_ < 0 || parameterInfo.shard_ >= parameterInfo.numberShards_)
+        mexErrMsgTxt("Shard must lie between 1 and Shards.");
+    if(parameterInfo.snpBeginIndex_ < 0 || parameterInfo.snpBeginIndex_ >= parameterInfo.snpEndIndex_)
+        mexErrMsgTxt("SnpRange must select at least one SNP.");
+    bool shardRun = parameterInfo.numberShards_ > 1 && !parameterInfo.mergeShards_;
+    bool testPermutations = parameterInfo.permuteSamples_ > 0;
+    if(testPermutations && numberPhenotypes > 1)
+        mexErrMsgTxt("Permutations need a single label column.");
+    if(testPermutations && parameterInfo.numberShards_ > 1)
+        mexErrMsgTxt("Permutations can not be split into shards.");
+    bool testTriplets = parameterInfo.tripletSeedPairs_ > 0 && !shardRun;
+    if(testTriplets && (numberPhenotypes > 1 || testPermutations))
+        mexErrMsgTxt("Triplets need a single label column and no permutations.");
+    bool allModels = parameterInfo.model_ == ALL_MODELS;
+    if(parameterInfo.model_ != GENOTYPIC_MODEL && (numberPhenotypes > 1 || testPermutations || testTriplets))
+        mexErrMsgTxt("Genetic models need a single label column, no permutations and no triplets.");
+    if(parameterInfo.caseOnly_ && (numberPhenotypes > 1 || testPermutations || testTriplets || parameterInfo.model_ != GENOTYPIC_MODEL))
+        mexErrMsgTxt("The case-only test needs a single label column, the genotypic model, no permutations and no triplets.");
+    if(parameterInfo.quantitative_ && (testPermutations || testTriplets || parameterInfo.model_ != GENOTYPIC_MODEL || parameterInfo.caseOnly_))
+        mexErrMsgTxt("The quantitative test needs the genotypic model, no permutations, no triplets and no case-only screen.");
+    if(parameterInfo.hierarchicalThreshold_ > 0 && (numberPhenotypes > 1 || testPermutations || allModels || parameterInfo.caseOnly_ || parameterInfo.quantitative_))
+        mexErrMsgTxt("The hierarchical test needs a single label column, a single model, no permutations, no case-only screen and no quantitative trait.");
+    //Exhaustive groupings would all score the same pairs, through the filter
+    if(parameterInfo.noTrees_ > 1 && (numberPhenotypes > 1 || testPermutations || allModels || parameterInfo.caseOnly_ || parameterInfo.quantitative_
+                                      || parameterInfo.numberShards_ > 1 || parameterInfo.checkpointInterval_ > 0 || parameterInfo.exhaustiveTesting_))
+        mexErrMsgTxt("Several trees need a single label column, a single model, no permutations, no case-only screen, no quantitative trait, no shards, no checkpoints and no exhaustive testing.");
+    vector<int> snpRows = readSnpSubset(snpSubset, numberGenotypeSnps);
+    if(snpRows.size() != snpInfo.size())
+        mexErrMsgTxt("The SNPs selected from the features must match the rows of the SNP info.");
+    layout.snpRows_ = snpRows.data();
     int topK = 2000;
 
     int maxMarginalSignificance = (int)mxGetScalar(prhs[6]); 
@@ -149,9 +607,12 @@ void mexFunction(int nlhs, mxArray *plhs[],
 
     char *filename;
     string outputFileName;
+    const mxArray *cell_element_ptr;
+    mwSize buflen;
+    int status;
      /* Find out how long the input string array is. */
-    col_outputBuff     = mxGetN(prhs[5]);
-    row_outputBuff     = mxGetM(prhs[5]);
+    mwSize col_outputBuff     = mxGetN(prhs[5]);
+    mwSize row_outputBuff     = mxGetM(prhs[5]);
     // Read in the data
     for (mwSize row=0; row < row_outputBuff; row++) {
         for (mwSize col=0; col < col_outputBuff; col++) {
@@ -164,71 +625,119 @@ void mexFunction(int nlhs, mxArray *plhs[],
         }
     }
     parameterInfo.outputFileName_ = outputFileName;
-    //Call snp constructors to create bitwise snp representations
+    //Pack, filter and compact the SNPs into bitwise snp representations in one parallel pass
     vector<Snp> snps;
-    
-    for(int i= parameterInfo.snpBeginIndex_; ceil(i)<min( parameterInfo.snpEndIndex_, infoMatrix.dim(0)); ++i)
+    vector<uint64_t> activePhenotypes;
+    int snpEnd = min( parameterInfo.snpEndIndex_, snpInfo.size());
+    float maxMarginalChiSquare = chi2DegreesFreedomTable[parameterInfo.maxMarginalSignificance_];
+    switch(mxGetClassID(genotypes))
     {
-        snps.push_back(Snp(i, controlsMatrix.getRow(i), casesMatrix.getRow(i), weights[i]));
+        case mxDOUBLE_CLASS: snps = buildSnps<double>(genotypes, layout, controlSamples, caseSamples, phenotypes, trait, snpEnd, weights, maxMarginalChiSquare, parameterInfo, datasetSizeInfos, activePhenotypes); break;
+        case mxSINGLE_CLASS: snps = buildSnps<float>(genotypes, layout, controlSamples, caseSamples, phenotypes, trait, snpEnd, weights, maxMarginalChiSquare, parameterInfo, datasetSizeInfos, activePhenotypes); break;
+        case mxINT8_CLASS: snps = buildSnps<int8_t>(genotypes, layout, controlSamples, caseSamples, phenotypes, trait, snpEnd, weights, maxMarginalChiSquare, parameterInfo, datasetSizeInfos, activePhenotypes); break;
+        case mxUINT8_CLASS: snps = buildSnps<uint8_t>(genotypes, layout, controlSamples, caseSamples, phenotypes, trait, snpEnd, weights, maxMarginalChiSquare, parameterInfo, datasetSizeInfos, activePhenotypes); break;
+        case mxLOGICAL_CLASS: snps = buildSnps<mxLogical>(genotypes, layout, controlSamples, caseSamples, phenotypes, trait, snpEnd, weights, maxMarginalChiSquare, parameterInfo, datasetSizeInfos, activePhenotypes); break;
+        default: mexErrMsgTxt("Features must be double, single, int8, uint8 or logical.");
     }
-    
 
-    LDForest ldforest( infoMatrix.dim(0) , controlsMatrix.dim(1), casesMatrix.dim(1), infoMatrix.dim(0));
+    //The genotype moments of the trait are counted once per SNP rather than for every pair tested
+    if(parameterInfo.quantitative_)
+        trait.summarize(snps, parameterInfo.maxThreadUsage_);
 
-    //Only create from snps with low enough marginal significance
+    // assign SNPs to the regions they belong
+    vector<int> tmpRegionInd;
+    tmpRegionInd.reserve(snps.size());
+    for(int i = 0 ; i < snps.size(); i++) {
+    	tmpRegionInd.push_back(regionIndices[snps[i].getIndex()]);
+    }
+
+    LDForest ldforest( snpInfo.size() , numberControls, numberCases, snpInfo.size());
+    if(numberPhenotypes > 1 || testPermutations)
+        ldforest.setPhenotypes(&phenotypes);
+    if(allModels)
+        ldforest.setAllModels();
+    if(parameterInfo.quantitative_)
+        ldforest.setQuantitativeTrait(&trait);
+    ldforest.reserve(snps.size());
     for(int i=0; i<snps.size(); ++i)
-    {  
-        if(snps[i].marginalTest() > chi2DegreesFreedomTable[parameterInfo.maxMarginalSignificance_])
-        {
-            datasetSizeInfo.marginalSignificanceRemoved_++;
-            regionIndices[i] = -1;
-        }
+    {
+        GenomeLocation location = snpInfo.getGenomeLocation(snps[i].getIndex());
+        if(numberPhenotypes > 1)
+            ldforest.insert(move(snps[i]), location, activePhenotypes[i]);
         else
-        {
-            if(isdigit(infoMatrix.a(snps[i].getIndex(),1)[0]));
-            {
-                ldforest.insert(snps[i], (char)stoi(infoMatrix.a(snps[i].getIndex(),1)), stoi(infoMatrix.a(snps[i].getIndex(),2))); 
-            }   
-        }    
+            ldforest.insert(move(snps[i]), location);
     }
+    snps.clear();
 
-    datasetSizeInfo.passingSnps_ = ldforest.size();
-    cout<<"---SNPs in LDForest = "<<ldforest.size()<<endl;
-    cout<<"\tSNPs Removed Marginal Significance: "<<datasetSizeInfo.marginalSignificanceRemoved_<<endl;
-    // assign SNPs to the regions they belong
-    vector<int> tmpRegionInd;
-    tmpRegionInd.reserve(ldforest.size());
-    for(int i = 0 ; i < snps.size(); i++) {
-    	if(regionIndices[i]!=-1)
-    		tmpRegionInd.push_back(regionIndices[i]);
+    cout<<"---SNPs in LDForest = "<<ldforest.getNumberSnps()<<endl;
+    for(int p=0; p<numberPhenotypes; ++p)
+    {
+        datasetSizeInfos[p].passingSnps_ = ldforest.getNumberSnps();
+        if(numberPhenotypes > 1)
+        {
+            datasetSizeInfos[p].passingSnps_ = 0;
+            for(int i=0; i<activePhenotypes.size(); ++i)
+                datasetSizeInfos[p].passingSnps_ += (activePhenotypes[i]>>p) & 1;
+            cout<<"\tPhenotype "<<p+1<<": "<<datasetSizeInfos[p].passingSnps_<<" SNPs"<<endl;
+        }
+        cout<<"\tSNPs Removed Marginal Significance: "<<datasetSizeInfos[p].marginalSignificanceRemoved_<<endl;
+        cout<<"\tSNPs Removed Minor Allele Frequency: "<<datasetSizeInfos[p].mafRemoved_<<endl;
+        cout<<"\tSNPs Removed Unknown Fraction: "<<datasetSizeInfos[p].unknownRemoved_<<endl;
     }
 
     vector<vector<int>> snp_ind_per_region;
     int no_of_regions = tmpRegionInd[tmpRegionInd.size()-1];
     snp_ind_per_region.resize(no_of_regions);
     
-    for(int i = 0 ; i < ldforest.size(); i++) {
+    for(int i = 0 ; i < ldforest.getNumberSnps(); i++) {
     	snp_ind_per_region[tmpRegionInd[i]-1].push_back(i);
     }
-    TopSnpList topSnpList_;
-    if(ldforest.size() > 1)
+    if(ldforest.getNumberSnps() > 1)
     {   
-        ldforest.createGroups(snp_ind_per_region);
-        ldforest.testGroups(parameterInfo.maxThreadUsage_, parameterInfo);
-        topSnpList_ = ldforest.writeResults(parameterInfo.outputFileName_, parameterInfo, datasetSizeInfo);
+        if(parameterInfo.ldDifference_ > 0)
+            ldforest.createLDGroups(parameterInfo.ldDifference_, parameterInfo.maxThreadUsage_);
+        else
+            ldforest.createGroups(snp_ind_per_region);
+        if(parameterInfo.noTrees_ > 1)
+            ldforest.createRandomGroupings(parameterInfo.noTrees_);
+        if(!parameterInfo.mergeShards_)
+            ldforest.testGroups(parameterInfo.maxThreadUsage_, parameterInfo);
     }
+    //A shard only leaves its partial results for the merge
+    if(shardRun)
+    {
+        ldforest.writeShard(parameterInfo.outputFileName_, parameterInfo.shard_, parameterInfo.numberShards_);
+        return;
+    }
+    if(parameterInfo.mergeShards_ && !ldforest.mergeShards(parameterInfo.outputFileName_, parameterInfo.numberShards_))
+        mexErrMsgTxt("The partial results of every shard must be in the output directory.");
+    TopTripletList topTriplets(TRIPLET_TOP_K);
+    if(testTriplets && ldforest.getNumberSnps() > 2)
+    {
+        ldforest.testTriplets(parameterInfo.maxThreadUsage_, parameterInfo.tripletSeedPairs_, parameterInfo.statistic_, topTriplets);
+        writeTriplets(topTriplets, snpInfo, parameterInfo.outputFileName_);
+    }
+    //Shuffled case masks over the samples packed in place, the groups above are reused
+    PermutationTest permutations(numberSamples, numberCases, parameterInfo.permuteSamples_, PERMUTATION_SEED);
+    if(testPermutations && ldforest.getNumberSnps() > 1)
+        ldforest.testPermutations(permutations, parameterInfo.maxThreadUsage_, parameterInfo);
     
-    topSnpList_.calculateFormattedResults();
-    vector<TopPairing> topPairs = topSnpList_.getReciprocalPairs();
-    
-    ofstream ofs("output/" + parameterInfo.outputFileName_ + ".reciprocalPairs.formatted");
-   
-    for(int j=min((size_t)topK, topPairs.size() )-1; j>=0; --j )
+    //Every phenotype gets its own output files, suffixed by its column of the labels, and so does every model
+    string baseFileName = parameterInfo.outputFileName_;
+    int numberLists = allModels ? NUMBER_MODELS : numberPhenotypes;
+    for(int p=0; p<numberLists; ++p)
     {
-        ofs<<topPairs[j].score_<<"\t"<<infoMatrix.a(topPairs[j].indexes_.first, 0)<<"\t"<<infoMatrix.a(topPairs[j].indexes_.second, 0)<<"\t"
-                        <<infoMatrix.a(topPairs[j].indexes_.first, 1)<<"\t"<<infoMatrix.a(topPairs[j].indexes_.second, 1)<<"\t"
-                        <<infoMatrix.a(topPairs[j].indexes_.first, 2)<<"\t"<<infoMatrix.a(topPairs[j].indexes_.second, 2)<<"\t"<<endl;
+        if(allModels)
+            parameterInfo.outputFileName_ = baseFileName + "." + geneticModelName(p);
+        else if(numberPhenotypes > 1)
+            parameterInfo.outputFileName_ = baseFileName + ".phenotype" + to_string(p+1);
+        TopSnpList topSnpList_;
+        if(ldforest.getNumberSnps() > 1)
+            topSnpList_ = ldforest.writeResults(parameterInfo.outputFileName_, parameterInfo, datasetSizeInfos[allModels ? 0 : p], p);
+        writeFormattedResults(topSnpList_, snpInfo, parameterInfo.outputFileName_, topK);
+        if(parameterInfo.caseOnly_ && ldforest.getNumberSnps() > 1)
+            writeConfirmedPairs(ldforest, topSnpList_, snpInfo, parameterInfo.outputFileName_, topK, parameterInfo.statistic_);
+        if(testPermutations)
+            writePermutationResults(permutations, topSnpList_, snpInfo, parameterInfo.outputFileName_, topK);
     }
-
-    ofs.close();
-}
\ No newline at end of file
+}
@@ -1,4 +1,4 @@
-function potpourri( X, Y, W, k, R, SNP_info, b, omega, maxMarginalSignificance, outputFileName)
+function potpourri( X, Y, W, k, R, SNP_info, b, omega, maxMarginalSignificance, outputFileName, varargin)
     p = inputParser;
     p.CaseSensitive = false;
     validInfo = @(x) validateattributes(x, {'string'}, ...
@@ -12,7 +12,7 @@ function potpourri( X, Y, W, k, R, SNP_info, b, omega, maxMarginalSignificance,
     addRequired(p, 'maxMarginalSignificance', validIntegerScalar);
     addRequired(p, 'omega', validFloat);
 
-    [indicators, Info] = spadis_logistic(double(X), Y, W, k, R, omega);
+    [indicators, Info] = spadis_logistic(X, Y, W, k, R, omega);
     group_ids = zeros(size(indicators,1),1);
     chr_info =  str2double(SNP_info(:,2));
     group_ind = 1;
@@ -30,7 +30,8 @@ function potpourri( X, Y, W, k, R, SNP_info, b, omega, maxMarginalSignificance,
         group_ids(chr_info == chr) = group_ids_chr;
     end
     Y = logical(Y);
-    epistasis_test_mex(transpose(X(Y,indicators)), transpose(X(~Y,indicators)), SNP_info(indicators,:), group_ids(indicators), R(indicators), cellstr(outputFileName), maxMarginalSignificance);
+    % X is passed as is, the mex splits cases from controls by Y and reads only the selected SNPs
+    epistasis_test_mex(X, Y, SNP_info(indicators,:), group_ids(indicators), R(indicators), cellstr(outputFileName), maxMarginalSignificance, 'SnpSubset', indicators, varargin{:});
 end
 
 